@@ -0,0 +1,217 @@
+#include "cpuplacement.h"
+#include <QStringList>
+#include <QDebug>
+
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ifaddrs.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+QList<int> CpuPlacement::parseCpuList(QString cpuList)
+{
+    QList<int> t_cpus;
+    QString t_part;
+    QStringList t_range;
+    bool t_ok1;
+    bool t_ok2;
+    int t_first;
+    int t_last;
+
+    foreach (t_part, cpuList.trimmed().split(',')) {
+        t_part = t_part.trimmed();
+        if (t_part.isEmpty()) {
+            continue;
+        }
+        t_range = t_part.split('-');
+        t_first = t_range[0].toInt(&t_ok1);
+        t_last = (t_range.size() == 2) ? t_range[1].toInt(&t_ok2) : t_first;
+        if (t_range.size() == 2 && !t_ok2) {
+            t_ok1 = false;
+        }
+        if (!t_ok1 || t_range.size() > 2 || t_first < 0 || t_last < t_first || t_last >= MAX_CPUS) {
+            return QList<int>();
+        }
+        for (int t_cpu = t_first; t_cpu <= t_last; t_cpu++) {
+            if (!t_cpus.contains(t_cpu)) {
+                t_cpus.append(t_cpu);
+            }
+        }
+    }
+
+    return t_cpus;
+}
+
+QString CpuPlacement::cpuListName(const QList<int> &cpus)
+{
+    QStringList t_parts;
+    int i = 0;
+    int j;
+
+    while (i < cpus.size()) {
+        // Consecutive CPUs are written as a range
+        j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+            j++;
+        }
+        if (j > i) {
+            t_parts.append(QString::number(cpus[i]) + "-" + QString::number(cpus[j]));
+        } else {
+            t_parts.append(QString::number(cpus[i]));
+        }
+        i = j + 1;
+    }
+
+    return t_parts.join(",");
+}
+
+QList<int> CpuPlacement::allowedCpus()
+{
+    QList<int> t_cpus;
+    cpu_set_t t_set;
+
+    CPU_ZERO(&t_set);
+    if (sched_getaffinity(0, sizeof (t_set), &t_set) < 0) {
+        return t_cpus;
+    }
+    for (int t_cpu = 0; t_cpu < CPU_SETSIZE && t_cpu < MAX_CPUS; t_cpu++) {
+        if (CPU_ISSET(t_cpu, &t_set)) {
+            t_cpus.append(t_cpu);
+        }
+    }
+
+    return t_cpus;
+}
+
+/* Reads the first line of a sysfs file, empty if the file does not exist */
+static QString readSysfs(QString path)
+{
+    char t_line[4096];
+    QString t_value;
+
+    FILE *t_file = fopen(path.toLatin1().constData(), "r");
+    if (t_file == NULL) {
+        return t_value;
+    }
+    if (fgets(t_line, sizeof (t_line), t_file) != NULL) {
+        t_value = QString(t_line).trimmed();
+    }
+    fclose(t_file);
+
+    return t_value;
+}
+
+QList<int> CpuPlacement::nodeCpus(int node)
+{
+    if (node < 0) {
+        return QList<int>();
+    }
+
+    return parseCpuList(readSysfs("/sys/devices/system/node/node" + QString::number(node) + "/cpulist"));
+}
+
+int CpuPlacement::cpuNode(int cpu)
+{
+    // The node is a link in the directory of the CPU, we look through the nodes instead
+    for (int t_node = 0; t_node < 64; t_node++) {
+        const QString t_cpuList = readSysfs("/sys/devices/system/node/node" + QString::number(t_node) + "/cpulist");
+        if (t_cpuList.isEmpty()) {
+            continue;
+        }
+        if (parseCpuList(t_cpuList).contains(cpu)) {
+            return t_node;
+        }
+    }
+
+    return -1;
+}
+
+QString CpuPlacement::routeInterface(QHostAddress destination)
+{
+    struct sockaddr_in t_address;
+    socklen_t t_addressLength = sizeof (t_address);
+    struct ifaddrs *t_interfaces;
+    struct ifaddrs *t_interface;
+    QString t_name;
+
+    /* Connecting an UDP socket lets the kernel choose our source address, without sending anything */
+    const int t_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (t_socket < 0) {
+        return t_name;
+    }
+    memset(&t_address, 0, sizeof (t_address));
+    t_address.sin_family = AF_INET;
+    t_address.sin_addr.s_addr = htonl(destination.toIPv4Address());
+    t_address.sin_port = htons(7);
+    if (connect(t_socket, (struct sockaddr *)&t_address, sizeof (t_address)) < 0
+            || getsockname(t_socket, (struct sockaddr *)&t_address, &t_addressLength) < 0) {
+        close(t_socket);
+        return t_name;
+    }
+    close(t_socket);
+
+    /* The interface which owns our source address */
+    if (getifaddrs(&t_interfaces) < 0) {
+        return t_name;
+    }
+    for (t_interface = t_interfaces; t_interface != NULL; t_interface = t_interface->ifa_next) {
+        if (t_interface->ifa_addr != NULL && t_interface->ifa_addr->sa_family == AF_INET
+                && reinterpret_cast<struct sockaddr_in *>(t_interface->ifa_addr)->sin_addr.s_addr == t_address.sin_addr.s_addr) {
+            t_name = t_interface->ifa_name;
+            break;
+        }
+    }
+    freeifaddrs(t_interfaces);
+
+    return t_name;
+}
+
+int CpuPlacement::interfaceNode(QString interfaceName)
+{
+    bool t_ok;
+
+    if (interfaceName.isEmpty()) {
+        return -1;
+    }
+    // Virtual interfaces have no device, single node machines report -1
+    const int t_node = readSysfs("/sys/class/net/" + interfaceName + "/device/numa_node").toInt(&t_ok);
+
+    return t_ok ? t_node : -1;
+}
+
+bool CpuPlacement::pinCurrentThread(int cpu)
+{
+    cpu_set_t t_set;
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    CPU_ZERO(&t_set);
+    CPU_SET(cpu, &t_set);
+    if (sched_setaffinity(0, sizeof (t_set), &t_set) < 0) {
+        qDebug() << "CpuPlacement::pinCurrentThread: could not pin the thread to CPU" << cpu;
+        return false;
+    }
+
+    return true;
+}
+
+bool CpuPlacement::preferNode(int node)
+{
+    if (node < 0 || node >= static_cast<int>(sizeof (unsigned long) * 8)) {
+        return false;
+    }
+
+    // We do not depend on libnuma, set_mempolicy() is called directly
+    unsigned long t_nodeMask = 1UL << node;
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &t_nodeMask, sizeof (t_nodeMask) * 8) < 0) {
+        qDebug() << "CpuPlacement::preferNode: could not prefer the memory of node" << node;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef CPUPLACEMENT_H
+#define CPUPLACEMENT_H
+
+#include <QHostAddress>
+#include <QList>
+#include <QString>
+
+/* Where the threads run: CPU lists, NUMA nodes and pinning.
+ *
+ * On multi-socket machines, a thread far from the NIC pays for each packet crossing the
+ * interconnect. The "auto" policy keeps the threads on the CPUs of the NUMA node of the NIC
+ * which reaches the satellite, read from sysfs.
+ */
+class CpuPlacement
+{
+public:
+    // Parses a CPU list as in sysfs and taskset: "0-3,8,10-11". Returns an empty list on error.
+    static QList<int> parseCpuList(QString cpuList);
+    static QString cpuListName(const QList<int> &cpus);
+
+    // CPUs this process may run on (taskset, cgroups)
+    static QList<int> allowedCpus();
+    // CPUs of a NUMA node, empty if unknown
+    static QList<int> nodeCpus(int node);
+    // NUMA node of a CPU, -1 if unknown
+    static int cpuNode(int cpu);
+
+    // Interface the kernel uses to reach destination, empty if there is no route
+    static QString routeInterface(QHostAddress destination);
+    // NUMA node of the device of a network interface, -1 if unknown (e.g. virtual interfaces)
+    static int interfaceNode(QString interfaceName);
+
+    // Pins the calling thread to cpu. Returns false if the kernel refused.
+    static bool pinCurrentThread(int cpu);
+    /* Prefers node for the memory of the calling thread, so that the buffers it allocates
+     * are local. The kernel allocates socket buffers on the node of the CPU anyway.
+     * Returns false if the kernel refused.
+     */
+    static bool preferNode(int node);
+
+    static const int MAX_CPUS = 1024;
+};
+
+#endif // CPUPLACEMENT_H
@@ -0,0 +1,102 @@
+#include "crc32c.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+// Reflected polynomial of CRC32C
+static const quint32 CRC32C_POLYNOMIAL = 0x82f63b78;
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static quint32 computeHardware(const char *data, int length)
+{
+    quint64 t_crc = 0xffffffff;
+    quint64 t_word;
+
+    for (; length >= 8; length -= 8, data += 8) {
+        // The payloads of the raw backends are not aligned
+        memcpy(&t_word, data, 8);
+        t_crc = _mm_crc32_u64(t_crc, t_word);
+    }
+    for (; length > 0; length--, data++) {
+        t_crc = _mm_crc32_u8(static_cast<quint32>(t_crc), static_cast<quint8>(*data));
+    }
+
+    return ~static_cast<quint32>(t_crc);
+}
+#elif defined(__aarch64__)
+__attribute__((target("arch=armv8-a+crc")))
+static quint32 computeHardware(const char *data, int length)
+{
+    quint32 t_crc = 0xffffffff;
+    quint64 t_word;
+
+    for (; length >= 8; length -= 8, data += 8) {
+        memcpy(&t_word, data, 8);
+        t_crc = __crc32cd(t_crc, t_word);
+    }
+    for (; length > 0; length--, data++) {
+        t_crc = __crc32cb(t_crc, static_cast<quint8>(*data));
+    }
+
+    return ~t_crc;
+}
+#endif
+
+// Chosen before main(), so the threads only read it
+const Crc32c::Function Crc32c::s_compute = Crc32c::selectFunction();
+
+bool Crc32c::hardwareAccelerated()
+{
+    return s_compute != computeTable;
+}
+
+Crc32c::Function Crc32c::selectFunction()
+{
+#if defined(__x86_64__)
+    // We may run before the constructor of libgcc which fills the CPU model
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        return computeHardware;
+    }
+#elif defined(__aarch64__)
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+        return computeHardware;
+    }
+#endif
+    return computeTable;
+}
+
+quint32 Crc32c::computeTable(const char *data, int length)
+{
+    struct Table {
+        quint32 entries[256];
+        Table()
+        {
+            quint32 t_entry;
+            for (quint32 i = 0; i < 256; i++) {
+                t_entry = i;
+                for (int bit = 0; bit < 8; bit++) {
+                    t_entry = (t_entry & 1) ? (t_entry >> 1) ^ CRC32C_POLYNOMIAL : t_entry >> 1;
+                }
+                entries[i] = t_entry;
+            }
+        }
+    };
+    // Built by the first flow which needs it (thread safe since C++11)
+    static const Table table;
+    quint32 t_crc = 0xffffffff;
+
+    for (; length > 0; length--, data++) {
+        t_crc = table.entries[(t_crc ^ static_cast<quint8>(*data)) & 0xff] ^ (t_crc >> 8);
+    }
+
+    return ~t_crc;
+}
@@ -0,0 +1,28 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <QtGlobal>
+
+/* CRC32C (Castagnoli), the CRC of iSCSI and ext4.
+ *
+ * x86-64 CPUs with SSE4.2 and ARMv8 CPUs with the CRC extension compute it with one instruction per
+ * 8 bytes. The instructions are picked at run time, so the binary still runs on CPUs without them
+ * (with a table, about ten times slower).
+ */
+class Crc32c
+{
+public:
+    static inline quint32 compute(const char *data, int length) { return s_compute(data, length); }
+    // The CPU computes the CRC, not the table
+    static bool hardwareAccelerated();
+
+private:
+    typedef quint32 (*Function)(const char *data, int length);
+
+    static Function selectFunction();
+    static quint32 computeTable(const char *data, int length);
+
+    static const Function s_compute;
+};
+
+#endif // CRC32C_H
@@ -0,0 +1,329 @@
+#include "iouring.h"
+#include "udpiouringbackend.h"
+
+#include <QDebug>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <poll.h>
+#include <string.h>
+#include <errno.h>
+
+/* The io_uring system calls have no glibc wrappers */
+static inline int ioUringSetup(unsigned entries, struct io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags,
+                               void *arg, size_t argSize)
+{
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+static inline int ioUringRegister(int fd, unsigned opcode, void *arg, unsigned argCount)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, argCount);
+}
+
+IoUring::IoUring()
+{
+}
+
+IoUring::~IoUring()
+{
+    close();
+}
+
+bool IoUring::open(unsigned sqEntries)
+{
+    struct io_uring_params t_params;
+    memset(&t_params, 0, sizeof (t_params));
+    // Multishot receives produce many completions per submission
+    t_params.flags = IORING_SETUP_CQSIZE;
+    t_params.cq_entries = qMax(4 * sqEntries, 4096u);
+
+    m_ringFd = ioUringSetup(sqEntries, &t_params);
+    if (m_ringFd < 0) {
+        qDebug() << "IoUring::open: io_uring_setup failed, errno" << errno;
+        m_ringFd = -1;
+        return false;
+    }
+    m_features = t_params.features;
+
+    /* Map the rings. With IORING_FEAT_SINGLE_MMAP, both queues share one mapping */
+    m_sqRingSize = t_params.sq_off.array + t_params.sq_entries * sizeof (unsigned);
+    m_cqRingSize = t_params.cq_off.cqes + t_params.cq_entries * sizeof (struct io_uring_cqe);
+    if (m_features & IORING_FEAT_SINGLE_MMAP) {
+        m_sqRingSize = qMax(m_sqRingSize, m_cqRingSize);
+        m_cqRingSize = 0;
+    }
+
+    m_sqRing = mmap(NULL, m_sqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                    m_ringFd, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED) {
+        m_sqRing = NULL;
+        close();
+        return false;
+    }
+    if (m_cqRingSize > 0) {
+        m_cqRing = mmap(NULL, m_cqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                        m_ringFd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED) {
+            m_cqRing = NULL;
+            close();
+            return false;
+        }
+    } else {
+        m_cqRing = m_sqRing;
+    }
+    m_sqesSize = t_params.sq_entries * sizeof (struct io_uring_sqe);
+    m_sqes = static_cast<struct io_uring_sqe *>(mmap(NULL, m_sqesSize, PROT_READ|PROT_WRITE,
+                                                      MAP_SHARED|MAP_POPULATE, m_ringFd, IORING_OFF_SQES));
+    if (m_sqes == MAP_FAILED) {
+        m_sqes = NULL;
+        close();
+        return false;
+    }
+
+    char *t_sq = static_cast<char *>(m_sqRing);
+    m_sqHead = reinterpret_cast<unsigned *>(t_sq + t_params.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned *>(t_sq + t_params.sq_off.tail);
+    m_sqMask = *reinterpret_cast<unsigned *>(t_sq + t_params.sq_off.ring_mask);
+    m_sqEntries = *reinterpret_cast<unsigned *>(t_sq + t_params.sq_off.ring_entries);
+    m_sqArray = reinterpret_cast<unsigned *>(t_sq + t_params.sq_off.array);
+    m_sqLocalTail = *m_sqTail;
+    m_sqSubmitted = m_sqLocalTail;
+
+    char *t_cq = static_cast<char *>(m_cqRing);
+    m_cqHead = reinterpret_cast<unsigned *>(t_cq + t_params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned *>(t_cq + t_params.cq_off.tail);
+    m_cqMask = *reinterpret_cast<unsigned *>(t_cq + t_params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<struct io_uring_cqe *>(t_cq + t_params.cq_off.cqes);
+
+    return true;
+}
+
+void IoUring::close()
+{
+    if (m_sqes != NULL) {
+        munmap(m_sqes, m_sqesSize);
+        m_sqes = NULL;
+    }
+    if (m_cqRing != NULL && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    m_cqRing = NULL;
+    if (m_sqRing != NULL) {
+        munmap(m_sqRing, m_sqRingSize);
+        m_sqRing = NULL;
+    }
+    if (m_ringFd >= 0) {
+        // Closing the ring also releases the registered files and buffer rings
+        ::close(m_ringFd);
+        m_ringFd = -1;
+    }
+    m_files.clear();
+}
+
+struct io_uring_sqe *IoUring::getSqe(IoUringRequest *request)
+{
+    // The kernel moves the head when it consumes entries
+    const unsigned t_head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if (m_sqLocalTail - t_head >= m_sqEntries) {
+        return NULL;
+    }
+
+    const unsigned t_index = m_sqLocalTail & m_sqMask;
+    struct io_uring_sqe *t_sqe = &m_sqes[t_index];
+    memset(t_sqe, 0, sizeof (struct io_uring_sqe));
+    t_sqe->user_data = reinterpret_cast<quint64>(request);
+    m_sqArray[t_index] = t_index;
+    m_sqLocalTail++;
+
+    return t_sqe;
+}
+
+int IoUring::submitAndWait(qint64 nsec)
+{
+    const unsigned t_toSubmit = m_sqLocalTail - m_sqSubmitted;
+    int t_result;
+
+    if (t_toSubmit == 0 && nsec <= 0) {
+        // Nothing to do, save the system call
+        return 0;
+    }
+
+    // Publish the new entries to the kernel
+    __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+
+    if (nsec <= 0) {
+        t_result = ioUringEnter(m_ringFd, t_toSubmit, 0, 0, NULL, 0);
+    } else if (m_features & IORING_FEAT_EXT_ARG) {
+        // Submit and wait for the first completion with one system call
+        struct __kernel_timespec t_timeout;
+        t_timeout.tv_sec = nsec / 1000000000;
+        t_timeout.tv_nsec = nsec % 1000000000;
+        struct io_uring_getevents_arg t_arg;
+        memset(&t_arg, 0, sizeof (t_arg));
+        t_arg.ts = reinterpret_cast<quint64>(&t_timeout);
+        t_result = ioUringEnter(m_ringFd, t_toSubmit, 1, IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG,
+                                &t_arg, sizeof (t_arg));
+    } else {
+        // Older kernels: submit, then wait for the ring with ppoll()
+        t_result = ioUringEnter(m_ringFd, t_toSubmit, 0, 0, NULL, 0);
+        struct timespec t_sleepTime;
+        t_sleepTime.tv_sec = nsec / 1000000000;
+        t_sleepTime.tv_nsec = nsec % 1000000000;
+        struct pollfd t_poll;
+        t_poll.fd = m_ringFd;
+        t_poll.events = POLLIN;
+        ppoll(&t_poll, 1, &t_sleepTime, NULL);
+    }
+
+    if (t_result > 0) {
+        m_sqSubmitted += t_result;
+    } else if (t_result < 0 && errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+        // Do not submit the same broken entries forever
+        m_sqSubmitted = m_sqLocalTail;
+    }
+
+    return t_result;
+}
+
+int IoUring::reap()
+{
+    unsigned t_head = *m_cqHead;
+    // The kernel moves the tail when it adds completions
+    const unsigned t_tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    struct io_uring_cqe *t_cqe;
+    IoUringRequest *t_request;
+    int t_count = 0;
+
+    while (t_head != t_tail) {
+        t_cqe = &m_cqes[t_head & m_cqMask];
+        t_request = reinterpret_cast<IoUringRequest *>(t_cqe->user_data);
+        if (t_request != NULL) {
+            t_request->backend->complete(t_request, t_cqe);
+            if (!t_request->backend->m_completed) {
+                t_request->backend->m_completed = true;
+                m_completedBackends.append(t_request->backend);
+            }
+        }
+        t_head++;
+        t_count++;
+    }
+
+    // Give the entries back to the kernel
+    __atomic_store_n(m_cqHead, t_head, __ATOMIC_RELEASE);
+
+    return t_count;
+}
+
+void IoUring::takeCompletedBackends(QVector<UdpIoUringBackend *> &backends)
+{
+    backends.clear();
+    backends.swap(m_completedBackends);
+    for (int i = 0; i < backends.size(); i++) {
+        backends[i]->m_completed = false;
+    }
+}
+
+void IoUring::forgetBackend(UdpIoUringBackend *backend)
+{
+    if (backend->m_completed) {
+        m_completedBackends.removeAll(backend);
+        backend->m_completed = false;
+    }
+}
+
+int IoUring::registerFile(int fd)
+{
+    int t_result;
+
+    if (m_files.isEmpty()) {
+        // Register a sparse table once, the entries are updated when flows come and go
+        m_files.fill(-1, MAX_FILES);
+        t_result = ioUringRegister(m_ringFd, IORING_REGISTER_FILES, m_files.data(), m_files.size());
+        if (t_result < 0) {
+            qDebug() << "IoUring::registerFile: could not register the file table, errno" << errno;
+            m_files.clear();
+            return -1;
+        }
+    }
+
+    int t_index = m_files.indexOf(-1);
+    if (t_index < 0) {
+        return -1;
+    }
+
+    struct io_uring_files_update t_update;
+    memset(&t_update, 0, sizeof (t_update));
+    t_update.offset = t_index;
+    t_update.fds = reinterpret_cast<quint64>(&fd);
+    t_result = ioUringRegister(m_ringFd, IORING_REGISTER_FILES_UPDATE, &t_update, 1);
+    if (t_result < 1) {
+        return -1;
+    }
+
+    m_files[t_index] = fd;
+    return t_index;
+}
+
+void IoUring::unregisterFile(int index)
+{
+    if (index < 0 || index >= m_files.size()) {
+        return;
+    }
+
+    int t_fd = -1;
+    struct io_uring_files_update t_update;
+    memset(&t_update, 0, sizeof (t_update));
+    t_update.offset = index;
+    t_update.fds = reinterpret_cast<quint64>(&t_fd);
+    ioUringRegister(m_ringFd, IORING_REGISTER_FILES_UPDATE, &t_update, 1);
+
+    m_files[index] = -1;
+}
+
+struct io_uring_buf_ring *IoUring::registerBufferRing(unsigned entries, int &bufferGroup)
+{
+    // The kernel wants the ring page aligned
+    const size_t t_size = entries * sizeof (struct io_uring_buf);
+    void *t_memory = mmap(NULL, t_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (t_memory == MAP_FAILED) {
+        return NULL;
+    }
+
+    struct io_uring_buf_reg t_registration;
+    memset(&t_registration, 0, sizeof (t_registration));
+    t_registration.ring_addr = reinterpret_cast<quint64>(t_memory);
+    t_registration.ring_entries = entries;
+    t_registration.bgid = m_nextBufferGroup;
+
+    int t_result = ioUringRegister(m_ringFd, IORING_REGISTER_PBUF_RING, &t_registration, 1);
+    if (t_result < 0) {
+        qDebug() << "IoUring::registerBufferRing: could not register the buffer ring, errno" << errno;
+        munmap(t_memory, t_size);
+        return NULL;
+    }
+
+    bufferGroup = m_nextBufferGroup;
+    m_nextBufferGroup++;
+    return static_cast<struct io_uring_buf_ring *>(t_memory);
+}
+
+void IoUring::unregisterBufferRing(struct io_uring_buf_ring *bufferRing, unsigned entries, int bufferGroup)
+{
+    if (bufferRing == NULL) {
+        return;
+    }
+
+    struct io_uring_buf_reg t_registration;
+    memset(&t_registration, 0, sizeof (t_registration));
+    t_registration.bgid = bufferGroup;
+    ioUringRegister(m_ringFd, IORING_UNREGISTER_PBUF_RING, &t_registration, 1);
+
+    munmap(bufferRing, entries * sizeof (struct io_uring_buf));
+}
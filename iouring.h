@@ -0,0 +1,108 @@
+#ifndef IOURING_H
+#define IOURING_H
+
+#include <QtGlobal>
+#include <QVector>
+
+#include <linux/io_uring.h>
+
+class UdpIoUringBackend;
+
+/* Each submission carries a pointer to its request as user_data.
+ * The ring hands the completion back to the backend that submitted it,
+ * so that flows can share one ring.
+ */
+struct IoUringRequest
+{
+    enum Type {
+        SendRequest = 0,
+        ReceiveRequest,
+        CancelRequest
+    };
+
+    UdpIoUringBackend *backend;
+    Type type;
+    // Send slot of the backend
+    int slot;
+    // Datagrams carried by the message
+    int datagrams;
+};
+
+/* A minimal io_uring built on the raw system calls (we do not depend on liburing).
+ * It is used by one thread only: the ring is not locked.
+ */
+class IoUring
+{
+public:
+    IoUring();
+    ~IoUring();
+
+    // Creates the ring with sqEntries submission entries, the completion queue is bigger
+    bool open(unsigned sqEntries);
+    void close();
+    inline bool isOpen() const { return m_ringFd >= 0; }
+    inline int fd() const { return m_ringFd; }
+
+    // Returns a cleared submission entry, or NULL if the submission queue is full
+    struct io_uring_sqe *getSqe(IoUringRequest *request);
+    // Count of submission entries not yet given to the kernel
+    inline unsigned pendingSubmissions() const { return m_sqLocalTail - m_sqSubmitted; }
+    // Submits the pending entries and waits up to nsec nanoseconds for a completion if nsec > 0
+    int submitAndWait(qint64 nsec);
+    // Hands all the available completions over to their backends and returns their count
+    int reap();
+    /* The backends which got completions since the last call. The thread which shares the ring
+     * runs their flows, as a shared ring has no file descriptor per backend to wait for.
+     */
+    inline bool hasCompletedBackends() const { return !m_completedBackends.isEmpty(); }
+    void takeCompletedBackends(QVector<UdpIoUringBackend *> &backends);
+    // Called when a backend closes, so that it is not handed over anymore
+    void forgetBackend(UdpIoUringBackend *backend);
+
+    // Registers a file descriptor and returns its index for IOSQE_FIXED_FILE, or -1
+    int registerFile(int fd);
+    void unregisterFile(int index);
+
+    // Registers a provided buffer ring of entries buffers (a power of 2). Returns NULL on error.
+    struct io_uring_buf_ring *registerBufferRing(unsigned entries, int &bufferGroup);
+    void unregisterBufferRing(struct io_uring_buf_ring *bufferRing, unsigned entries, int bufferGroup);
+
+    // Size of the shared file table
+    static const int MAX_FILES = 256;
+
+private:
+    Q_DISABLE_COPY(IoUring)
+
+    int m_ringFd = -1;
+    unsigned m_features = 0;
+
+    // Submission queue
+    void *m_sqRing = NULL;
+    size_t m_sqRingSize = 0;
+    unsigned *m_sqHead = NULL;
+    unsigned *m_sqTail = NULL;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    unsigned *m_sqArray = NULL;
+    struct io_uring_sqe *m_sqes = NULL;
+    size_t m_sqesSize = 0;
+    // Entries are filled at m_sqLocalTail and published to the kernel with submitAndWait()
+    unsigned m_sqLocalTail = 0;
+    unsigned m_sqSubmitted = 0;
+
+    // Completion queue. With IORING_FEAT_SINGLE_MMAP, it shares the mapping of the submission queue
+    void *m_cqRing = NULL;
+    size_t m_cqRingSize = 0;
+    unsigned *m_cqHead = NULL;
+    unsigned *m_cqTail = NULL;
+    unsigned m_cqMask = 0;
+    struct io_uring_cqe *m_cqes = NULL;
+
+    // Registered files, -1 for free entries
+    QVector<int> m_files;
+    int m_nextBufferGroup = 0;
+
+    QVector<UdpIoUringBackend *> m_completedBackends;
+};
+
+#endif // IOURING_H
@@ -0,0 +1,75 @@
+#include "latencyhistogram.h"
+
+#include <cstring>
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram()
+{
+    clear();
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    if (other.m_count == 0) {
+        return;
+    }
+
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        m_counts[i] += other.m_counts[i];
+    }
+    m_count += other.m_count;
+    m_sumNsec += other.m_sumNsec;
+    if (other.m_maxNsec > m_maxNsec) {
+        m_maxNsec = other.m_maxNsec;
+    }
+}
+
+void LatencyHistogram::clear()
+{
+    memset(m_counts, 0, sizeof(m_counts));
+    m_count = 0;
+    m_sumNsec = 0;
+    m_maxNsec = 0;
+}
+
+quint64 LatencyHistogram::percentileNsec(qreal percent) const
+{
+    quint64 t_rank;
+    quint64 t_counted = 0;
+
+    if (m_count == 0) {
+        return 0;
+    }
+
+    // Count of values at or below the percentile, at least one
+    t_rank = qMax(static_cast<quint64>(ceil(percent * m_count / 100)), static_cast<quint64>(1));
+    if (t_rank >= m_count) {
+        return m_maxNsec;
+    }
+
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        t_counted += m_counts[i];
+        if (t_counted >= t_rank) {
+            // The maximum is exact, the bucket may reach above it
+            return qMin(bucketHighestNsec(i), m_maxNsec);
+        }
+    }
+
+    return m_maxNsec;
+}
+
+quint64 LatencyHistogram::bucketHighestNsec(int index)
+{
+    int t_shift;
+    quint64 t_lowest;
+
+    if (index < (1 << SUB_BUCKET_BITS)) {
+        return index;
+    }
+
+    // Inverse of bucketIndex(): the exponent selects the width of the bucket
+    t_shift = (index >> SUB_BUCKET_BITS) - 1;
+    t_lowest = static_cast<quint64>((1 << SUB_BUCKET_BITS) + (index & ((1 << SUB_BUCKET_BITS) - 1))) << t_shift;
+
+    return t_lowest + (static_cast<quint64>(1) << t_shift) - 1;
+}
@@ -0,0 +1,68 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QtGlobal>
+
+/* Histogram of latencies in nsec, log-linear like HdrHistogram.
+ *
+ * Below 2^SUB_BUCKET_BITS nsec, each value has its own bucket. Above, each power of 2 is cut into
+ * 2^SUB_BUCKET_BITS buckets, so a bucket is at most 1/32 (3 %) of its values wide.
+ * The memory is fixed (4 KiB) and record() is a few instructions without allocation, so the
+ * receiving loop can record every echo. Histograms of several flows or intervals add up with merge().
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    inline void record(quint64 nsec)
+    {
+        m_counts[bucketIndex(nsec)]++;
+        m_count++;
+        m_sumNsec += nsec;
+        if (nsec > m_maxNsec) {
+            m_maxNsec = nsec;
+        }
+    }
+
+    void merge(const LatencyHistogram &other);
+    void clear();
+
+    inline quint64 count() const { return m_count; }
+    inline quint64 maxNsec() const { return m_maxNsec; }
+    inline quint64 meanNsec() const { return (m_count > 0) ? m_sumNsec / m_count : 0; }
+    /* Latency not exceeded by the given percent (e.g. 99.9) of the values. This is the highest value
+     * of its bucket, so it is at most 3 % too high, never too low. 0 if the histogram is empty.
+     */
+    quint64 percentileNsec(qreal percent) const;
+
+    static const int SUB_BUCKET_BITS = 5;
+    // Highest power of 2 with its own buckets: values up to 2^36 nsec (68 s). Higher values go to the last bucket.
+    static const int MAX_EXPONENT = 35;
+    static const int BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) << SUB_BUCKET_BITS;
+
+private:
+    static inline int bucketIndex(quint64 nsec)
+    {
+        if (nsec < (1 << SUB_BUCKET_BITS)) {
+            return nsec;
+        }
+        // Position of the highest bit set
+        const int t_exponent = 63 - __builtin_clzll(nsec);
+        if (t_exponent > MAX_EXPONENT) {
+            return BUCKET_COUNT - 1;
+        }
+        // The SUB_BUCKET_BITS bits below the highest bit select the bucket of this power of 2
+        return ((t_exponent - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS)
+                + static_cast<int>(nsec >> (t_exponent - SUB_BUCKET_BITS)) - (1 << SUB_BUCKET_BITS);
+    }
+    static quint64 bucketHighestNsec(int index);
+
+    // An interval of 10 s at 100 Mpps is far below 2^32 per bucket
+    quint32 m_counts[BUCKET_COUNT];
+    quint64 m_count;
+    quint64 m_sumNsec;
+    quint64 m_maxNsec;
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -36,6 +36,7 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->bandwidthUnit->addItem("bit/s", QVariant(static_cast<int>(1)));
     ui->bandwidthUnit->addItem("Kbit/s", QVariant(static_cast<int>(1000)));
     ui->bandwidthUnit->addItem("Mbit/s", QVariant(static_cast<int>(1000000)));
+    ui->bandwidthUnit->addItem("Gbit/s", QVariant(static_cast<int>(1000000000)));
     ui->bandwidthUnit->setCurrentIndex(DEFAULT_BandwidthUnitIndex);
 
 
@@ -87,11 +88,11 @@ MainWindow::MainWindow(QWidget *parent) :
     m_wanLayersModel->appendLayer(NetworkLayer::EthernetL1);
 
     loadSettings();
+    uiLoadFlowSettings();
 
-    // Refresh global stats every second
-    QTimer *statsTimer = new QTimer(this);
-    connect(statsTimer, SIGNAL(timeout()), this, SLOT(updateGlobalStats()));
-    statsTimer->start(STAT_PERIOD);
+    // Refresh global stats with the stats of the flows
+    connect(senderListModel, SIGNAL(statsUpdated()), this, SLOT(updateGlobalStats()));
+    connect(senderListModel, SIGNAL(flowRefused(QString)), this, SLOT(showFlowRefused(QString)));
 }
 
 MainWindow::~MainWindow()
@@ -112,6 +113,7 @@ void MainWindow::on_btnGenerate_clicked()
     if (m_isGeneratingTraffic) {
         senderListModel->stopAllSender();
         ui->destinationHost->setEnabled(true);
+        setPoolSettingsEnabled(true);
         ui->btnGenerate->setText("Generate traffic");
         ui->btnGenerate->setStyleSheet("");
         m_isGeneratingTraffic = false;
@@ -137,6 +139,7 @@ void MainWindow::on_btnGenerate_clicked()
 
         addToDestinationList(destinationString);
         ui->destinationHost->setEnabled(false);
+        setPoolSettingsEnabled(false);
         senderListModel->setDestinationIP(destinationIP);
         senderListModel->generateTraffic();
         ui->btnGenerate->setText("Stop traffic");
@@ -174,6 +177,45 @@ void MainWindow::on_bandwidthUnit_currentIndexChanged(int /* index */)
     senderListModel->setBandwidthUnit(ui->bandwidthUnit->currentData().toInt());
 }
 
+void MainWindow::on_mtu_editingFinished()
+{
+    // The packet sizes which do not fit any more are cut, the table shows them
+    senderListModel->setMtu(ui->mtu->value());
+}
+
+void MainWindow::on_workerCount_editingFinished()
+{
+    senderListModel->setWorkerCount(ui->workerCount->value());
+}
+
+void MainWindow::on_separateReceive_clicked(bool checked)
+{
+    senderListModel->setSeparateReceive(checked);
+}
+
+void MainWindow::on_cpuPolicy_editingFinished()
+{
+    senderListModel->setCpuPolicy(ui->cpuPolicy->text());
+    // The policy is stored trimmed and in lower case
+    ui->cpuPolicy->setText(senderListModel->cpuPolicy());
+}
+
+/* The stats interval and the loss timeout are picked up by the running flows */
+void MainWindow::on_statsInterval_editingFinished()
+{
+    senderListModel->setStatsIntervalMsec(ui->statsInterval->value());
+}
+
+void MainWindow::on_lossTimeout_editingFinished()
+{
+    senderListModel->setLossTimeoutMsec(ui->lossTimeout->value());
+}
+
+void MainWindow::showFlowRefused(QString message)
+{
+    QMessageBox::warning(this, "Flow setting refused", message);
+}
+
 void MainWindow::updateGlobalStats()
 {
     NetworkModel::Layer layer = static_cast<NetworkModel::Layer>(ui->bandwidthLayer->currentData().toInt());
@@ -184,6 +226,7 @@ void MainWindow::updateGlobalStats()
     ui->sendingTotal->setText(senderListModel->totalSendingStats());
     ui->receivingTotal->setText(senderListModel->totalReceivingStats());
     ui->packetsTotal->setText(senderListModel->totalPacketsStats());
+    ui->latencyTotal->setText(senderListModel->totalLatencyStats());
 
     ui->WANReceivingTotal->setText(senderListModel->WANtotalReceivingStats());
     ui->WANSendingTotal->setText(senderListModel->WANtotalSendingStats());
@@ -335,6 +378,7 @@ void MainWindow::loadProject(QString fileName)
     if (m_isGeneratingTraffic) {
         senderListModel->stopAllSender();
         ui->destinationHost->setEnabled(true);
+        setPoolSettingsEnabled(true);
         ui->btnGenerate->setText("Generate traffic");
         ui->btnGenerate->setStyleSheet("");
         m_isGeneratingTraffic = false;
@@ -362,6 +406,7 @@ void MainWindow::loadProject(QString fileName)
 
     senderListModel->loadParameter(settings);
     m_wanLayersModel->loadParameter(settings);
+    uiLoadFlowSettings();
 
     setProjectFilename(fileName);
 }
@@ -419,6 +464,26 @@ void MainWindow::addRecentProject(QString fileName)
     uiLoadRecentProjects();
 }
 
+/** Shows the settings of senderListModel which apply to all flows, e.g. after a project was loaded.
+ *  Setting the values does not emit editingFinished() or clicked(), so the model is not changed again.
+ */
+void MainWindow::uiLoadFlowSettings()
+{
+    ui->mtu->setValue(senderListModel->mtu());
+    ui->workerCount->setValue(senderListModel->workerCount());
+    ui->separateReceive->setChecked(senderListModel->separateReceive());
+    ui->cpuPolicy->setText(senderListModel->cpuPolicy());
+    ui->statsInterval->setValue(senderListModel->statsIntervalMsec());
+    ui->lossTimeout->setValue(senderListModel->lossTimeoutMsec());
+}
+
+void MainWindow::setPoolSettingsEnabled(bool enabled)
+{
+    ui->workerCount->setEnabled(enabled);
+    ui->separateReceive->setEnabled(enabled);
+    ui->cpuPolicy->setEnabled(enabled);
+}
+
 /** Adds a new destination to the destinationlist stored in ui->destinationHost
  *  If the destination already is in the list, it will be put a the top of it
  *  If MAX_DESTINATIONS is reached, remove the last entry
@@ -27,6 +27,7 @@ public:
 
 public slots:
     void updateGlobalStats();
+    void showFlowRefused(QString message);
     void wanLayersChanged();
 
 private slots:
@@ -35,6 +36,12 @@ private slots:
     void on_sizeLayer_currentIndexChanged(int index);
     void on_bandwidthLayer_currentIndexChanged(int index);
     void on_bandwidthUnit_currentIndexChanged(int index);
+    void on_mtu_editingFinished();
+    void on_workerCount_editingFinished();
+    void on_separateReceive_clicked(bool checked);
+    void on_cpuPolicy_editingFinished();
+    void on_statsInterval_editingFinished();
+    void on_lossTimeout_editingFinished();
     void on_btnGenerate_clicked();
     void on_renoveLowestLayer_clicked();
     void on_addLayer_clicked();
@@ -59,6 +66,10 @@ private:
     void addRecentProject(QString fileName);
     void loadProject(QString fileName);
     void addToDestinationList(QString destination);
+    // Shows the settings the flow list keeps for all flows
+    void uiLoadFlowSettings();
+    // The worker pool is set up when the traffic starts, it can not change while generating
+    void setPoolSettingsEnabled(bool enabled);
 
     static const int DEFAULT_SizePDULayerIndex = 1;
     static const int DEFAULT_BWPDULayerIndex = 1;
@@ -73,9 +84,6 @@ private:
 
     quint64 sendingCounter = 10000;
     quint64 receivedCounter = 0;
-    // Refresch stats every STAT_PERIOD (in msec)
-    static const int STAT_PERIOD = 1000;
-
     // Keep an history of maximel MAX_DESTINTATIONS destination hosts
     // We need to declare MAX_DESTINATIONS als consexpr because we use it in qMin wich passes its arguments as
     // a reference. C++17 makes an inline variable of it, so we don't get an error at compilation time
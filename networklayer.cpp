@@ -2,9 +2,10 @@
 
 #include "networklayer.h"
 
-NetworkLayer::NetworkLayer(NetworkLayer::Layer layer)
+NetworkLayer::NetworkLayer(NetworkLayer::Layer layer, uint mtu)
 {
     m_layer = layer;
+    m_mtu = mtu;
 }
 
 QList<NetworkLayer::Layer> NetworkLayer::possibleSubLayers(NetworkLayer::Layer layer)
@@ -48,6 +49,21 @@ NetworkLayer::Layer NetworkLayer::shortname2Layer(QString shortName)
     return static_cast<NetworkLayer::Layer>(-1);
 }
 
+void NetworkLayer::setMtu(uint mtu)
+{
+    m_mtu = mtu;
+}
+
+uint NetworkLayer::mtu()
+{
+    return m_mtu;
+}
+
+uint NetworkLayer::maxPDUSize()
+{
+    return m_mtu + m_maxPDUsizeAboveMtu[m_layer];
+}
+
 uint NetworkLayer::setPDUSize(uint size)
 {
     int tmpSDUSize;
@@ -57,7 +73,7 @@ uint NetworkLayer::setPDUSize(uint size)
     m_PDUSize = qMax(m_PDUSize, m_minPDUsize[m_layer]);
 
     // Maximal PDU to avoid fragmentation
-    m_PDUSize = qMin(m_PDUSize, m_maxPDUsize[m_layer]);
+    m_PDUSize = qMin(m_PDUSize, maxPDUSize());
 
     switch (m_layer) {
     case NetworkLayer::ESP_AES256_SHA_TUN:
@@ -106,7 +122,7 @@ uint NetworkLayer::setSDUSize(uint size)
     m_PDUSize = qMax(m_PDUSize, m_minPDUsize[m_layer]);
 
     // Maximal PDU to avoid fragmentation
-    m_PDUSize = qMin(m_PDUSize, m_maxPDUsize[m_layer]);
+    m_PDUSize = qMin(m_PDUSize, maxPDUSize());
 
     // Now recalculate the SDU Size after the PDU Size has been adjusted
     switch (m_layer) {
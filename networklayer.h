@@ -21,7 +21,8 @@ public:
         LAYER_COUNT // Used to know how much layers we have
     };
 
-    NetworkLayer(NetworkLayer::Layer layer);
+    // mtu is the IP MTU the maximal PDU sizes derive from
+    NetworkLayer(NetworkLayer::Layer layer, uint mtu);
 
     static QList<NetworkLayer::Layer> possibleSubLayers(NetworkLayer::Layer layer);
     bool hasPossibleSublayer(NetworkLayer::Layer layer);
@@ -34,6 +35,11 @@ public:
     uint PDUSize();
     uint SDUSize();
 
+    // Changes the IP MTU. The sizes are clamped at the next setPDUSize() or setSDUSize().
+    void setMtu(uint mtu);
+    uint mtu();
+    uint maxPDUSize();
+
     QString layerName();
     QString layerShortName();
 
@@ -81,17 +87,18 @@ private:
         38  // ESP has to be calculated because of padding, 38 is the overhead without padding
     };
 
-    // We mean here the maximal PDU size in order to avoid fragmentation.
-    static inline const uint m_maxPDUsize[] = {
-        1600, // EthL1 - we do not which EthL2 we have (802.1q = EthL2 + 4 Bytes; Cisco Trustsec...)
-        1518, // EthL2 - 1500 Eth2-Payload + 18 overhead
-        1514, // EthL2 without CRC - derived from EthL2 without CRC/FCS
-        1518, // CRC for Eth L2: 1500 Eth2-Payload + 18 overhead
-        1500, // IP - IP MTU from IEE802.3 (without jumbo frames)
-        1500, // UDP - no limit (we don't know what transports us)
-        1500, // GRE - no limit (we don't know what transports us)
-        1500, // GREwKey - no limit (we don't know what transports us)
-        1500  // ESP - no limit (we don't know what transports us)
+    // We mean here the maximal PDU size in order to avoid fragmentation, as the size above the IP MTU.
+    // With the IP MTU of IEE802.3 (1500, without jumbo frames), EthL2 is 1518.
+    static inline const uint m_maxPDUsizeAboveMtu[] = {
+        100, // EthL1 - we do not which EthL2 we have (802.1q = EthL2 + 4 Bytes; Cisco Trustsec...)
+        18,  // EthL2 - Eth2-Payload + 18 overhead
+        14,  // EthL2 without CRC - derived from EthL2 without CRC/FCS
+        18,  // CRC for Eth L2: Eth2-Payload + 18 overhead
+        0,   // IP - IP MTU
+        0,   // UDP - no limit (we don't know what transports us)
+        0,   // GRE - no limit (we don't know what transports us)
+        0,   // GREwKey - no limit (we don't know what transports us)
+        0    // ESP - no limit (we don't know what transports us)
     };
 
     static inline const char* const m_shortNames[] = {
@@ -121,6 +128,7 @@ private:
 
     uint m_PDUSize;
     uint m_SDUSize;
+    uint m_mtu;
 
     /* As ESP adds a padding, we try to keep the ordiginal SDU stored */
     uint m_ESPSDUSize = 0;
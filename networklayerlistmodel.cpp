@@ -113,7 +113,7 @@ Qt::ItemFlags NetworkLayerListModel::flags(const QModelIndex &index) const
 void NetworkLayerListModel::appendLayer(NetworkLayer::Layer layer)
 {
     NetworkLayer *nl;
-    nl = new NetworkLayer(layer);
+    nl = new NetworkLayer(layer, m_mtu);
     int insertedRow = m_networklayerList.count();
 
     beginInsertRows(QModelIndex(), insertedRow, insertedRow);
@@ -242,6 +242,7 @@ NetworkLayerListModel *NetworkLayerListModel::clone()
 {
     NetworkLayerListModel *model = new NetworkLayerListModel();
 
+    model->setMtu(m_mtu);
     model->fillWithLayers(this->layerList());
     // we do not copy the m_displayStatsList as it is not used in udpsender for stats.
 
@@ -284,6 +285,21 @@ void NetworkLayerListModel::setPDUSize(const uint row, const uint size)
     }
 }
 
+void NetworkLayerListModel::setMtu(uint mtu)
+{
+    NetworkLayer *layer;
+
+    m_mtu = mtu;
+    foreach (layer, m_networklayerList) {
+        layer->setMtu(mtu);
+    }
+}
+
+uint NetworkLayerListModel::mtu()
+{
+    return m_mtu;
+}
+
 /** Saves the networklayer list to settings
  *
  * we save the short name of the layers and not its enum value so that the stats are human readable
@@ -346,7 +362,7 @@ void NetworkLayerListModel::loadParameter(QSettings &settings)
         if (row == 0) {
             if (layerID != NetworkLayer::UDP) {
                 // The first layer must always be UDP. Insert it an break
-                layer = new NetworkLayer(NetworkLayer::UDP);
+                layer = new NetworkLayer(NetworkLayer::UDP, m_mtu);
                 m_networklayerList.append(layer);
                 m_displayStatsList.append(true);
                 break;
@@ -357,7 +373,7 @@ void NetworkLayerListModel::loadParameter(QSettings &settings)
                 break;
             }
         }
-        layer = new NetworkLayer(layerID);
+        layer = new NetworkLayer(layerID, m_mtu);
         m_networklayerList.append(layer);
         m_displayStatsList.append(displayStats);
         previousLayer = layer;
@@ -365,7 +381,7 @@ void NetworkLayerListModel::loadParameter(QSettings &settings)
 
     // If there was a problem with the project, at least insert an UDP Layer
     if (m_networklayerList.count() == 0) {
-        layer = new NetworkLayer(NetworkLayer::UDP);
+        layer = new NetworkLayer(NetworkLayer::UDP, m_mtu);
         m_networklayerList.append(layer);
         m_displayStatsList.append(true);
     }
@@ -7,6 +7,7 @@
 #include <QSettings>
 
 #include "networklayer.h"
+#include "networkmodel.h"
 
 class NetworkLayerListModel : public QAbstractTableModel
 {
@@ -36,6 +37,9 @@ public:
     NetworkLayerListModel *clone();
     void setUDPPDUSize(uint size);
     void setPDUSize(const uint row, const uint size);
+    // IP MTU of the layers, applied to their sizes at the next setPDUSize()
+    void setMtu(uint mtu);
+    uint mtu();
 
     // Saving/Loading Parameter
     void saveParameter(QSettings &settings);
@@ -44,6 +48,7 @@ public:
 private:
     QList<NetworkLayer *> m_networklayerList;
     QList<bool> m_displayStatsList;
+    uint m_mtu = NetworkModel::DEFAULT_MTU;
 
     enum networkLayerColumns {
         COL_NAME, // 0
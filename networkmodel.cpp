@@ -16,10 +16,25 @@ NetworkModel::NetworkModel()
 {
     // Initialize to something
     m_udpSize = 1000;
+    m_averageUdpSize = m_udpSize;
     m_bandwidth = 100;
     m_bandwidthLayer = NetworkModel::EthernetLayer2;
 }
 
+void NetworkModel::setMtu(uint mtu)
+{
+    m_maxUdpSize = qBound(MIN_MTU, mtu, MAX_MTU) - m_L3overhead;
+
+    // A lower MTU may cut the current sizes
+    setSizeMix(m_udpSizeMix, NetworkModel::UDPLayer);
+    setPduSize(m_udpSize, NetworkModel::UDPLayer);
+}
+
+uint NetworkModel::mtu()
+{
+    return m_maxUdpSize + m_L3overhead;
+}
+
 void NetworkModel::setPduSize(uint size, NetworkModel::Layer layer)
 {
     // Assign a value to tmp_size in order to avoid a warning.
@@ -53,9 +68,81 @@ void NetworkModel::setPduSize(uint size, NetworkModel::Layer layer)
     }
 
     m_udpSize = qMax(qMin(m_udpSize, m_maxUdpSize), m_minUdpSize);
+    if (m_udpSizeMix.isEmpty()) {
+        m_averageUdpSize = m_udpSize;
+    }
 
     // recalculate pps. We use the specified bandwidth in its specified layer
-    m_pps = (qreal) m_bandwidth / (pduSize(m_bandwidthLayer) * 8);
+    m_pps = (qreal) m_bandwidth / (averagePduSize(m_bandwidthLayer) * 8);
+}
+
+void NetworkModel::setSizeMix(NetworkModel::SizeMix mix, NetworkModel::Layer layer)
+{
+    QPair<uint, uint> entry;
+    qreal totalSize = 0;
+    uint totalWeight = 0;
+
+    m_udpSizeMix.clear();
+    foreach (entry, mix) {
+        if (entry.second == 0) {
+            continue;
+        }
+        m_udpSizeMix.append(qMakePair(udpSize(entry.first, layer), entry.second));
+        totalSize += (qreal) m_udpSizeMix.last().first * entry.second;
+        totalWeight += entry.second;
+    }
+
+    if (totalWeight > 0) {
+        m_averageUdpSize = totalSize / totalWeight;
+    } else {
+        m_udpSizeMix.clear();
+        m_averageUdpSize = m_udpSize;
+    }
+
+    // recalculate pps. We use the specified bandwidth in its specified layer
+    m_pps = (qreal) m_bandwidth / (averagePduSize(m_bandwidthLayer) * 8);
+}
+
+NetworkModel::SizeMix NetworkModel::sizeMix(NetworkModel::Layer layer)
+{
+    NetworkModel::SizeMix mix;
+    QPair<uint, uint> entry;
+
+    foreach (entry, m_udpSizeMix) {
+        mix.append(qMakePair(entry.first + overhead(layer), entry.second));
+    }
+
+    return mix;
+}
+
+qreal NetworkModel::averagePduSize(NetworkModel::Layer layer)
+{
+    return m_averageUdpSize + overhead(layer);
+}
+
+uint NetworkModel::overhead(NetworkModel::Layer layer)
+{
+    switch (layer) {
+    case NetworkModel::EthernetLayer1:
+        return m_L3overhead + m_L2overhead + m_L1overhead;
+    case NetworkModel::EthernetLayer2:
+        return m_L3overhead + m_L2overhead;
+    case NetworkModel::EthernetLayer2woCRC:
+        return m_L3overhead + m_L2noCRCoverhead;
+    case NetworkModel::IPLayer:
+        return m_L3overhead;
+    default:
+        return 0;
+    }
+}
+
+uint NetworkModel::udpSize(uint size, NetworkModel::Layer layer)
+{
+    if (size < overhead(layer) + m_minUdpSize) {
+        return m_minUdpSize;
+    }
+
+    return qMin(size - overhead(layer), m_maxUdpSize);
 }
 
 uint NetworkModel::pduSize(NetworkModel::Layer layer)
@@ -82,12 +169,12 @@ uint NetworkModel::pduSize(NetworkModel::Layer layer)
     return m_udpSize;
 }
 
-void NetworkModel::setBandwidth(uint newBandwidth, NetworkModel::Layer layer)
+void NetworkModel::setBandwidth(quint64 newBandwidth, NetworkModel::Layer layer)
 {
     /* We never set m_udpSize to 0 */
     Q_ASSERT(m_udpSize != 0);
 
-    m_pps = (qreal) newBandwidth / (pduSize(layer) * 8);
+    m_pps = (qreal) newBandwidth / (averagePduSize(layer) * 8);
     // we round to the nearest integer. If we would not use qRound, it would round down
     m_bandwidth = newBandwidth;
     m_bandwidthLayer = layer;
@@ -95,15 +182,15 @@ void NetworkModel::setBandwidth(uint newBandwidth, NetworkModel::Layer layer)
     return;
 }
 
-uint NetworkModel::bandwidth(NetworkModel::Layer layer)
+quint64 NetworkModel::bandwidth(NetworkModel::Layer layer)
 {
-    // we round to the nearest integer. If we would not use qRound, it would round down
-    return qRound(m_pps * pduSize(layer) * 8);
+    // we round to the nearest integer. If we would not use qRound64, it would round down
+    return qRound64(m_pps * averagePduSize(layer) * 8);
 }
 
-uint NetworkModel::pps2bandwidth(qreal pps, NetworkModel::Layer layer)
+quint64 NetworkModel::pps2bandwidth(qreal pps, NetworkModel::Layer layer)
 {
-    return pps * pduSize(layer) * 8;
+    return qRound64(pps * averagePduSize(layer) * 8);
 }
 
 qreal NetworkModel::pps()
@@ -4,6 +4,8 @@
 #include <QtGlobal>
 #include <QString>
 #include <QStringList>
+#include <QList>
+#include <QPair>
 
 /*!
  * \brief The NetworkModel class is used to calculate bandwidth and PDU-Size between differen OSI-Layers
@@ -35,21 +37,46 @@ public:
         mbps
     };
 
+    // IP MTU of the LAN, the biggest packet sent. Clamps the current PDU size.
+    void setMtu(uint mtu);
+    uint mtu();
+
     void setPduSize(uint size, NetworkModel::Layer layer);
     uint pduSize(NetworkModel::Layer layer);
 
-    void setBandwidth(uint newBandwidth, NetworkModel::Layer layer);
-    uint bandwidth(NetworkModel::Layer layer);
+    // PDU sizes and their weights, e.g. {{64, 7}, {594, 4}, {1518, 1}} for the simple IMIX at Ethernet L2
+    typedef QList<QPair<uint, uint>> SizeMix;
+    /* With a size mix, the datagrams have the sizes of the mix instead of pduSize(), and the
+     * bandwidth is converted with their average size. An empty mix goes back to pduSize().
+     */
+    void setSizeMix(SizeMix mix, NetworkModel::Layer layer);
+    SizeMix sizeMix(NetworkModel::Layer layer);
+    // Average PDU size of the datagrams, the one of pduSize() without a size mix
+    qreal averagePduSize(NetworkModel::Layer layer);
+
+    void setBandwidth(quint64 newBandwidth, NetworkModel::Layer layer);
+    quint64 bandwidth(NetworkModel::Layer layer);
 
     // Used to calculate the Bandwidth for Statistics
-    uint pps2bandwidth(qreal pps, NetworkModel::Layer layer);
+    quint64 pps2bandwidth(qreal pps, NetworkModel::Layer layer);
 
     qreal pps();
 
     static QString layerName(NetworkModel::Layer layer);
     static QString layerShortName(NetworkModel::Layer layer);
 
+    // IP MTU without jumbo frames, and the range accepted by setMtu(): 576 is the smallest datagram
+    // every IPv4 host must accept, 9216 the biggest jumbo frame of most switches.
+    static constexpr uint DEFAULT_MTU = 1500;
+    static constexpr uint MIN_MTU = 576;
+    static constexpr uint MAX_MTU = 9216;
+
 private:
+    // Size of the headers below the UDP datagram
+    uint overhead(NetworkModel::Layer layer);
+    // UDP size of a PDU of size at layer, clamped to m_minUdpSize..m_maxUdpSize
+    uint udpSize(uint size, NetworkModel::Layer layer);
+
     // We need to declare the static variables als consexpr because we use it in qMin wich passes its arguments as
     // a reference. C++17 makes an inline variable of it, so we don't get an error at compilation time
 
@@ -64,24 +91,28 @@ private:
 
     // Current udp Size & bandwith. These are the reference for converting into other Layers
     uint m_udpSize;
+    // UDP sizes of the size mix and their weights, empty without one
+    SizeMix m_udpSizeMix;
+    qreal m_averageUdpSize;
 
     // Specified bandwidth in bits per second. We must store the specified layer to, in order to keep the
     // bandwidth at PDU Size changes
-    uint m_udpBandwidth;
-    uint m_bandwidth;
+    // 64 bits, as 4.29 Gbit/s do not fit in an uint
+    quint64 m_udpBandwidth;
+    quint64 m_bandwidth;
     NetworkModel::Layer m_bandwidthLayer;
 
     // Current packets per second. Used to calculate the bandwidth
     // NOTE: Tc could be used to calculate Bc (in packets) and from it the bandwidth that realy will be sent.
     qreal m_pps;
 
-    // Smalest and biggest UDP size in order to reach smallest (IP PDU-Lengeht 64) and biggest (IP MTU 1500)
+    // Smalest and biggest UDP size in order to reach smallest (IP PDU-Lengeht 64) and biggest (IP MTU)
     // Ethernet Frame
 
     // Minimal Ethernet length = 64 bytes, minus ethernet header, minus IP header (20 Bytes)
     static constexpr uint m_minUdpSize = 64 - 18 - 20;
     // IP MTU minus IP header
-    static constexpr uint m_maxUdpSize = 1500 - 20;
+    uint m_maxUdpSize = DEFAULT_MTU - m_L3overhead;
 };
 
 #endif // NETWORKMODEL_H
@@ -0,0 +1,122 @@
+#include "payloadgenerator.h"
+
+#include <QRandomGenerator>
+
+PayloadGenerator::PayloadGenerator()
+{
+    // xorshift128+ must not start with a state of zeros
+    for (int g = 0; g < 2; g++) {
+        for (int i = 0; i < 2; i++) {
+            m_state0[g][i] = QRandomGenerator::global()->generate64() | 1;
+            m_state1[g][i] = QRandomGenerator::global()->generate64();
+        }
+    }
+}
+
+QString PayloadGenerator::modeName(Mode mode)
+{
+    switch (mode) {
+    case ZeroPayload:
+        return "zeros";
+    case PatternPayload:
+        return "pattern";
+    case RandomPoolPayload:
+        return "pool";
+    case UniquePayload:
+        return "unique";
+    }
+
+    return "zeros";
+}
+
+/* Returns the mode from its name. Unknown names return ZeroPayload */
+PayloadGenerator::Mode PayloadGenerator::modeFromName(QString name)
+{
+    name = name.trimmed().toLower();
+
+    if (name == modeName(PatternPayload)) {
+        return PatternPayload;
+    }
+    if (name == modeName(RandomPoolPayload)) {
+        return RandomPoolPayload;
+    }
+    if (name == modeName(UniquePayload)) {
+        return UniquePayload;
+    }
+
+    return ZeroPayload;
+}
+
+void PayloadGenerator::setMode(Mode mode)
+{
+    m_mode = mode;
+    m_poolOffset = 0;
+
+    // Built once for all flows by the first flow which needs them (thread safe since C++11)
+    if (m_mode == PatternPayload) {
+        static const QVector<char> pattern = buildPattern();
+        m_pattern = pattern.constData();
+    }
+    if (m_mode == RandomPoolPayload) {
+        static const QVector<char> pool = buildPool();
+        m_pool = pool.constData();
+    }
+}
+
+/*
+ * xorshift128+ (Vigna): shifts, xors and one addition per 64 bits, no multiplication. With the
+ * lanes in vector registers, each step gives 32 bytes, so a full size payload costs a few hundred
+ * cycles. It is not a cryptographic generator, which does not matter to a WAN optimizer.
+ */
+void PayloadGenerator::fillRandom(char *data, int length)
+{
+    Lanes t_s0;
+    Lanes t_s1;
+    Lanes t_out[2];
+    // The state stays in registers during the loop
+    Lanes t_state0[2] = { m_state0[0], m_state0[1] };
+    Lanes t_state1[2] = { m_state1[0], m_state1[1] };
+    int t_done = 0;
+
+    while (t_done < length) {
+        for (int g = 0; g < 2; g++) {
+            t_s1 = t_state0[g];
+            t_s0 = t_state1[g];
+            t_state0[g] = t_s0;
+            t_s1 ^= t_s1 << 23;
+            t_state1[g] = t_s1 ^ t_s0 ^ (t_s1 >> 17) ^ (t_s0 >> 26);
+            t_out[g] = t_state1[g] + t_s0;
+        }
+        // The payloads of the raw backends are not aligned
+        if (length - t_done >= static_cast<int>(sizeof(t_out))) {
+            memcpy(data + t_done, t_out, sizeof(t_out));
+        } else {
+            memcpy(data + t_done, t_out, length - t_done);
+        }
+        t_done += sizeof(t_out);
+    }
+
+    m_state0[0] = t_state0[0];
+    m_state0[1] = t_state0[1];
+    m_state1[0] = t_state1[0];
+    m_state1[1] = t_state1[1];
+}
+
+QVector<char> PayloadGenerator::buildPattern()
+{
+    QVector<char> t_pattern(MAX_LENGTH);
+
+    for (int i = 0; i < MAX_LENGTH; i++) {
+        t_pattern[i] = static_cast<char>(i & 0xff);
+    }
+    return t_pattern;
+}
+
+QVector<char> PayloadGenerator::buildPool()
+{
+    QVector<char> t_pool(POOL_SIZE + MAX_LENGTH);
+    PayloadGenerator t_generator;
+
+    t_generator.fillRandom(t_pool.data(), t_pool.size());
+    return t_pool;
+}
@@ -0,0 +1,90 @@
+#ifndef PAYLOADGENERATOR_H
+#define PAYLOADGENERATOR_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QVector>
+
+#include <cstring>
+
+/* Content of the payloads behind the timestamp and the counter.
+ *
+ * Zeros are compressed and deduplicated by WAN optimizers, which then look much faster than
+ * with real traffic. The other modes resist them more and more:
+ * - a fixed pattern: the same bytes in every datagram, for devices which only skip zeros
+ * - a pool of random bytes: incompressible, but the pool repeats, so a dedup appliance may learn it
+ * - unique: each datagram gets fresh random bytes
+ *
+ * A generator is used by the thread running its flow only. fill() copies or generates the bytes
+ * without allocation, so it runs for every datagram sent.
+ */
+class PayloadGenerator
+{
+public:
+    enum Mode {
+        // The buffers of the backends are zeroed once, nothing is written (default)
+        ZeroPayload = 0,
+        // Bytes 0x00 to 0xff, repeated
+        PatternPayload,
+        // Slices of a random pool shared by all flows
+        RandomPoolPayload,
+        // Random bytes generated for each datagram
+        UniquePayload
+    };
+
+    PayloadGenerator();
+
+    static QString modeName(Mode mode);
+    static Mode modeFromName(QString name);
+
+    // The shared pattern and pool are built at their first use
+    void setMode(Mode mode);
+    inline Mode mode() const { return m_mode; }
+
+    // Fills the bytes from offset to length of payload. The buffers of the backends are zeroed once.
+    inline void fill(char *payload, int offset, int length)
+    {
+        if (length <= offset) {
+            return;
+        }
+        switch (m_mode) {
+        case ZeroPayload:
+            break;
+        case PatternPayload:
+            memcpy(payload + offset, m_pattern + offset, length - offset);
+            break;
+        case RandomPoolPayload:
+            memcpy(payload + offset, m_pool + m_poolOffset, length - offset);
+            // The next datagram starts elsewhere in the pool, at an odd distance
+            m_poolOffset = (m_poolOffset + length + POOL_STEP) % POOL_SIZE;
+            break;
+        case UniquePayload:
+            fillRandom(payload + offset, length - offset);
+            break;
+        }
+    }
+
+    // Above the longest UDP payload
+    static const int MAX_LENGTH = 65536;
+    // Random bytes in the pool, it has MAX_LENGTH more so that a payload can start anywhere in it
+    static const int POOL_SIZE = 1 << 20;
+    static const int POOL_STEP = 61;
+
+private:
+    // Two xorshift128+ generators of two lanes each: 32 bytes per step, in SSE2 or NEON registers
+    typedef quint64 Lanes __attribute__((vector_size(16)));
+
+    void fillRandom(char *data, int length);
+    static QVector<char> buildPattern();
+    static QVector<char> buildPool();
+
+    Mode m_mode = ZeroPayload;
+    const char *m_pattern = NULL;
+    const char *m_pool = NULL;
+    int m_poolOffset = 0;
+
+    Lanes m_state0[2];
+    Lanes m_state1[2];
+};
+
+#endif // PAYLOADGENERATOR_H
@@ -0,0 +1,149 @@
+#include "rateprofile.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+#include <QDebug>
+
+bool RateProfile::parse(const QString &text)
+{
+    QStringList t_words = text.simplified().split(' ');
+    QList<Step> t_steps;
+    Step t_step;
+    bool t_loop = false;
+    bool t_relative = true;
+    bool t_ok1 = false;
+    bool t_ok2 = false;
+    qreal t_value1;
+    qreal t_value2;
+    int t_count;
+
+    if (text.trimmed().isEmpty()) {
+        m_text = "";
+        m_steps.clear();
+        m_loop = false;
+        m_relative = true;
+        return true;
+    }
+
+    if (t_words.last().toLower() == "loop") {
+        t_loop = true;
+        t_words.removeLast();
+    }
+    if (t_words.isEmpty()) {
+        return false;
+    }
+    const QString t_kind = t_words.first().toLower();
+
+    if (t_kind == "ramp" && t_words.count() == 2) {
+        t_step.seconds = t_words[1].toDouble(&t_ok1);
+        t_step.bandwidthStart = 0;
+        t_step.bandwidthEnd = 1;
+        if (!t_ok1 || t_step.seconds < MIN_STEP_SECONDS) {
+            return false;
+        }
+        t_steps.append(t_step);
+    } else if (t_kind == "steps" && t_words.count() == 3) {
+        t_count = t_words[1].toInt(&t_ok1);
+        t_value2 = t_words[2].toDouble(&t_ok2);
+        if (!t_ok1 || !t_ok2 || t_count < 1 || t_count > MAX_STEPS || t_value2 < MIN_STEP_SECONDS) {
+            return false;
+        }
+        for (int i = 1; i <= t_count; i++) {
+            t_step.seconds = t_value2;
+            t_step.bandwidthStart = static_cast<qreal>(i) / t_count;
+            t_step.bandwidthEnd = t_step.bandwidthStart;
+            t_steps.append(t_step);
+        }
+    } else if (t_kind == "burst" && t_words.count() == 3) {
+        t_value1 = t_words[1].toDouble(&t_ok1);
+        t_value2 = t_words[2].toDouble(&t_ok2);
+        if (!t_ok1 || !t_ok2 || t_value1 < MIN_STEP_SECONDS || t_value2 < MIN_STEP_SECONDS) {
+            return false;
+        }
+        t_step.seconds = t_value1;
+        t_step.bandwidthStart = 1;
+        t_step.bandwidthEnd = 1;
+        t_steps.append(t_step);
+        t_step.seconds = t_value2;
+        t_step.bandwidthStart = 0;
+        t_step.bandwidthEnd = 0;
+        t_steps.append(t_step);
+        t_loop = true;
+    } else if (t_kind == "trace" && t_words.count() >= 2) {
+        // The file name may contain spaces
+        t_words.removeFirst();
+        if (!readTrace(t_words.join(" "), t_steps)) {
+            return false;
+        }
+        t_relative = false;
+    } else {
+        return false;
+    }
+
+    m_text = text.simplified();
+    m_steps = t_steps;
+    m_loop = t_loop;
+    m_relative = t_relative;
+    return true;
+}
+
+/*
+ * Each line gives the bandwidth from its time to the time of the next line. The last line has the
+ * duration of the line before (usually the export interval of a collector). Lines which do not start
+ * with a number (headers, comments) are skipped.
+ */
+bool RateProfile::readTrace(const QString &fileName, QList<Step> &steps)
+{
+    QFile t_file(fileName);
+    QStringList t_fields;
+    QString t_line;
+    QList<qreal> t_times;
+    QList<qreal> t_bandwidths;
+    qreal t_time;
+    qreal t_bandwidth;
+    bool t_ok1;
+    bool t_ok2;
+    Step t_step;
+
+    if (!t_file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qDebug() << "RateProfile::readTrace: can not open" << fileName;
+        return false;
+    }
+
+    QTextStream t_stream(&t_file);
+    while (!t_stream.atEnd()) {
+        t_line = t_stream.readLine();
+        t_fields = t_line.split(',');
+        if (t_fields.count() < 2) {
+            continue;
+        }
+        t_time = t_fields[0].trimmed().toDouble(&t_ok1);
+        t_bandwidth = t_fields[1].trimmed().toDouble(&t_ok2);
+        if (!t_ok1 || !t_ok2) {
+            continue;
+        }
+        if (t_bandwidth < 0 || (!t_times.isEmpty() && t_time - t_times.last() < MIN_STEP_SECONDS)
+                || t_times.count() >= MAX_STEPS) {
+            qDebug() << "RateProfile::readTrace: invalid line in" << fileName << ":" << t_line;
+            return false;
+        }
+        t_times.append(t_time);
+        t_bandwidths.append(t_bandwidth);
+    }
+    t_file.close();
+
+    if (t_times.count() < 2) {
+        qDebug() << "RateProfile::readTrace: less than two lines in" << fileName;
+        return false;
+    }
+
+    steps.clear();
+    for (int i = 0; i < t_times.count(); i++) {
+        t_step.seconds = (i + 1 < t_times.count()) ? t_times[i + 1] - t_times[i] : t_times[i] - t_times[i - 1];
+        t_step.bandwidthStart = t_bandwidths[i];
+        t_step.bandwidthEnd = t_bandwidths[i];
+        steps.append(t_step);
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef RATEPROFILE_H
+#define RATEPROFILE_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QList>
+
+/* Bandwidth of a flow over time, given as text:
+ * - ""                    constant, the specified bandwidth
+ * - "ramp S"              linear ramp from 0 to the specified bandwidth over S seconds
+ * - "steps N S"           staircase up to the specified bandwidth, N steps of S seconds
+ * - "burst ON OFF"        the specified bandwidth for ON seconds, nothing for OFF seconds
+ * - "trace FILE"          bandwidths of a CSV file: "seconds,bit/s" per line, the seconds increasing
+ * Followed by "loop", the profile starts again at its end (a burst always does), else the last
+ * bandwidth is kept.
+ *
+ * Ramps, steps and bursts are relative to the specified bandwidth, so they follow it when it changes.
+ * The bandwidths of a trace are absolute, at the layer of the specified bandwidth.
+ */
+class RateProfile
+{
+public:
+    struct Step {
+        qreal seconds;
+        // Bandwidth at the beginning and at the end of the step, linear in between.
+        // A fraction of the specified bandwidth, or bit/s for a trace.
+        qreal bandwidthStart;
+        qreal bandwidthEnd;
+    };
+
+    // Returns false (and keeps the profile) if text is not a valid profile or the trace can not be read
+    bool parse(const QString &text);
+
+    inline const QString &text() const { return m_text; }
+    inline bool isEmpty() const { return m_steps.isEmpty(); }
+    inline const QList<Step> &steps() const { return m_steps; }
+    inline bool loop() const { return m_loop; }
+    inline bool relative() const { return m_relative; }
+
+    // Shortest step: a step is followed at Tc granularity
+    static constexpr qreal MIN_STEP_SECONDS = 0.001;
+    static const int MAX_STEPS = 100000;
+
+private:
+    static bool readTrace(const QString &fileName, QList<Step> &steps);
+
+    QString m_text;
+    QList<Step> m_steps;
+    bool m_loop = false;
+    bool m_relative = true;
+};
+
+#endif // RATEPROFILE_H
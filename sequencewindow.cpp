@@ -0,0 +1,141 @@
+#include "sequencewindow.h"
+
+#include <cstring>
+
+SequenceWindow::SequenceWindow()
+{
+    setSize(MIN_SIZE);
+}
+
+void SequenceWindow::setSize(quint64 size)
+{
+    Q_ASSERT(size >= 64 && (size & (size - 1)) == 0);
+    m_size = size;
+    m_wordMask = size / 64 - 1;
+    m_received.resize(size / 64);
+    m_lost.resize(size / 64);
+    m_receivedWords = m_received.data();
+    m_lostWords = m_lost.data();
+    clear();
+}
+
+quint64 SequenceWindow::sizeFor(qreal ppmsec, qint64 nsecTimeout)
+{
+    const qreal t_packets = 2 * ppmsec * nsecTimeout / 1000000;
+    quint64 t_size = MIN_SIZE;
+
+    while (t_size < MAX_SIZE && t_size < t_packets) {
+        t_size *= 2;
+    }
+    return t_size;
+}
+
+void SequenceWindow::clear()
+{
+    memset(m_receivedWords, 0, m_size / 8);
+    memset(m_lostWords, 0, m_size / 8);
+    m_base = 0;
+    m_next = 0;
+    m_receivedCount = 0;
+    m_lostCount = 0;
+    m_reordered = 0;
+    m_duplicated = 0;
+    m_late = 0;
+}
+
+SequenceWindow::Arrival SequenceWindow::receiveBelowBase(quint64 counter)
+{
+    quint64 *t_word;
+    quint64 t_bit;
+
+    if (m_base - counter <= m_size) {
+        t_word = &m_lostWords[(counter / 64) & m_wordMask];
+        t_bit = static_cast<quint64>(1) << (counter % 64);
+        if (*t_word & t_bit) {
+            // Credited back once: another echo of it is a duplicate
+            *t_word &= ~t_bit;
+            m_lostCount--;
+            m_receivedCount++;
+            m_late++;
+            return Late;
+        }
+    }
+
+    // Received before it left the window, or too far behind to tell
+    m_duplicated++;
+    return Duplicated;
+}
+
+bool SequenceWindow::receiveInWindow(quint64 counter)
+{
+    quint64 *t_word;
+    quint64 t_bit;
+
+    if (counter < m_base || counter - m_base >= m_size) {
+        return false;
+    }
+    t_word = &m_receivedWords[(counter / 64) & m_wordMask];
+    t_bit = static_cast<quint64>(1) << (counter % 64);
+    if (*t_word & t_bit) {
+        return false;
+    }
+    *t_word |= t_bit;
+    m_receivedCount++;
+    return true;
+}
+
+/*
+ * The counters of [m_base, newBase) leave the window. Only the last m_size of them have to be kept
+ * as lost: the older ones are below the lost bitmap as well.
+ */
+void SequenceWindow::advance(quint64 newBase)
+{
+    quint64 t_from;
+
+    if (newBase <= m_base) {
+        return;
+    }
+
+    if (newBase - m_base > m_size) {
+        // The whole window goes, the counters beyond it were never received
+        retire(m_base, m_base + m_size);
+        t_from = qMax(m_base + m_size, newBase - m_size);
+        m_lostCount += t_from - (m_base + m_size);
+        // The received bitmap is empty now: all the counters of [t_from, newBase) are lost
+        retire(t_from, newBase);
+    } else {
+        retire(m_base, newBase);
+    }
+
+    m_base = newBase;
+    if (m_next < newBase) {
+        m_next = newBase;
+    }
+}
+
+/*
+ * Counts 64 packets at a time. The bits of the counters move from the received bitmap to the lost
+ * bitmap, inverted: the lost bits of the counters m_size before them are overwritten.
+ */
+void SequenceWindow::retire(quint64 from, quint64 to)
+{
+    quint64 t_counter = from;
+    quint64 *t_received;
+    quint64 *t_lost;
+    quint64 t_mask;
+    int t_bit;
+    int t_bits;
+
+    while (t_counter < to) {
+        t_received = &m_receivedWords[(t_counter / 64) & m_wordMask];
+        t_lost = &m_lostWords[(t_counter / 64) & m_wordMask];
+        t_bit = t_counter % 64;
+        t_bits = qMin(static_cast<quint64>(64 - t_bit), to - t_counter);
+        t_mask = (t_bits == 64) ? ~static_cast<quint64>(0) : ((static_cast<quint64>(1) << t_bits) - 1) << t_bit;
+        m_lostCount += t_bits - __builtin_popcountll(*t_received & t_mask);
+        *t_lost = (*t_lost & ~t_mask) | (~*t_received & t_mask);
+        // Free the bits for the counters to come
+        *t_received &= ~t_mask;
+        t_counter += t_bits;
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef SEQUENCEWINDOW_H
+#define SEQUENCEWINDOW_H
+
+#include <QtGlobal>
+#include <QVector>
+
+/* Sequence window of the receiving half of a flow: tells in-sequence, reordered, duplicated and
+ * late echoes apart by their counter.
+ *
+ * One bit per counter from base() on, set when the packet came back. The window is circular
+ * (counter modulo size()). It moves when the packets time out (advance()) or when a packet comes back
+ * more than size() after base(). The packets which leave the window without being received are lost.
+ * A second bitmap keeps which of the size() counters below base() were counted as lost: only these
+ * can come back late, any other echo below base() is a duplicate.
+ *
+ * The size is set when the flow opens (setSize()), large enough for the packets sent over the loss
+ * timeout, so that they time out before they leave the window. Used by the thread receiving the
+ * flow only, without allocation.
+ */
+class SequenceWindow
+{
+public:
+    enum Arrival {
+        // The highest counter so far, maybe after a gap
+        InSequence = 0,
+        // Sent before the highest counter received
+        Reordered,
+        // Received already
+        Duplicated,
+        // Counted as lost, but it came back
+        Late
+    };
+
+    SequenceWindow();
+    void clear();
+    // Allocates a window of size counters (a power of 2, see sizeFor()) and clears it
+    void setSize(quint64 size);
+    inline quint64 size() const { return m_size; }
+    /* Size of a window for the packets sent at ppmsec over nsecTimeout, with room for the rate to
+     * double, between MIN_SIZE and MAX_SIZE
+     */
+    static quint64 sizeFor(qreal ppmsec, qint64 nsecTimeout);
+
+    inline Arrival receive(quint64 counter)
+    {
+        if (counter < m_base) {
+            return receiveBelowBase(counter);
+        }
+        if (counter - m_base >= m_size) {
+            // Far ahead: the oldest packets leave the window, those which did not come back are lost
+            advance(counter - m_size + 1);
+        }
+        quint64 *t_word = &m_receivedWords[(counter / 64) & m_wordMask];
+        const quint64 t_bit = static_cast<quint64>(1) << (counter % 64);
+        if (*t_word & t_bit) {
+            m_duplicated++;
+            return Duplicated;
+        }
+        *t_word |= t_bit;
+        m_receivedCount++;
+
+        if (counter < m_next) {
+            m_reordered++;
+            return Reordered;
+        }
+        // The packets of the gap may still come back
+        m_next = counter + 1;
+        return InSequence;
+    }
+
+    /* Marks counter as received if it is in the window and was not received yet, without moving the
+     * window. For echoes whose counter can not be trusted (corrupted). Returns false otherwise.
+     */
+    bool receiveInWindow(quint64 counter);
+
+    // Moves the beginning of the window to newBase, the packets before newBase which did not come back are lost
+    void advance(quint64 newBase);
+
+    inline quint64 base() const { return m_base; }
+    // Counter following the highest one received
+    inline quint64 next() const { return m_next; }
+
+    inline quint64 received() const { return m_receivedCount; }
+    inline quint64 lost() const { return m_lostCount; }
+    inline quint64 reordered() const { return m_reordered; }
+    inline quint64 duplicated() const { return m_duplicated; }
+    inline quint64 late() const { return m_late; }
+
+    // Limits of the window size, powers of 2. MAX_SIZE takes 4 MB for both bitmaps.
+    static const quint64 MIN_SIZE = 16384;
+    static const quint64 MAX_SIZE = 16777216;
+
+private:
+    Q_DISABLE_COPY(SequenceWindow)
+
+    Arrival receiveBelowBase(quint64 counter);
+    // Moves the counters of [from, to) out of the window, to - from <= m_size
+    void retire(quint64 from, quint64 to);
+
+    quint64 m_size = 0;
+    // Index of the 64-bit word of a counter: (counter / 64) & m_wordMask
+    quint64 m_wordMask = 0;
+    // Bit of each counter of [m_base, m_base + m_size): received
+    QVector<quint64> m_received;
+    // Bit of each counter of [m_base - m_size, m_base): counted as lost and not come back yet
+    QVector<quint64> m_lost;
+    // Data of both vectors, which are not shared
+    quint64 *m_receivedWords = NULL;
+    quint64 *m_lostWords = NULL;
+    quint64 m_base;
+    quint64 m_next;
+
+    quint64 m_receivedCount;
+    quint64 m_lostCount;
+    quint64 m_reordered;
+    quint64 m_duplicated;
+    quint64 m_late;
+};
+
+#endif // SEQUENCEWINDOW_H
@@ -0,0 +1,14 @@
+#-------------------------------------------------
+#
+# Unit tests of CpuPlacement
+#
+#-------------------------------------------------
+
+include(../tests.pri)
+
+TARGET = tst_cpuplacement
+
+SOURCES += tst_cpuplacement.cpp \
+    ../../cpuplacement.cpp
+
+HEADERS += ../../cpuplacement.h
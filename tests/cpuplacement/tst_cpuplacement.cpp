@@ -0,0 +1,39 @@
+#include <QtTest>
+
+#include "cpuplacement.h"
+
+class TestCpuPlacement : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cpuListParse();
+    void cpuListName();
+};
+
+void TestCpuPlacement::cpuListParse()
+{
+    QCOMPARE(CpuPlacement::parseCpuList("0-3,8"), QList<int>() << 0 << 1 << 2 << 3 << 8);
+    QCOMPARE(CpuPlacement::parseCpuList(" 5 , 1-2 "), QList<int>() << 5 << 1 << 2);
+    // Duplicates are dropped
+    QCOMPARE(CpuPlacement::parseCpuList("1,1,0-1"), QList<int>() << 1 << 0);
+    QCOMPARE(CpuPlacement::parseCpuList("1023"), QList<int>() << 1023);
+
+    QVERIFY(CpuPlacement::parseCpuList("").isEmpty());
+    QVERIFY(CpuPlacement::parseCpuList("3-1").isEmpty());
+    QVERIFY(CpuPlacement::parseCpuList("a").isEmpty());
+    QVERIFY(CpuPlacement::parseCpuList("1-2-3").isEmpty());
+    QVERIFY(CpuPlacement::parseCpuList("-1").isEmpty());
+    QVERIFY(CpuPlacement::parseCpuList("0,1024").isEmpty());
+}
+
+void TestCpuPlacement::cpuListName()
+{
+    QCOMPARE(CpuPlacement::cpuListName(QList<int>() << 0 << 1 << 2 << 3 << 8 << 10 << 11), QString("0-3,8,10-11"));
+    QCOMPARE(CpuPlacement::cpuListName(QList<int>()), QString(""));
+    QCOMPARE(CpuPlacement::cpuListName(CpuPlacement::parseCpuList("4,0-2")), QString("4,0-2"));
+}
+
+QTEST_APPLESS_MAIN(TestCpuPlacement)
+
+#include "tst_cpuplacement.moc"
@@ -0,0 +1,14 @@
+#-------------------------------------------------
+#
+# Unit tests of Crc32c
+#
+#-------------------------------------------------
+
+include(../tests.pri)
+
+TARGET = tst_crc32c
+
+SOURCES += tst_crc32c.cpp \
+    ../../crc32c.cpp
+
+HEADERS += ../../crc32c.h
@@ -0,0 +1,51 @@
+#include <QtTest>
+
+#include "crc32c.h"
+
+class TestCrc32c : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void checkValue();
+    void lengthsAndOffsets();
+};
+
+// Bit by bit, as in RFC 3720 appendix B.4
+static quint32 crc32cReference(const char *data, int length)
+{
+    quint32 crc = 0xffffffff;
+
+    for (int i = 0; i < length; i++) {
+        crc ^= static_cast<quint8>(data[i]);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78 : 0);
+        }
+    }
+    return ~crc;
+}
+
+void TestCrc32c::checkValue()
+{
+    QCOMPARE(Crc32c::compute("123456789", 9), quint32(0xe3069283));
+    QCOMPARE(Crc32c::compute("", 0), quint32(0));
+}
+
+void TestCrc32c::lengthsAndOffsets()
+{
+    char buffer[300];
+
+    for (int i = 0; i < static_cast<int>(sizeof(buffer)); i++) {
+        buffer[i] = static_cast<char>(i * 37 + 11);
+    }
+    // Unaligned starts and the tails shorter than 8 bytes
+    for (int offset = 0; offset < 8; offset++) {
+        for (int length = 0; length <= 260; length++) {
+            QCOMPARE(Crc32c::compute(buffer + offset, length), crc32cReference(buffer + offset, length));
+        }
+    }
+}
+
+QTEST_APPLESS_MAIN(TestCrc32c)
+
+#include "tst_crc32c.moc"
@@ -0,0 +1,14 @@
+#-------------------------------------------------
+#
+# Unit tests of LatencyHistogram
+#
+#-------------------------------------------------
+
+include(../tests.pri)
+
+TARGET = tst_latencyhistogram
+
+SOURCES += tst_latencyhistogram.cpp \
+    ../../latencyhistogram.cpp
+
+HEADERS += ../../latencyhistogram.h
@@ -0,0 +1,83 @@
+#include <QtTest>
+
+#include "latencyhistogram.h"
+
+class TestLatencyHistogram : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void empty();
+    void exact();
+    void percentiles();
+    void merge();
+};
+
+void TestLatencyHistogram::empty()
+{
+    LatencyHistogram histogram;
+
+    QCOMPARE(histogram.count(), quint64(0));
+    QCOMPARE(histogram.percentileNsec(50), quint64(0));
+    QCOMPARE(histogram.percentileNsec(100), quint64(0));
+}
+
+void TestLatencyHistogram::exact()
+{
+    LatencyHistogram histogram;
+
+    // Each value below 2^SUB_BUCKET_BITS has its own bucket
+    for (quint64 nsec = 0; nsec < 32; nsec++) {
+        histogram.record(nsec);
+    }
+    QCOMPARE(histogram.percentileNsec(50), quint64(15));
+    QCOMPARE(histogram.percentileNsec(0), quint64(0));
+    QCOMPARE(histogram.percentileNsec(100), quint64(31));
+    QCOMPARE(histogram.maxNsec(), quint64(31));
+}
+
+void TestLatencyHistogram::percentiles()
+{
+    LatencyHistogram histogram;
+    const qreal percents[] = {50, 90, 99, 99.9};
+    quint64 exact;
+    quint64 percentile;
+
+    for (quint64 nsec = 1; nsec <= 100000; nsec++) {
+        histogram.record(nsec * 1000);
+    }
+    QCOMPARE(histogram.count(), quint64(100000));
+    QCOMPARE(histogram.meanNsec(), quint64(50000500));
+
+    // Never too low, at most 3 % too high
+    for (qreal percent : percents) {
+        exact = static_cast<quint64>(percent * 1000) * 1000;
+        percentile = histogram.percentileNsec(percent);
+        QVERIFY2(percentile >= exact, qPrintable(QString::number(percent)));
+        QVERIFY2(percentile <= exact + exact * 3 / 100, qPrintable(QString::number(percent)));
+    }
+    QCOMPARE(histogram.percentileNsec(100), quint64(100000000));
+
+    // Above 2^36 nsec, the maximum stays exact
+    histogram.record(static_cast<quint64>(1) << 40);
+    QCOMPARE(histogram.percentileNsec(100), static_cast<quint64>(1) << 40);
+}
+
+void TestLatencyHistogram::merge()
+{
+    LatencyHistogram first;
+    LatencyHistogram second;
+
+    first.record(10);
+    second.record(20);
+    second.record(30);
+    first.merge(second);
+    QCOMPARE(first.count(), quint64(3));
+    QCOMPARE(first.maxNsec(), quint64(30));
+    QCOMPARE(first.meanNsec(), quint64(20));
+    QCOMPARE(first.percentileNsec(50), quint64(20));
+}
+
+QTEST_APPLESS_MAIN(TestLatencyHistogram)
+
+#include "tst_latencyhistogram.moc"
@@ -0,0 +1,14 @@
+#-------------------------------------------------
+#
+# Unit tests of RateProfile
+#
+#-------------------------------------------------
+
+include(../tests.pri)
+
+TARGET = tst_rateprofile
+
+SOURCES += tst_rateprofile.cpp \
+    ../../rateprofile.cpp
+
+HEADERS += ../../rateprofile.h
@@ -0,0 +1,94 @@
+#include <QtTest>
+#include <QTemporaryFile>
+
+#include "rateprofile.h"
+
+class TestRateProfile : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void parse();
+    void invalid();
+    void trace();
+};
+
+void TestRateProfile::parse()
+{
+    RateProfile profile;
+
+    QVERIFY(profile.parse("ramp 10"));
+    QCOMPARE(profile.steps().size(), 1);
+    QCOMPARE(profile.steps()[0].seconds, 10.0);
+    QCOMPARE(profile.steps()[0].bandwidthStart, 0.0);
+    QCOMPARE(profile.steps()[0].bandwidthEnd, 1.0);
+    QVERIFY(!profile.loop());
+    QVERIFY(profile.relative());
+
+    QVERIFY(profile.parse("  Steps 4   2 LOOP "));
+    QCOMPARE(profile.text(), QString("Steps 4 2 LOOP"));
+    QCOMPARE(profile.steps().size(), 4);
+    QCOMPARE(profile.steps()[0].bandwidthStart, 0.25);
+    QCOMPARE(profile.steps()[3].bandwidthEnd, 1.0);
+    QVERIFY(profile.loop());
+
+    // A burst always loops
+    QVERIFY(profile.parse("burst 0.5 1.5"));
+    QCOMPARE(profile.steps().size(), 2);
+    QCOMPARE(profile.steps()[0].bandwidthStart, 1.0);
+    QCOMPARE(profile.steps()[1].seconds, 1.5);
+    QCOMPARE(profile.steps()[1].bandwidthEnd, 0.0);
+    QVERIFY(profile.loop());
+
+    QVERIFY(profile.parse(""));
+    QVERIFY(profile.isEmpty());
+    QVERIFY(!profile.loop());
+}
+
+void TestRateProfile::invalid()
+{
+    RateProfile profile;
+    const char *invalid[] = {"ramp", "ramp x", "ramp 0.0001", "steps 0 1", "steps 2", "burst 1",
+                             "loop", "unknown 1", "trace /nonexistent/wanperf.csv"};
+
+    QVERIFY(profile.parse("ramp 10"));
+    for (const char *text : invalid) {
+        QVERIFY2(!profile.parse(text), text);
+        // The profile before is kept
+        QCOMPARE(profile.text(), QString("ramp 10"));
+        QCOMPARE(profile.steps().size(), 1);
+    }
+}
+
+void TestRateProfile::trace()
+{
+    RateProfile profile;
+    QTemporaryFile file;
+
+    QVERIFY(file.open());
+    file.write("seconds,bit/s\n0,1000000\n1.5, 2000000\n# comment\n2,0\n");
+    file.close();
+
+    QVERIFY(profile.parse("trace " + file.fileName() + " loop"));
+    QVERIFY(!profile.relative());
+    QVERIFY(profile.loop());
+    QCOMPARE(profile.steps().size(), 3);
+    QCOMPARE(profile.steps()[0].seconds, 1.5);
+    QCOMPARE(profile.steps()[0].bandwidthStart, 1000000.0);
+    QCOMPARE(profile.steps()[1].seconds, 0.5);
+    QCOMPARE(profile.steps()[1].bandwidthEnd, 2000000.0);
+    // The last line lasts as long as the line before
+    QCOMPARE(profile.steps()[2].seconds, 0.5);
+    QCOMPARE(profile.steps()[2].bandwidthStart, 0.0);
+
+    // The times have to increase
+    QVERIFY(file.open());
+    file.resize(0);
+    file.write("0,1000\n2,1000\n1,1000\n");
+    file.close();
+    QVERIFY(!profile.parse("trace " + file.fileName()));
+}
+
+QTEST_APPLESS_MAIN(TestRateProfile)
+
+#include "tst_rateprofile.moc"
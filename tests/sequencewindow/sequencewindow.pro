@@ -0,0 +1,14 @@
+#-------------------------------------------------
+#
+# Unit tests of SequenceWindow
+#
+#-------------------------------------------------
+
+include(../tests.pri)
+
+TARGET = tst_sequencewindow
+
+SOURCES += tst_sequencewindow.cpp \
+    ../../sequencewindow.cpp
+
+HEADERS += ../../sequencewindow.h
@@ -0,0 +1,253 @@
+#include <QtTest>
+
+#include "sequencewindow.h"
+
+class TestSequenceWindow : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void inOrder();
+    void reordered();
+    void duplicated();
+    void late();
+    void duplicatedAfterLate();
+    void duplicatedBelowBase();
+    void advanceWords();
+    void wrapAround();
+    void jumpAhead();
+    void receiveInWindow();
+    void sizeFor();
+    void largerWindow();
+};
+
+static const quint64 SIZE = SequenceWindow::MIN_SIZE;
+
+void TestSequenceWindow::inOrder()
+{
+    SequenceWindow window;
+
+    for (quint64 counter = 0; counter < 1000; counter++) {
+        QCOMPARE(window.receive(counter), SequenceWindow::InSequence);
+    }
+    QCOMPARE(window.received(), quint64(1000));
+    QCOMPARE(window.next(), quint64(1000));
+    QCOMPARE(window.lost(), quint64(0));
+    QCOMPARE(window.reordered(), quint64(0));
+    QCOMPARE(window.duplicated(), quint64(0));
+    QCOMPARE(window.late(), quint64(0));
+}
+
+void TestSequenceWindow::reordered()
+{
+    SequenceWindow window;
+
+    QCOMPARE(window.receive(0), SequenceWindow::InSequence);
+    QCOMPARE(window.receive(2), SequenceWindow::InSequence);
+    QCOMPARE(window.receive(1), SequenceWindow::Reordered);
+    QCOMPARE(window.receive(3), SequenceWindow::InSequence);
+    QCOMPARE(window.received(), quint64(4));
+    QCOMPARE(window.reordered(), quint64(1));
+    QCOMPARE(window.next(), quint64(4));
+}
+
+void TestSequenceWindow::duplicated()
+{
+    SequenceWindow window;
+
+    window.receive(0);
+    window.receive(1);
+    QCOMPARE(window.receive(1), SequenceWindow::Duplicated);
+    QCOMPARE(window.receive(0), SequenceWindow::Duplicated);
+    QCOMPARE(window.received(), quint64(2));
+    QCOMPARE(window.duplicated(), quint64(2));
+    QCOMPARE(window.reordered(), quint64(0));
+}
+
+void TestSequenceWindow::late()
+{
+    SequenceWindow window;
+
+    // 0 to 9 sent, 0 to 4 came back before the timeout
+    for (quint64 counter = 0; counter < 5; counter++) {
+        window.receive(counter);
+    }
+    window.advance(10);
+    QCOMPARE(window.lost(), quint64(5));
+
+    QCOMPARE(window.receive(7), SequenceWindow::Late);
+    QCOMPARE(window.lost(), quint64(4));
+    QCOMPARE(window.received(), quint64(6));
+    QCOMPARE(window.late(), quint64(1));
+}
+
+void TestSequenceWindow::duplicatedAfterLate()
+{
+    SequenceWindow window;
+
+    window.advance(10);
+    QCOMPARE(window.receive(7), SequenceWindow::Late);
+    QCOMPARE(window.receive(7), SequenceWindow::Duplicated);
+    QCOMPARE(window.receive(7), SequenceWindow::Duplicated);
+    QCOMPARE(window.lost(), quint64(9));
+    QCOMPARE(window.received(), quint64(1));
+    QCOMPARE(window.late(), quint64(1));
+    QCOMPARE(window.duplicated(), quint64(2));
+}
+
+void TestSequenceWindow::duplicatedBelowBase()
+{
+    SequenceWindow window;
+
+    for (quint64 counter = 0; counter < 5; counter++) {
+        window.receive(counter);
+    }
+    window.advance(10);
+
+    // Received before the window moved: a duplicate does not reduce the loss
+    QCOMPARE(window.receive(3), SequenceWindow::Duplicated);
+    QCOMPARE(window.lost(), quint64(5));
+    QCOMPARE(window.received(), quint64(5));
+    QCOMPARE(window.late(), quint64(0));
+}
+
+void TestSequenceWindow::advanceWords()
+{
+    SequenceWindow window;
+    SequenceWindow steps;
+    quint64 missing = 0;
+
+    // Every third packet is missing, over several 64-bit words and partial words
+    for (quint64 counter = 0; counter < 1000; counter++) {
+        if (counter % 3 == 0) {
+            missing++;
+        } else {
+            window.receive(counter);
+            steps.receive(counter);
+        }
+    }
+
+    window.advance(1000);
+    QCOMPARE(window.lost(), missing);
+
+    steps.advance(5);
+    steps.advance(70);
+    steps.advance(128);
+    steps.advance(129);
+    steps.advance(640);
+    steps.advance(1000);
+    QCOMPARE(steps.lost(), missing);
+    QCOMPARE(steps.base(), quint64(1000));
+
+    // Each lost packet can come back once
+    QCOMPARE(window.receive(999), SequenceWindow::Late);
+    QCOMPARE(window.receive(998), SequenceWindow::Duplicated);
+    QCOMPARE(window.lost(), missing - 1);
+}
+
+void TestSequenceWindow::wrapAround()
+{
+    SequenceWindow window;
+    const quint64 sent = 3 * SIZE + 100;
+    quint64 missing = 0;
+
+    // The window moves forward as the echoes come in, its bitmap index wraps around three times
+    for (quint64 counter = 0; counter < sent; counter++) {
+        if (counter % 1000 == 0) {
+            missing++;
+            continue;
+        }
+        QCOMPARE(window.receive(counter), SequenceWindow::InSequence);
+    }
+    QCOMPARE(window.base(), sent - SIZE);
+    QCOMPARE(window.received(), sent - missing);
+
+    window.advance(sent);
+    QCOMPARE(window.lost(), missing);
+    QCOMPARE(window.received() + window.lost(), sent);
+
+    // Within SIZE below the base, a lost packet is late. Older, it can not be told from a duplicate.
+    QCOMPARE(window.receive(3 * SIZE - (3 * SIZE) % 1000), SequenceWindow::Late);
+    QCOMPARE(window.receive(1000), SequenceWindow::Duplicated);
+    QCOMPARE(window.lost(), missing - 1);
+    QCOMPARE(window.late(), quint64(1));
+}
+
+void TestSequenceWindow::jumpAhead()
+{
+    SequenceWindow window;
+
+    for (quint64 counter = 0; counter < 10; counter++) {
+        if (counter != 5) {
+            window.receive(counter);
+        }
+    }
+
+    // Less than twice the window ahead: the packets which left the window are remembered as lost
+    QCOMPARE(window.receive(SIZE + SIZE / 2), SequenceWindow::InSequence);
+    QCOMPARE(window.base(), SIZE / 2 + 1);
+    QCOMPARE(window.lost(), SIZE / 2 + 1 - 9);
+    QCOMPARE(window.receive(5), SequenceWindow::Late);
+    QCOMPARE(window.receive(3), SequenceWindow::Duplicated);
+
+    // Far ahead: the last SIZE packets before the base are lost, the older ones are forgotten
+    window.clear();
+    window.receive(0);
+    QCOMPARE(window.receive(5 * SIZE), SequenceWindow::InSequence);
+    QCOMPARE(window.base(), 4 * SIZE + 1);
+    QCOMPARE(window.lost(), 4 * SIZE);
+    QCOMPARE(window.receive(4 * SIZE), SequenceWindow::Late);
+    QCOMPARE(window.receive(3 * SIZE + 1), SequenceWindow::Late);
+    QCOMPARE(window.receive(3 * SIZE), SequenceWindow::Duplicated);
+    QCOMPARE(window.lost(), 4 * SIZE - 2);
+}
+
+void TestSequenceWindow::receiveInWindow()
+{
+    SequenceWindow window;
+
+    QVERIFY(window.receiveInWindow(3));
+    QVERIFY(!window.receiveInWindow(3));
+    // Does not move the window
+    QVERIFY(!window.receiveInWindow(SIZE));
+    QCOMPARE(window.base(), quint64(0));
+    QCOMPARE(window.received(), quint64(1));
+    QCOMPARE(window.receive(3), SequenceWindow::Duplicated);
+}
+
+void TestSequenceWindow::sizeFor()
+{
+    // 2 s at 10 packets/msec: 40000 packets with the headroom
+    QCOMPARE(SequenceWindow::sizeFor(10, 2000000000), quint64(65536));
+    QCOMPARE(SequenceWindow::sizeFor(0, 2000000000), SIZE);
+    QCOMPARE(SequenceWindow::sizeFor(1, 1000000), SIZE);
+    QCOMPARE(SequenceWindow::sizeFor(4096, 1000000000), quint64(8388608));
+    QCOMPARE(SequenceWindow::sizeFor(1000000, 60000000000), quint64(SequenceWindow::MAX_SIZE));
+}
+
+void TestSequenceWindow::largerWindow()
+{
+    SequenceWindow window;
+    const quint64 size = 4 * SIZE;
+
+    window.receive(0);
+    window.setSize(size);
+    QCOMPARE(window.size(), size);
+    // Cleared
+    QCOMPARE(window.received(), quint64(0));
+    QCOMPARE(window.next(), quint64(0));
+
+    // Packets further behind than MIN_SIZE are still in the window
+    QCOMPARE(window.receive(size - 1), SequenceWindow::InSequence);
+    QCOMPARE(window.receive(SIZE), SequenceWindow::Reordered);
+    QCOMPARE(window.base(), quint64(0));
+    QCOMPARE(window.receive(size + 10), SequenceWindow::InSequence);
+    QCOMPARE(window.base(), quint64(11));
+    QCOMPARE(window.lost(), quint64(11));
+    QCOMPARE(window.receive(5), SequenceWindow::Late);
+    QCOMPARE(window.receive(SIZE), SequenceWindow::Duplicated);
+}
+
+QTEST_APPLESS_MAIN(TestSequenceWindow)
+
+#include "tst_sequencewindow.moc"
@@ -0,0 +1,12 @@
+# Settings shared by the unit test projects, one per module in its own directory
+
+QMAKE_CXXFLAGS  += -std=c++17
+QT              += core network testlib
+QT              -= gui
+
+CONFIG += testcase console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ../..
@@ -0,0 +1,15 @@
+#-------------------------------------------------
+#
+# Unit tests of the parts of wanperf without network or GUI.
+# Run them with: qmake && make check
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += sequencewindow \
+    latencyhistogram \
+    crc32c \
+    rateprofile \
+    cpuplacement \
+    udpflow
@@ -0,0 +1,271 @@
+#include <QtTest>
+#include <QSet>
+#include <QQueue>
+
+#include "udpflow.h"
+#include "udpsenderthread.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+class TestUdpFlow : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void sizeMixChange();
+    void duplicatedEchoJitter();
+    void sendTimestampMissed();
+
+private:
+    /* Reads the datagrams of the flow until one has a length of next, then count more.
+     * Every length has to be one of current until the first of next, then one of next.
+     */
+    bool switchLengths(const QSet<int> &current, const QSet<int> &next, int count);
+
+    // The flow sends to this socket
+    int m_socket = -1;
+    quint16 m_port = 0;
+};
+
+void TestUdpFlow::initTestCase()
+{
+    struct sockaddr_in address;
+    socklen_t length = sizeof (address);
+    struct timeval timeout = {1, 0};
+
+    m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    QVERIFY(m_socket >= 0);
+    memset(&address, 0, sizeof (address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    QVERIFY(bind(m_socket, reinterpret_cast<struct sockaddr *>(&address), sizeof (address)) == 0);
+    QVERIFY(getsockname(m_socket, reinterpret_cast<struct sockaddr *>(&address), &length) == 0);
+    m_port = ntohs(address.sin_port);
+    QVERIFY(setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout)) == 0);
+}
+
+void TestUdpFlow::cleanupTestCase()
+{
+    if (m_socket >= 0) {
+        close(m_socket);
+    }
+}
+
+bool TestUdpFlow::switchLengths(const QSet<int> &current, const QSet<int> &next, int count)
+{
+    char buffer[2048];
+    ssize_t length;
+    bool switched = false;
+    const qint64 nsecDeadline = UdpFlow::monotonicNsec() + 5000000000;
+
+    while (count > 0 && UdpFlow::monotonicNsec() < nsecDeadline) {
+        length = recv(m_socket, buffer, sizeof (buffer), 0);
+        if (length < 0) {
+            continue;
+        }
+        if (next.contains(length)) {
+            switched = true;
+        } else if (switched || !current.contains(length)) {
+            qWarning() << "unexpected datagram of" << length << "bytes";
+            return false;
+        }
+        if (switched) {
+            count--;
+        }
+    }
+    return count == 0;
+}
+
+/*
+ * A running flow picks a new size mix up within a process() call which then sends with it:
+ * a shorter schedule, or none, must not be read with the length of the schedule before.
+ */
+void TestUdpFlow::sizeMixChange()
+{
+    UdpSenderThread thread;
+    UdpFlow flow;
+    QList<QPair<uint, uint>> longMix;
+    QList<QPair<uint, uint>> shortMix;
+
+    // 6000 lengths in the schedule, then 4096
+    longMix << qMakePair(200u, 3000u) << qMakePair(300u, 3000u);
+    shortMix << qMakePair(100u, 1u);
+
+    flow.setDestination(QHostAddress::LocalHost);
+    flow.setPort(m_port);
+    flow.setTcUsec(1000);
+    flow.setTxBatchSize(16);
+    flow.setDatagramSDULength(150);
+    flow.setSizeMix(longMix, 20);
+    flow.setSenderThread(&thread);
+    flow.start();
+
+    QVERIFY(switchLengths(QSet<int>(), QSet<int>() << 200 << 300, 1000));
+
+    flow.setSizeMix(shortMix, 20);
+    QVERIFY(switchLengths(QSet<int>() << 200 << 300, QSet<int>() << 100, 1000));
+
+    // Without a mix, the datagrams have the length of setDatagramSDULength()
+    flow.setSizeMix(QList<QPair<uint, uint>>(), 20);
+    QVERIFY(switchLengths(QSet<int>() << 100, QSet<int>() << 150, 1000));
+
+    flow.stop();
+    thread.stop();
+}
+
+/*
+ * Each datagram is echoed at once, and once more DUPLICATE_DELAY_NSEC later. The duplicates are
+ * counted, but they do not belong to the stream: they must not make jitter.
+ */
+void TestUdpFlow::duplicatedEchoJitter()
+{
+    struct Echo
+    {
+        qint64 nsecDue;
+        QByteArray datagram;
+    };
+    static const qint64 DUPLICATE_DELAY_NSEC = 20000000;
+    UdpSenderThread thread;
+    UdpFlow flow;
+    UdpSenderStats stats;
+    UdpLatencyStats latencies;
+    QQueue<Echo> duplicates;
+    char buffer[2048];
+    ssize_t length;
+    struct sockaddr_in source;
+    socklen_t sourceLength;
+    qint64 nsecNow;
+    const qint64 nsecEnd = UdpFlow::monotonicNsec() + 1500000000;
+    quint64 packetsDuplicated = 0;
+    quint64 latencyCount = 0;
+
+    // The datagrams left by the test before
+    while (recv(m_socket, buffer, sizeof (buffer), MSG_DONTWAIT) >= 0) {
+    }
+
+    flow.setDestination(QHostAddress::LocalHost);
+    flow.setPort(m_port);
+    flow.setTcUsec(1000);
+    flow.setDatagramSDULength(64);
+    flow.setPpmsec(1);
+    flow.setStatsIntervalMsec(100);
+    flow.setSenderThread(&thread);
+    flow.start();
+
+    while ((nsecNow = UdpFlow::monotonicNsec()) < nsecEnd) {
+        while (!duplicates.isEmpty() && duplicates.head().nsecDue <= nsecNow) {
+            Echo echo = duplicates.dequeue();
+            sendto(m_socket, echo.datagram.constData(), echo.datagram.size(), 0,
+                   reinterpret_cast<struct sockaddr *>(&source), sizeof (source));
+        }
+        sourceLength = sizeof (source);
+        length = recvfrom(m_socket, buffer, sizeof (buffer), MSG_DONTWAIT,
+                          reinterpret_cast<struct sockaddr *>(&source), &sourceLength);
+        if (length < 0) {
+            usleep(100);
+            continue;
+        }
+        sendto(m_socket, buffer, length, 0, reinterpret_cast<struct sockaddr *>(&source), sourceLength);
+        duplicates.enqueue(Echo{nsecNow + DUPLICATE_DELAY_NSEC, QByteArray(buffer, length)});
+
+        while (flow.takeStatistics(stats)) {
+            packetsDuplicated = stats.packetsDuplicated;
+        }
+        while (flow.takeLatencies(latencies)) {
+            latencyCount += latencies.histogram.count();
+            // Loopback echoes vary by microseconds, the duplicates would add DUPLICATE_DELAY_NSEC / 2
+            QVERIFY2(latencies.jitterNsec < DUPLICATE_DELAY_NSEC / 10, qPrintable(QString::number(latencies.jitterNsec)));
+        }
+    }
+
+    flow.stop();
+    thread.stop();
+    QVERIFY(packetsDuplicated > 0);
+    QVERIFY(latencyCount > 0);
+}
+
+/*
+ * With kernel timestamps, the echoes are first sent back at once, then ECHO_DELAY_NSEC later:
+ * more datagrams are in flight than the backend keeps send timestamps for. Their network delay is
+ * unknown, they have to be counted as missed.
+ */
+void TestUdpFlow::sendTimestampMissed()
+{
+    struct Echo
+    {
+        qint64 nsecDue;
+        QByteArray datagram;
+    };
+    static const qint64 ECHO_DELAY_NSEC = 2000000000;
+    UdpSenderThread thread;
+    UdpFlow flow;
+    UdpLatencyStats latencies;
+    QQueue<Echo> echoes;
+    char buffer[2048];
+    ssize_t length;
+    struct sockaddr_in source;
+    socklen_t sourceLength;
+    qint64 nsecNow;
+    const qint64 nsecDelayed = UdpFlow::monotonicNsec() + 500000000;
+    const qint64 nsecEnd = nsecDelayed + ECHO_DELAY_NSEC + 1000000000;
+    quint64 networkCount = 0;
+    quint64 networkMissed = 0;
+    quint64 networkMissedBefore = 0;
+
+    while (recv(m_socket, buffer, sizeof (buffer), MSG_DONTWAIT) >= 0) {
+    }
+
+    flow.setDestination(QHostAddress::LocalHost);
+    flow.setPort(m_port);
+    flow.setTcUsec(1000);
+    flow.setDatagramSDULength(64);
+    // 10000 datagrams in flight with the delay
+    flow.setPpmsec(5);
+    flow.setStatsIntervalMsec(100);
+    flow.setLossTimeoutMsec(5000);
+    flow.setTimestamping(true);
+    flow.setSenderThread(&thread);
+    flow.start();
+
+    while ((nsecNow = UdpFlow::monotonicNsec()) < nsecEnd) {
+        while (!echoes.isEmpty() && echoes.head().nsecDue <= nsecNow) {
+            Echo echo = echoes.dequeue();
+            sendto(m_socket, echo.datagram.constData(), echo.datagram.size(), 0,
+                   reinterpret_cast<struct sockaddr *>(&source), sizeof (source));
+        }
+        while (flow.takeLatencies(latencies)) {
+            networkCount += latencies.networkHistogram.count();
+            networkMissed += latencies.networkMissed;
+        }
+        sourceLength = sizeof (source);
+        length = recvfrom(m_socket, buffer, sizeof (buffer), MSG_DONTWAIT,
+                          reinterpret_cast<struct sockaddr *>(&source), &sourceLength);
+        if (length < 0) {
+            usleep(50);
+            continue;
+        }
+        if (nsecNow < nsecDelayed) {
+            sendto(m_socket, buffer, length, 0, reinterpret_cast<struct sockaddr *>(&source), sourceLength);
+            networkMissedBefore = networkMissed;
+        } else {
+            echoes.enqueue(Echo{nsecNow + ECHO_DELAY_NSEC, QByteArray(buffer, length)});
+        }
+    }
+
+    flow.stop();
+    thread.stop();
+    if (networkCount == 0) {
+        QSKIP("no kernel timestamps on the loopback interface");
+    }
+    QCOMPARE(networkMissedBefore, quint64(0));
+    QVERIFY(networkMissed > 1000);
+}
+
+QTEST_GUILESS_MAIN(TestUdpFlow)
+
+#include "tst_udpflow.moc"
@@ -0,0 +1,43 @@
+#-------------------------------------------------
+#
+# Tests of UdpFlow running on a UdpSenderThread, sending to the loopback
+#
+#-------------------------------------------------
+
+include(../tests.pri)
+
+TARGET = tst_udpflow
+
+SOURCES += tst_udpflow.cpp \
+    ../../udpflow.cpp \
+    ../../udpsenderthread.cpp \
+    ../../udpreceiverthread.cpp \
+    ../../cpuplacement.cpp \
+    ../../latencyhistogram.cpp \
+    ../../sequencewindow.cpp \
+    ../../payloadgenerator.cpp \
+    ../../crc32c.cpp \
+    ../../udpiobackend.cpp \
+    ../../udpsocketbackend.cpp \
+    ../../iouring.cpp \
+    ../../udpiouringbackend.cpp \
+    ../../udprawbackend.cpp \
+    ../../udpxdpbackend.cpp \
+    ../../udppacketbackend.cpp
+
+HEADERS += ../../udpflow.h \
+    ../../udpsenderthread.h \
+    ../../udpreceiverthread.h \
+    ../../udpstatsring.h \
+    ../../cpuplacement.h \
+    ../../latencyhistogram.h \
+    ../../sequencewindow.h \
+    ../../payloadgenerator.h \
+    ../../crc32c.h \
+    ../../udpiobackend.h \
+    ../../udpsocketbackend.h \
+    ../../iouring.h \
+    ../../udpiouringbackend.h \
+    ../../udprawbackend.h \
+    ../../udpxdpbackend.h \
+    ../../udppacketbackend.h
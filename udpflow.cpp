@@ -0,0 +1,1207 @@
+#include "udpflow.h"
+#include "udpsenderthread.h"
+#include <QtEndian>
+#include <QtGlobal>
+#include <QDebug>
+#include <QRandomGenerator>
+
+#include <cstring>
+
+UdpFlow::UdpFlow(QObject *parent) :
+    QObject(parent)
+{
+    // Emitted by the thread running the flow, the flow is restarted by the main thread
+    connect(this, SIGNAL(restartNeeded()), this, SLOT(restart()), Qt::QueuedConnection);
+}
+
+UdpFlow::~UdpFlow()
+{
+    // be sure the thread does not run the flow anymore
+    stop();
+    delete m_liveConfig.loadAcquire();
+}
+
+/* TOS, size, rate and Tc are picked up by a running flow at its next Tc, without restarting it */
+void UdpFlow::setTos(quint8 tos)
+{
+    m_Mutex.lock();
+    m_tos = tos;
+    m_Mutex.unlock();
+
+    if (isRunning()) {
+        publishConfig();
+    }
+}
+
+void UdpFlow::setDatagramSDULength(int length)
+{
+    m_Mutex.lock();
+    m_datagramSDULength = length;
+    m_Mutex.unlock();
+
+    if (isRunning()) {
+        publishConfig();
+    }
+}
+
+void UdpFlow::setDatagramSDULength(int length, qreal ppmsec)
+{
+    if (isRunning()) {
+        m_thread->updateLoad(m_ppmsec, ppmsec);
+    }
+
+    m_Mutex.lock();
+    m_datagramSDULength = length;
+    m_ppmsec = ppmsec;
+    m_Mutex.unlock();
+
+    if (isRunning()) {
+        publishConfig();
+    }
+}
+
+void UdpFlow::setSizeMix(const QList<QPair<uint, uint>> &mix, qreal ppmsec)
+{
+    QVector<quint16> t_schedule;
+    QPair<uint, uint> t_entry;
+    quint64 t_weightSum = 0;
+    quint64 t_lengthSum = 0;
+    int t_longest = 0;
+    quint64 t_repeat;
+    int j;
+
+    foreach (t_entry, mix) {
+        t_weightSum += t_entry.second;
+        t_lengthSum += static_cast<quint64>(t_entry.first) * t_entry.second;
+        if (t_entry.second > 0) {
+            t_longest = qMax(t_longest, static_cast<int>(t_entry.first));
+        }
+    }
+
+    if (t_weightSum > 0) {
+        // Each length appears as often as its weight (times t_repeat), so the mix is exact over the schedule
+        t_repeat = qMax(static_cast<quint64>(1), (SIZE_SCHEDULE_MIN_LENGTH + t_weightSum - 1) / t_weightSum);
+        t_schedule.reserve(t_weightSum * t_repeat);
+        foreach (t_entry, mix) {
+            for (quint64 i = 0; i < static_cast<quint64>(t_entry.second) * t_repeat; i++) {
+                t_schedule.append(t_entry.first);
+            }
+        }
+        // Fisher-Yates shuffle, so that the sizes do not come in blocks
+        for (int i = t_schedule.size() - 1; i > 0; i--) {
+            j = QRandomGenerator::global()->bounded(i + 1);
+            qSwap(t_schedule[i], t_schedule[j]);
+        }
+    }
+
+    if (isRunning()) {
+        m_thread->updateLoad(m_ppmsec, ppmsec);
+    }
+
+    m_Mutex.lock();
+    m_sizeSchedule = t_schedule;
+    m_sizeMixLongest = t_longest;
+    m_sizeMixAverage = (t_weightSum > 0) ? qRound(static_cast<qreal>(t_lengthSum) / t_weightSum) : 0;
+    m_ppmsec = ppmsec;
+    m_Mutex.unlock();
+
+    if (isRunning()) {
+        publishConfig();
+    }
+}
+
+void UdpFlow::setPpmsec(qreal ppmsec)
+{
+    if (isRunning()) {
+        // The thread spreads its flows by their rate
+        m_thread->updateLoad(m_ppmsec, ppmsec);
+    }
+
+    m_Mutex.lock();
+    m_ppmsec = ppmsec;
+    m_Mutex.unlock();
+
+    if (isRunning()) {
+        publishConfig();
+    }
+}
+
+qreal UdpFlow::ppmsec()
+{
+    return m_ppmsec;
+}
+
+void UdpFlow::setRateProfile(const QVector<UdpRateStep> &profile, bool loop, bool restart)
+{
+    m_Mutex.lock();
+    m_rateProfile = profile;
+    m_rateProfileLoop = loop;
+    if (restart) {
+        m_rateProfileId++;
+    }
+    m_Mutex.unlock();
+
+    if (isRunning()) {
+        publishConfig();
+    }
+}
+
+bool UdpFlow::setPort(int port)
+{
+    if (isRunning()) {
+        // We don't change the destination port while the flow is running
+        //FIXME: this should be handled by the GUI
+        return false;
+    }
+
+    m_udpPort = port;
+    return true;
+}
+
+bool UdpFlow::setDestination(QHostAddress address)
+{
+    if (isRunning()) {
+        // We don't change the destination address while the flow is running
+        //FIXME: this should be handled by the GUI
+        return false;
+    }
+
+    m_destination = address;
+    return true;
+}
+
+void UdpFlow::setTcUsec(uint tcUsec)
+{
+    // these guards should be enforced into the UI, be we have to be sure
+    // Tc cannot be zero, and we would only spin below MIN_TC_USEC
+    if (tcUsec < MIN_TC_USEC)
+        tcUsec = MIN_TC_USEC;
+    // Tc should not be superior to 1 second (or we may have to change some code like packet loss detection)
+    if (tcUsec > MAX_TC_USEC)
+        tcUsec = MAX_TC_USEC;
+
+    m_Mutex.lock();
+    m_tcUsec = tcUsec;
+    m_Mutex.unlock();
+
+    if (isRunning()) {
+        publishConfig();
+    }
+}
+
+void UdpFlow::setTxBatchSize(int batchSize)
+{
+    // these guards should be enforced into the UI, be we have to be sure
+    batchSize = qBound(1, batchSize, MAX_TX_BATCH_SIZE);
+
+    if (isRunning()) {
+        // We don't change the batch size while the flow is running. First stop the flow
+        stop();
+
+        m_txBatchSize = batchSize;
+
+        start();
+    } else {
+        m_txBatchSize = batchSize;
+    }
+}
+
+void UdpFlow::setRxDrainBudget(int budget)
+{
+    // A negative budget makes no sense, 0 means "receive until the buffer is empty"
+    if (budget < 0)
+        budget = 0;
+
+    if (isRunning()) {
+        // We don't change the budget while the flow is running. First stop the flow
+        stop();
+
+        m_rxDrainBudget = budget;
+
+        start();
+    } else {
+        m_rxDrainBudget = budget;
+    }
+}
+
+void UdpFlow::setUdpGso(bool enabled)
+{
+    if (isRunning()) {
+        // The socket is configured when the flow starts. First stop the flow
+        stop();
+
+        m_udpGso = enabled;
+
+        start();
+    } else {
+        m_udpGso = enabled;
+    }
+}
+
+void UdpFlow::setTimestamping(bool enabled)
+{
+    if (isRunning()) {
+        // The socket is configured when the flow starts. First stop the flow
+        stop();
+
+        m_timestamping = enabled;
+
+        start();
+    } else {
+        m_timestamping = enabled;
+    }
+}
+
+void UdpFlow::setMaxDatagramSDULength(int length)
+{
+    // Used by the next start: a running flow restarts if its datagrams do not fit any more
+    m_Mutex.lock();
+    m_maxDatagramSDULength = length;
+    m_Mutex.unlock();
+}
+
+void UdpFlow::setCrc32c(bool enabled)
+{
+    if (isRunning()) {
+        // Both halves have to agree on the trailer. First stop the flow
+        stop();
+
+        m_crc32c = enabled;
+
+        start();
+    } else {
+        m_crc32c = enabled;
+    }
+}
+
+void UdpFlow::setUdpGro(bool enabled)
+{
+    if (isRunning()) {
+        // The socket is configured when the flow starts. First stop the flow
+        stop();
+
+        m_udpGro = enabled;
+
+        start();
+    } else {
+        m_udpGro = enabled;
+    }
+}
+
+void UdpFlow::setPacingMode(PacingMode mode)
+{
+    if (isRunning()) {
+        // We don't change the pacing while the flow is running. First stop the flow
+        stop();
+
+        m_pacingMode = mode;
+
+        start();
+    } else {
+        m_pacingMode = mode;
+    }
+}
+
+void UdpFlow::setPayloadMode(PayloadGenerator::Mode mode)
+{
+    if (isRunning()) {
+        // The buffers of the backend are zeroed when the flow starts. First stop the flow
+        stop();
+
+        m_payloadMode = mode;
+
+        start();
+    } else {
+        m_payloadMode = mode;
+    }
+}
+
+QString UdpFlow::pacingModeName(PacingMode mode)
+{
+    switch (mode) {
+    case BurstPacing:
+        return "burst";
+    case SmoothPacing:
+        return "smooth";
+    case KernelPacing:
+        return "kernel";
+    }
+
+    return "burst";
+}
+
+/* Returns the pacing mode from its name. Unknown names return BurstPacing */
+UdpFlow::PacingMode UdpFlow::pacingModeFromName(QString name)
+{
+    name = name.trimmed().toLower();
+
+    if (name == pacingModeName(SmoothPacing)) {
+        return SmoothPacing;
+    }
+    if (name == pacingModeName(KernelPacing)) {
+        return KernelPacing;
+    }
+
+    return BurstPacing;
+}
+
+void UdpFlow::setIoBackend(UdpIoBackend::Backend backend)
+{
+    if (isRunning()) {
+        // The backend is opened when the flow starts. First stop the flow
+        stop();
+
+        m_ioBackend = backend;
+
+        start();
+    } else {
+        m_ioBackend = backend;
+    }
+}
+
+void UdpFlow::setStatsIntervalMsec(int msec)
+{
+    msec = qBound(MIN_STATS_INTERVAL_MSEC, msec, MAX_STATS_INTERVAL_MSEC);
+
+    m_Mutex.lock();
+    m_nsecStatsInterval = static_cast<qint64>(msec) * 1000000;
+    m_Mutex.unlock();
+
+    if (isRunning()) {
+        publishConfig();
+    }
+}
+
+void UdpFlow::setLossTimeoutMsec(int msec)
+{
+    msec = qBound(MIN_LOSS_TIMEOUT_MSEC, msec, MAX_LOSS_TIMEOUT_MSEC);
+
+    m_Mutex.lock();
+    m_nsecLossTimeout = static_cast<qint64>(msec) * 1000000;
+    m_Mutex.unlock();
+
+    if (isRunning()) {
+        publishConfig();
+    }
+}
+
+void UdpFlow::setSenderThread(UdpSenderThread *thread)
+{
+    if (isRunning()) {
+        // A flow does not move while it is running
+        return;
+    }
+
+    m_thread = thread;
+}
+
+UdpSenderThread *UdpFlow::senderThread()
+{
+    return m_thread;
+}
+
+void UdpFlow::start()
+{
+    if (m_running || m_thread == NULL) {
+        return;
+    }
+
+    // The thread opens the flow with the live parameters
+    publishConfig();
+    m_running = true;
+    m_thread->addFlow(this);
+}
+
+void UdpFlow::stop()
+{
+    if (m_running) {
+        m_running = false;
+
+        // Make sure the thread does not run the flow anymore
+        m_thread->removeFlow(this);
+
+        // The thread does not read any parameter block anymore
+        qDeleteAll(m_retiredConfigs);
+        m_retiredConfigs.clear();
+    }
+}
+
+void UdpFlow::restart()
+{
+    if (m_running) {
+        stop();
+        start();
+    }
+}
+
+/*
+ * Publishes the live parameters to the thread running the flow (RCU style).
+ * The block replaced may still be read by the thread until it acknowledges a newer version
+ * (t_sharedConfigVersion). As versions only grow, the blocks older than the acknowledged
+ * version can be freed.
+ */
+void UdpFlow::publishConfig()
+{
+    UdpFlowConfig *t_config = new UdpFlowConfig;
+    UdpFlowConfig *t_oldConfig;
+    quint64 t_versionInUse;
+
+    m_Mutex.lock();
+    t_config->ppmsec = m_ppmsec;
+    t_config->tcUsec = m_tcUsec;
+    t_config->sizeSchedule = m_sizeSchedule;
+    if (m_sizeSchedule.isEmpty()) {
+        t_config->datagramSDULength = m_datagramSDULength;
+        t_config->averageSDULength = m_datagramSDULength;
+    } else {
+        t_config->datagramSDULength = m_sizeMixLongest;
+        t_config->averageSDULength = m_sizeMixAverage;
+    }
+    t_config->tos = m_tos;
+    t_config->rateProfile = m_rateProfile;
+    t_config->rateProfileLoop = m_rateProfileLoop;
+    t_config->rateProfileId = m_rateProfileId;
+    t_config->nsecStatsInterval = m_nsecStatsInterval;
+    t_config->nsecLossTimeout = m_nsecLossTimeout;
+    m_Mutex.unlock();
+    m_configVersion++;
+    t_config->version = m_configVersion;
+
+    t_oldConfig = m_liveConfig.fetchAndStoreOrdered(t_config);
+    if (t_oldConfig != NULL) {
+        m_retiredConfigs.append(t_oldConfig);
+    }
+
+    t_versionInUse = t_sharedConfigVersion.loadAcquire();
+    while (!m_retiredConfigs.isEmpty() && m_retiredConfigs.first()->version < t_versionInUse) {
+        delete m_retiredConfigs.takeFirst();
+    }
+}
+
+/* True between start() and stop(), even if the thread could not open the backend */
+bool UdpFlow::isRunning()
+{
+    return m_running;
+}
+
+/*
+ * I want this to be very fast, so we will read the parameters once with a Mutex.
+ * If the parameter are changed, the main process has to restart the flow. Only the live
+ * parameters (UdpFlowConfig) are picked up while the flow runs, see applyConfig().
+ *
+ * This is Linux-Only code. If someone wants to port to windows, here are
+ * hints for Sockets with Linux & Windows:
+ * https://handsonnetworkprogramming.com/articles/socket-error-message-text/
+ */
+bool UdpFlow::open(IoUring *ring)
+{
+    /********************************************************************
+    * Open the I/O backend: it creates the socket and sends and receives the datagrams.
+    * The options the kernel refuses are cleared in t_ioConfig.
+    *********************************************************************/
+    UdpIoConfig t_ioConfig;
+    // Published by start(), it does not change as long as we do not acknowledge it
+    t_config = *m_liveConfig.loadAcquire();
+    t_sharedConfigVersion.storeRelease(t_config.version);
+
+    m_Mutex.lock();
+    t_ioConfig.destination = m_destination;
+    t_ioConfig.udpPort = m_udpPort;
+    t_ioConfig.tos = t_config.tos;
+    t_ioConfig.datagramSDULength = t_config.datagramSDULength;
+    t_ioConfig.maxDatagramSDULength = m_maxDatagramSDULength;
+    t_ioConfig.variableLength = !t_config.sizeSchedule.isEmpty();
+    t_ioConfig.txBatchSize = m_txBatchSize;
+    t_ioConfig.udpGso = m_udpGso;
+    t_ioConfig.udpGro = m_udpGro;
+    t_ioConfig.timestamping = m_timestamping;
+    const UdpIoBackend::Backend t_ioBackend = m_ioBackend;
+    m_Mutex.unlock();
+
+    /********************************************************************
+    * Now initialise many variables
+    *********************************************************************/
+    // Current Time in nanoseconds from the monotonic clock
+    const qint64 t_nsecNow = monotonicNsec();
+
+    t_nsecTc = static_cast<qint64>(t_config.tcUsec) * 1000;
+    t_packetsBc = t_config.ppmsec * t_config.tcUsec / 1000;
+    t_packetsBcFraction = t_packetsBc;
+
+    t_packetBucket = t_packetsBcFraction;
+    t_packetsBcFraction -= t_packetBucket;
+
+    t_nsecNextRefill = t_nsecNow + t_nsecTc;
+
+    m_Mutex.lock();
+    t_pacingMode = m_pacingMode;
+    t_payload.setMode(m_payloadMode);
+    t_crc32c = m_crc32c;
+    m_Mutex.unlock();
+    t_nsecInterPacket = (t_config.ppmsec > 0) ? 1000000 / t_config.ppmsec : t_nsecTc;
+    const quint64 t_pacingRate = pacingRate(t_config);
+    t_nsecNextDeparture = t_nsecNow;
+    t_nsecLookahead = 0;
+
+    /* With kernel pacing, we hand the departure times over to the qdisc (fq or etf) with SO_TXTIME.
+     * If SO_TXTIME is not supported, the fq qdisc can still pace the socket to a maximum rate.
+     * If both fail, we pace in userspace.
+     */
+    if (t_pacingMode == KernelPacing) {
+        t_ioConfig.txTime = true;
+        t_ioConfig.maxPacingRate = t_pacingRate;
+    }
+
+    t_backend = UdpIoBackend::create(t_ioBackend, ring);
+    const bool t_timestampingWanted = t_ioConfig.timestamping;
+    if (!t_backend->open(t_ioConfig)) {
+        qDebug() << "UdpFlow::open: could not open the" << UdpIoBackend::backendName(t_ioBackend) << "backend";
+        delete t_backend;
+        t_backend = NULL;
+        return false;
+    }
+    if (t_timestampingWanted && !t_ioConfig.timestamping) {
+        qDebug() << "UdpFlow::open: no kernel timestamps with the" << UdpIoBackend::backendName(t_ioBackend) << "backend";
+    }
+    t_variableLengthAsked = !t_config.sizeSchedule.isEmpty();
+    t_variableLength = t_ioConfig.variableLength;
+    t_backendLength = t_ioConfig.datagramSDULength;
+    if (t_variableLengthAsked && !t_variableLength) {
+        // The bandwidth stays right if all datagrams have the average length
+        qDebug() << "UdpFlow::open: no size mix with the" << UdpIoBackend::backendName(t_ioBackend)
+                 << "backend, sending datagrams of the average length";
+        t_ioConfig.datagramSDULength = backendLength(t_config);
+        if (t_backend->reconfigure(t_ioConfig)) {
+            t_backendLength = t_ioConfig.datagramSDULength;
+        }
+    }
+
+    t_socketPacingRate = false;
+    if (t_pacingMode == KernelPacing) {
+        if (t_ioConfig.txTime) {
+            t_nsecLookahead = KERNEL_PACING_LOOKAHEAD_NSEC;
+        } else if (t_ioConfig.maxPacingRate > 0) {
+            // The kernel spreads the packets, we just fill the socket like with burst pacing
+            qDebug() << "UdpFlow::open: SO_TXTIME not supported, using SO_MAX_PACING_RATE";
+            t_pacingMode = BurstPacing;
+            t_socketPacingRate = true;
+        } else {
+            qDebug() << "UdpFlow::open: kernel pacing not supported, pacing in userspace";
+            t_pacingMode = SmoothPacing;
+        }
+    }
+    t_txTime = t_ioConfig.txTime;
+
+    t_txBatchSize = t_ioConfig.txBatchSize;
+    m_Mutex.lock();
+    t_rxDrainBudget = m_rxDrainBudget;
+    m_Mutex.unlock();
+    t_rxBatchSize = t_ioConfig.udpGro ? UdpIoBackend::RX_GRO_BATCH_SIZE : UdpIoBackend::RX_BATCH_SIZE;
+
+    t_sendingCounter = 0;
+    // A rate profile starts with the flow, its first Tc already follows it
+    startRateProfile(t_nsecNow);
+    if (!t_config.rateProfile.isEmpty()) {
+        followRateProfile(t_nsecNow);
+        t_packetsBcFraction = t_packetsBc;
+        t_packetBucket = t_packetsBcFraction;
+        t_packetsBcFraction -= t_packetBucket;
+    }
+    // Room for the packets of the loss timeout, cleared
+    t_sequence.setSize(SequenceWindow::sizeFor(t_config.ppmsec, t_config.nsecLossTimeout));
+
+    t_statsPacketsCorrupted = 0;
+    t_statsPacketsNotSent = 0;
+    t_statsSendCalls = 0;
+    t_statsReceiveCalls = 0;
+    t_statsPacingErrorSum = 0;
+    t_statsPacingErrorCount = 0;
+    t_statsPacingErrorMax = 0;
+    t_nsecStarted = t_nsecNow;
+    t_nsecStatsInterval = t_config.nsecStatsInterval;
+    t_statNextTime = (t_nsecNow / t_nsecStatsInterval + 1) * t_nsecStatsInterval;
+    t_sharedStatsInterval.storeRelease(t_nsecStatsInterval);
+    t_latencies = UdpLatencyStats();
+    t_latencyNextTime = t_statNextTime;
+    t_jitterScaled = 0;
+    t_previousLatency = -1;
+    // No packet before the first one
+    t_ipdvNextCounter = Q_UINT64_C(0xffffffffffffffff);
+    t_sharedPacketsReceived.storeRelease(0);
+    t_sharedPacketsLost.storeRelease(0);
+    t_sharedReceiveCalls.storeRelease(0);
+    t_sharedCounterTimedOut.storeRelease(0);
+    t_sharedPacketsReordered.storeRelease(0);
+    t_sharedPacketsDuplicated.storeRelease(0);
+    t_sharedPacketsLate.storeRelease(0);
+    t_sharedPacketsCorrupted.storeRelease(0);
+    t_separateReceive = false;
+
+    t_nsecLossTimeout = t_config.nsecLossTimeout;
+    t_counterMarkFirst = 0;
+    t_counterMarkCount = 0;
+    t_nsecNextCounterMark = t_nsecNow;
+
+    // Run as soon as possible
+    t_nsecNextRun = t_nsecNow;
+    t_wantsToSend = false;
+
+    return true;
+}
+
+/*
+ * Applies the live parameters published by the main thread. Called at the beginning of a Tc,
+ * so that the new rate starts with a whole Tc. The backend stays open: the counters, the loss
+ * detection and the stats keep running.
+ */
+void UdpFlow::applyConfig(const UdpFlowConfig *config, qint64 nsecNow)
+{
+    UdpIoConfig t_ioConfig;
+
+    t_nsecLossTimeout = config->nsecLossTimeout;
+    if ((config->ppmsec != t_config.ppmsec || config->nsecLossTimeout != t_config.nsecLossTimeout)
+            && t_sequence.size() < SequenceWindow::MAX_SIZE
+            && config->ppmsec * config->nsecLossTimeout / 1000000 > t_sequence.size()) {
+        // The packets would leave the sequence window before they time out: open with a larger one
+        qDebug() << "UdpFlow::applyConfig: the sequence window is too small for the rate and the loss timeout, restarting the flow";
+        emit restartNeeded();
+    }
+
+    if (config->nsecStatsInterval != t_nsecStatsInterval) {
+        t_nsecStatsInterval = config->nsecStatsInterval;
+        t_statNextTime = (nsecNow / t_nsecStatsInterval + 1) * t_nsecStatsInterval;
+        t_sharedStatsInterval.storeRelease(t_nsecStatsInterval);
+    }
+
+    t_nsecTc = static_cast<qint64>(config->tcUsec) * 1000;
+    t_packetsBc = config->ppmsec * config->tcUsec / 1000;
+    t_nsecInterPacket = (config->ppmsec > 0) ? 1000000 / config->ppmsec : t_nsecTc;
+    if (config->rateProfileId != t_config.rateProfileId) {
+        // The profile starts with the Tc beginning now
+        startRateProfile(t_nsecNextRefill);
+    }
+
+    if (!config->sizeSchedule.isEmpty() && !t_variableLengthAsked) {
+        // The backend has to be opened again, with variableLength
+        qDebug() << "UdpFlow::applyConfig: a size mix needs a new backend, restarting the flow";
+        t_variableLengthAsked = true;
+        emit restartNeeded();
+    }
+
+    const int t_length = backendLength(*config);
+    if (config->tos != t_config.tos || t_length != t_backendLength
+            || (t_socketPacingRate && (config->ppmsec != t_config.ppmsec
+                                       || config->averageSDULength != t_config.averageSDULength))) {
+        t_ioConfig.tos = config->tos;
+        t_ioConfig.datagramSDULength = t_length;
+        t_ioConfig.maxPacingRate = t_socketPacingRate ? pacingRate(*config) : 0;
+        if (!t_backend->reconfigure(t_ioConfig)) {
+            // We go on with the old TOS and size until the main thread reopens the flow
+            qDebug() << "UdpFlow::applyConfig: the backend can not change TOS or size while running, restarting the flow";
+            emit restartNeeded();
+        } else {
+            // The payloads are filled up to this length
+            t_backendLength = t_length;
+        }
+    }
+
+    t_config = *config;
+    // The main thread may free the older blocks
+    t_sharedConfigVersion.storeRelease(t_config.version);
+}
+
+void UdpFlow::startRateProfile(qint64 nsecNow)
+{
+    t_profileStep = 0;
+    t_profilePass = 0;
+    t_nsecStepStart = nsecNow;
+    t_stepPacketsTarget = 0;
+    t_stepFirstCounter = t_sendingCounter;
+}
+
+/*
+ * The rate is set once per Tc, so a step is followed at Tc granularity: the Tcs which begin in a
+ * step have its rate, and a step shorter than Tc may be skipped.
+ */
+void UdpFlow::followRateProfile(qint64 nsecTcStart)
+{
+    const UdpRateStep *t_steps = t_config.rateProfile.constData();
+    const int t_stepCount = t_config.rateProfile.size();
+    UdpRateStepStats t_stepStats;
+    qreal t_ppmsec;
+    qreal t_position;
+
+    // Publish the steps which ended since the last Tc. They got the packets sent until now.
+    while (t_profileStep < t_stepCount && nsecTcStart >= t_nsecStepStart + t_steps[t_profileStep].nsecDuration) {
+        t_stepStats.step = t_profileStep;
+        t_stepStats.pass = t_profilePass;
+        t_stepStats.nsecStart = t_nsecStepStart;
+        t_stepStats.nsecEnd = t_nsecStepStart + t_steps[t_profileStep].nsecDuration;
+        t_stepStats.packetsTarget = t_stepPacketsTarget;
+        t_stepStats.packetsSent = t_sendingCounter - t_stepFirstCounter;
+        // If the main thread does not keep up, the step is dropped
+        m_rateStepRing.push(t_stepStats);
+
+        t_nsecStepStart = t_stepStats.nsecEnd;
+        t_stepPacketsTarget = 0;
+        t_stepFirstCounter = t_sendingCounter;
+        t_profileStep++;
+        if (t_profileStep == t_stepCount && t_config.rateProfileLoop) {
+            t_profileStep = 0;
+            t_profilePass++;
+        }
+    }
+
+    if (t_profileStep >= t_stepCount) {
+        // The profile ended, its last rate is kept
+        t_ppmsec = t_steps[t_stepCount - 1].ppmsecEnd;
+    } else {
+        // The rate in the middle of the Tc, so that a ramp sends the packets of its area
+        t_position = static_cast<qreal>(nsecTcStart + t_nsecTc / 2 - t_nsecStepStart) / t_steps[t_profileStep].nsecDuration;
+        t_ppmsec = t_steps[t_profileStep].ppmsecStart
+                + (t_steps[t_profileStep].ppmsecEnd - t_steps[t_profileStep].ppmsecStart) * qBound(0.0, t_position, 1.0);
+    }
+
+    t_packetsBc = t_ppmsec * t_config.tcUsec / 1000;
+    t_nsecInterPacket = (t_ppmsec > 0) ? 1000000 / t_ppmsec : t_nsecTc;
+    t_stepPacketsTarget += t_packetsBc;
+}
+
+void UdpFlow::close()
+{
+    // close the backend and its socket
+    if (t_backend != NULL) {
+        t_backend->close();
+        delete t_backend;
+        t_backend = NULL;
+    }
+}
+
+/*
+ * The receiving step of the engine: receives the echoes, counts lost packets and measures latency.
+ * Called by process(), or by a receiver thread at the same time as process() runs on the sending
+ * thread. The two halves only share the t_shared counters.
+ * The latencies go into a histogram, handed over to the main thread at the report epochs.
+ */
+void UdpFlow::receive(qint64 nsecNow)
+{
+    int t_result;
+    // Count of datagrams asked from the backend
+    int t_batchCount;
+    // Payload of the datagram beeing processed
+    const char *t_datagramReceive;
+    // Datagrams we still may receive in this pass. Not used if t_rxDrainBudget is 0 (unlimited)
+    int t_receiveBudget;
+
+    quint64 t_returnedCounter;
+    SequenceWindow::Arrival t_arrival;
+    /* We keep track of the time the packet was send in order to measure latency
+     * The sending time is written at the beginning of each datagram. The returned
+     * time is read from the received datagram.
+    */
+    qint64 t_returnedTime;
+    // Time the batch was received
+    qint64 t_nsecReceived = nsecNow;
+    qint64 t_latency;
+    /* With timestamping, the delay between the kernel send and receive timestamps, -1 if unknown.
+     * The rest of the latency is spent in our host (stack, queues, this process).
+     */
+    qint64 t_networkLatency;
+    qint64 t_nsecSent;
+    bool t_hardwareSent;
+    // The echo has a receive timestamp but its send timestamp is gone (or not there yet)
+    bool t_sendTimestampMissed;
+    // Delay variation to the previous packet
+    qint64 t_delayDelta;
+    qint64 t_nsecStatsInterval;
+
+    // The packets which did not come back in time are lost
+    const quint64 t_counterTimedOut = t_sharedCounterTimedOut.loadAcquire();
+    if (t_counterTimedOut > t_sequence.base()) {
+        t_sequence.advance(t_counterTimedOut);
+    }
+
+    /********************************************************************
+    * Receive as much packets as possible, in order to clear the buffers.
+    * We begin with receiving because we do not want packet drops comming from overfull receiving buffers.
+    * We might not reach the wanted bandwidth because we recive to much at a time. But leaving packets
+    * in the receiving Buffer could produce unwanted packet loss.
+    * If a drain budget is set, we stop after t_rxDrainBudget packets so that sending gets its turn.
+    * The remaining packets are received with the next pass.
+    * As soon as there is nothing to receive, the backend returns 0 and we are done.
+    ********************************************************************/
+    t_receiveBudget = t_rxDrainBudget;
+    while (true) {
+        if (t_rxDrainBudget > 0) {
+            if (t_receiveBudget <= 0) {
+                // Budget exhausted, let the sending step (or the other flows) run
+                break;
+            }
+            t_batchCount = qMin(t_receiveBudget, t_rxBatchSize);
+        } else {
+            t_batchCount = t_rxBatchSize;
+        }
+
+        t_result = t_backend->receive(t_batchCount);
+        if (t_result <= 0) {
+            /* Error or buffers empty => stop receiving for now and go to next step */
+            break;
+        }
+        t_statsReceiveCalls++;
+        t_receiveBudget -= t_result;
+        // A long drain takes time: the echoes of this batch did not wait for the previous batches
+        t_nsecReceived = monotonicNsec();
+
+        // Process the whole batch in one pass
+        for (int i = 0; i < t_result; i++) {
+            const UdpIoDatagram &t_datagram = t_backend->receivedDatagram(i);
+            if (t_datagram.length < PAYLOAD_HEADER_LENGTH) {
+                // Too short to carry our timestamp and counter, this is not one of our packets
+                continue;
+            }
+            t_datagramReceive = t_datagram.payload;
+            // Behind the Ethernet, IP and UDP headers of the raw backends, the payload is not 8-byte aligned
+            t_returnedTime = qFromUnaligned<qint64>(t_datagramReceive);
+            t_returnedCounter = qFromUnaligned<quint64>(t_datagramReceive + 8);
+
+            /* A corrupted echo is not lost: it is received and counted as corrupted. Its timestamp
+             * can not be trusted, so it has no latency. If its counter is not plausible (outside the
+             * window or received already), the packet it was will be lost as well.
+             * The end of a truncated echo is missing, it can not be checked.
+             */
+            if (t_crc32c && !t_datagram.truncated
+                    && t_datagram.length >= PAYLOAD_HEADER_LENGTH + CRC32C_TRAILER_LENGTH
+                    && Crc32c::compute(t_datagramReceive, t_datagram.length - CRC32C_TRAILER_LENGTH)
+                       != qFromUnaligned<quint32>(t_datagramReceive + t_datagram.length - CRC32C_TRAILER_LENGTH)) {
+                t_statsPacketsCorrupted++;
+                t_sequence.receiveInWindow(t_returnedCounter);
+                continue;
+            }
+
+            // With a receiver thread, the echo may have been sent after nsecNow was taken
+            t_latency = (t_nsecReceived > t_returnedTime) ? t_nsecReceived - t_returnedTime : 0;
+
+            // Both kernel timestamps have to come from the same clock: the NIC or the kernel
+            t_networkLatency = -1;
+            t_sendTimestampMissed = false;
+            if (t_datagram.nsecKernelTimestamp != 0) {
+                if (!t_backend->sendTimestamp(t_returnedCounter, t_nsecSent, t_hardwareSent)) {
+                    t_sendTimestampMissed = true;
+                } else if (t_hardwareSent == t_datagram.hardwareTimestamp
+                           && t_datagram.nsecKernelTimestamp >= t_nsecSent) {
+                    t_networkLatency = t_datagram.nsecKernelTimestamp - t_nsecSent;
+                }
+            }
+
+            t_arrival = t_sequence.receive(t_returnedCounter);
+            // The latency of a duplicate was recorded with its first echo
+            if (t_arrival == SequenceWindow::Duplicated) {
+                continue;
+            }
+            t_latencies.histogram.record(t_latency);
+            if (t_networkLatency >= 0) {
+                t_latencies.networkHistogram.record(t_networkLatency);
+            } else if (t_sendTimestampMissed) {
+                t_latencies.networkMissed++;
+            }
+
+            /* RFC 3550 interarrival jitter: J += (|D| - J) / 16, D being the difference of the transit
+             * times of this packet and of the packet received before it (in arrival order).
+             * The round trip time is our transit time: both timestamps are from our clock.
+             * Only the packets of the stream count: a late echo came back after the loss timeout.
+             */
+            if (t_arrival == SequenceWindow::Late) {
+                continue;
+            }
+            if (t_previousLatency >= 0) {
+                t_delayDelta = qAbs(t_latency - t_previousLatency);
+                t_jitterScaled += t_delayDelta - ((t_jitterScaled + 8) >> 4);
+            }
+            t_previousLatency = t_latency;
+
+            if (t_arrival == SequenceWindow::InSequence) {
+                // RFC 5481 IPDV: only between consecutive packets of the sequence
+                if (t_returnedCounter == t_ipdvNextCounter) {
+                    t_delayDelta = t_latency - t_ipdvPreviousLatency;
+                    if (t_latencies.ipdvCount == 0) {
+                        t_latencies.ipdvMinNsec = t_delayDelta;
+                        t_latencies.ipdvMaxNsec = t_delayDelta;
+                    } else if (t_delayDelta < t_latencies.ipdvMinNsec) {
+                        t_latencies.ipdvMinNsec = t_delayDelta;
+                    } else if (t_delayDelta > t_latencies.ipdvMaxNsec) {
+                        t_latencies.ipdvMaxNsec = t_delayDelta;
+                    }
+                    t_latencies.ipdvCount++;
+                    t_latencies.ipdvAbsSumNsec += qAbs(t_delayDelta);
+                }
+                t_ipdvNextCounter = t_returnedCounter + 1;
+                t_ipdvPreviousLatency = t_latency;
+            }
+        }
+
+        if (t_result < t_batchCount) {
+            // The receiving buffer is empty, no need to call receive() again
+            break;
+        }
+    }
+
+    // Hand the counters over to the sending step, which reports them
+    t_sharedPacketsReceived.storeRelease(t_sequence.received());
+    t_sharedPacketsLost.storeRelease(t_sequence.lost());
+    t_sharedReceiveCalls.storeRelease(t_statsReceiveCalls);
+    t_sharedPacketsReordered.storeRelease(t_sequence.reordered());
+    t_sharedPacketsDuplicated.storeRelease(t_sequence.duplicated());
+    t_sharedPacketsLate.storeRelease(t_sequence.late());
+    t_sharedPacketsCorrupted.storeRelease(t_statsPacketsCorrupted);
+
+    /* Hand the latencies over at the report epochs of the sending half. If the main thread does not
+     * keep up, we go on recording into the same histogram, it then covers several intervals.
+     */
+    if (t_latencyNextTime <= nsecNow) {
+        t_nsecStatsInterval = t_sharedStatsInterval.loadAcquire();
+        t_latencies.nsecEpoch = nsecNow - nsecNow % t_nsecStatsInterval;
+        t_latencies.jitterNsec = t_jitterScaled >> 4;
+        if (m_latencyRing.push(t_latencies)) {
+            t_latencies.histogram.clear();
+            t_latencies.networkHistogram.clear();
+            t_latencies.networkMissed = 0;
+            t_latencies.ipdvCount = 0;
+            t_latencies.ipdvAbsSumNsec = 0;
+        }
+        t_latencyNextTime = t_latencies.nsecEpoch + t_nsecStatsInterval;
+    }
+}
+
+/*
+ * One pass of the sending engine: stats, receive, send.
+ * With a receiver thread, the receiving step is done by receive() on the other thread.
+ *
+ * All thread-internal variables are prefixed with t_
+ * All shared variables (parameters of the flow) are prefixed with m_
+ *
+ * This is a quite monolithic function. I avoided function calls in order to save
+ * CPU cycles. I'm not sure this is a good idea, the code is difficult to read.
+ *
+ * The stats are handed over to the main thread with m_statsRing, without any lock.
+ */
+qint64 UdpFlow::process(qint64 nsecNow)
+{
+    qint64 t_nsecNow = nsecNow;
+    int t_result;
+
+    // Packets whose departure time is reached
+    qint64 t_packetsDue;
+    // Difference between the real and the scheduled departure time
+    qint64 t_pacingError;
+
+    // Time stamped into the datagrams
+    qint64 t_nsecSendTime;
+    // Count of datagrams in the current batch
+    int t_batchCount;
+    // Payload of the datagram beeing prepared
+    char *t_datagramSend;
+    // Payload length of the datagram beeing prepared
+    int t_length;
+    // With a size mix, position of the datagram beeing prepared in the size schedule, and the length of the schedule
+    int t_sizeIndex = 0;
+    int t_sizeCount;
+    // The backend took less datagrams than we wanted to send
+    bool t_sendBlocked = false;
+    // Live parameters published by the main thread
+    const UdpFlowConfig *t_newConfig;
+    CounterMark *t_counterMark;
+
+    UdpSenderStats t_stats;
+
+    /********************************************************************
+    * First step: publish a stats snapshot at each report epoch
+    * We do this before we send new packets and hope to get stats that
+    * do not vary to much in time.
+    * The epochs are multiples of the stats interval on the monotonic clock, so all flows take
+    * their snapshots at the same times. The snapshot carries the time it was taken: the main
+    * thread calculates the rates with it, whenever it reads the snapshot.
+    *********************************************************************/
+    if (t_statNextTime <= t_nsecNow) {
+        t_stats.nsecTimestamp = t_nsecNow;
+        t_stats.nsecEpoch = t_nsecNow - t_nsecNow % t_nsecStatsInterval;
+        t_stats.nsecStarted = t_nsecStarted;
+        t_stats.packetsLost = t_sharedPacketsLost.loadAcquire();
+        t_stats.packetsSent = t_sendingCounter;
+        t_stats.packetsReceived = t_sharedPacketsReceived.loadAcquire();
+        // Asynchronous backends report failed sends afterwards
+        t_stats.packetsNotSent = t_statsPacketsNotSent + t_backend->sendErrors();
+        t_stats.sendCalls = t_statsSendCalls;
+        t_stats.receiveCalls = t_sharedReceiveCalls.loadAcquire();
+        t_stats.packetsReordered = t_sharedPacketsReordered.loadAcquire();
+        t_stats.packetsDuplicated = t_sharedPacketsDuplicated.loadAcquire();
+        t_stats.packetsLate = t_sharedPacketsLate.loadAcquire();
+        t_stats.packetsCorrupted = t_sharedPacketsCorrupted.loadAcquire();
+        t_stats.pacingErrorSumNsec = t_statsPacingErrorSum;
+        t_stats.pacingErrorCount = t_statsPacingErrorCount;
+        t_stats.pacingErrorMaxNsec = t_statsPacingErrorMax;
+        // If the main thread does not keep up, the snapshot is dropped. The next one has the counters.
+        if (m_statsRing.push(t_stats)) {
+            // The maximum is reported per snapshot
+            t_statsPacingErrorMax = 0;
+        }
+
+        // Next epoch. If we are late, the epochs missed are skipped.
+        t_statNextTime = t_stats.nsecEpoch + t_nsecStatsInterval;
+    }
+
+
+    /********************************************************************
+    * Second step: receive, unless a receiver thread does it
+    ********************************************************************/
+    if (!t_separateReceive) {
+        receive(t_nsecNow);
+    }
+
+
+
+    /********************************************************************
+    * Third step: send one batch of packets if needed
+    * If the buffers are full, the backend sends nothing
+    * We only send one batch (up to t_txBatchSize packets) as we also want to receive packets
+    * in order to avoid packet loss. A batch of one packet does cost some CPU time, a
+    * bigger batch saves system calls.
+    *********************************************************************/
+    // Do we need to refill our Bucket?
+    if (t_nsecNextRefill <= t_nsecNow) {
+        // Pick the parameters changed by the main thread up with this Tc
+        t_newConfig = m_liveConfig.loadAcquire();
+        if (t_newConfig->version != t_config.version) {
+            applyConfig(t_newConfig, t_nsecNow);
+        }
+        if (!t_config.rateProfile.isEmpty()) {
+            // The Tc began at its refill time, even if the thread wakes up late
+            followRateProfile(t_nsecNextRefill);
+        }
+
+        // If we do not sent everything keep how much for the stats
+        t_statsPacketsNotSent += t_packetBucket;
+        t_nsecNextRefill += t_nsecTc;
+        t_packetsBcFraction += t_packetsBc;
+        t_packetBucket = t_packetsBcFraction;
+        t_packetsBcFraction -= t_packetBucket;
+
+        if (t_nsecNextDeparture < t_nsecNow - t_nsecTc) {
+            // We are more than one Tc late: these packets were counted as not sent,
+            // do not send them as a burst now
+            t_nsecNextDeparture = t_nsecNow;
+        }
+
+        /* Keep track of the sending counter over the loss timeout, one mark every
+         * 1/COUNTER_MARK_COUNT of it. The receiving step counts the packets before the timed out
+         * counter as lost, if they did not come back.
+         */
+        while (t_counterMarkCount > 0 && t_counterMarks[t_counterMarkFirst].nsec <= t_nsecNow - t_nsecLossTimeout) {
+            t_sharedCounterTimedOut.storeRelease(t_counterMarks[t_counterMarkFirst].counter);
+            t_counterMarkFirst = (t_counterMarkFirst + 1) % COUNTER_MARK_COUNT;
+            t_counterMarkCount--;
+        }
+        if (t_nsecNextCounterMark <= t_nsecNow && t_counterMarkCount < COUNTER_MARK_COUNT) {
+            t_counterMark = &t_counterMarks[(t_counterMarkFirst + t_counterMarkCount) % COUNTER_MARK_COUNT];
+            t_counterMark->nsec = t_nsecNow;
+            t_counterMark->counter = t_sendingCounter;
+            t_counterMarkCount++;
+            t_nsecNextCounterMark = t_nsecNow + t_nsecLossTimeout / COUNTER_MARK_COUNT;
+        }
+    }
+
+    if (t_packetBucket > 0 && (t_pacingMode == BurstPacing
+                               || t_nsecNextDeparture <= t_nsecNow + t_nsecLookahead)) {
+        // The Bucket ist not empty, send one batch of Datagrams
+        t_batchCount = qMin(t_packetBucket, t_txBatchSize);
+        if (t_pacingMode != BurstPacing) {
+            // Only send the packets whose departure time is reached (or is within the lookahead
+            // of kernel pacing). The receiving step took some time, so read the clock again.
+            t_nsecNow = monotonicNsec();
+            t_packetsDue = (t_nsecNow + t_nsecLookahead - t_nsecNextDeparture) / t_nsecInterPacket + 1;
+            t_batchCount = qMin(static_cast<qint64>(t_batchCount), t_packetsDue);
+        }
+        // Read after the refill: a new size mix (or none) may have been applied with this Tc
+        t_sizeCount = t_config.sizeSchedule.size();
+        // The backend may have less free buffers than we want to send
+        t_sendBlocked = true;
+        t_batchCount = t_backend->prepareSend(t_batchCount);
+        if (t_sizeCount > 0) {
+            // The schedule repeats, the counter of the first datagram gives its place
+            t_sizeIndex = t_sendingCounter % t_sizeCount;
+        }
+        // Each datagram gets its own sending time and counter
+        // With kernel pacing, the sending time is the departure time given to the kernel
+        for (int i = 0; i < t_batchCount; i++) {
+            t_datagramSend = t_backend->sendPayload(i);
+            if (t_txTime) {
+                t_nsecSendTime = t_nsecNextDeparture + i * t_nsecInterPacket;
+            } else {
+                t_nsecSendTime = t_nsecNow;
+            }
+            qToUnaligned<qint64>(t_nsecSendTime, t_datagramSend);
+            qToUnaligned<quint64>(t_sendingCounter + i, t_datagramSend + 8);
+            t_length = t_backendLength;
+            if (t_variableLength) {
+                if (t_sizeCount > 0) {
+                    t_length = t_config.sizeSchedule.constData()[t_sizeIndex];
+                    if (++t_sizeIndex == t_sizeCount) {
+                        t_sizeIndex = 0;
+                    }
+                } else {
+                    t_length = t_config.datagramSDULength;
+                }
+                t_backend->setSendLength(i, t_length);
+            }
+            t_payload.fill(t_datagramSend, PAYLOAD_HEADER_LENGTH, t_length);
+            if (t_crc32c && t_length >= PAYLOAD_HEADER_LENGTH + CRC32C_TRAILER_LENGTH) {
+                qToUnaligned<quint32>(Crc32c::compute(t_datagramSend, t_length - CRC32C_TRAILER_LENGTH),
+                                      t_datagramSend + t_length - CRC32C_TRAILER_LENGTH);
+            }
+        }
+
+        t_result = (t_batchCount > 0) ? t_backend->send(t_batchCount, t_nsecNextDeparture, t_nsecInterPacket) : 0;
+
+        if (t_result > 0) {
+            t_sendBlocked = (t_result < t_batchCount);
+            // t_result datagrams were sent. If the buffers got full, the remaining counters
+            // are sent again with the next batch.
+            t_sendingCounter += t_result;
+            t_packetBucket -= t_result;
+            t_statsSendCalls++;
+
+            if (t_pacingMode == SmoothPacing) {
+                t_pacingError = t_nsecNow - t_nsecNextDeparture;
+                t_statsPacingErrorSum += t_pacingError;
+                t_statsPacingErrorCount++;
+                t_statsPacingErrorMax = qMax(t_statsPacingErrorMax, t_pacingError);
+            }
+            t_nsecNextDeparture += t_result * t_nsecInterPacket;
+        } //else: Error or buffers full => try again next time
+    }
+
+    /*****************************************/
+    /* Last step: tell the thread when to run us again
+     *****************************************/
+
+    // When we refill our bucket or we have to send stats
+    t_nsecNextRun = qMin(t_nsecNextRefill, t_statNextTime);
+    t_wantsToSend = false;
+    if (t_packetBucket > 0) {
+        if (t_pacingMode == KernelPacing) {
+            // With kernel pacing, we only have to run when the next packets enter the lookahead
+            t_nsecNextRun = qMin(t_nsecNextRun, static_cast<qint64>(t_nsecNextDeparture) - t_nsecLookahead);
+        } else if (t_pacingMode == SmoothPacing) {
+            // With smooth pacing, the next departure may come first. The thread spins the last
+            // PACING_SPIN_NSEC, as its timer does not wake up precisely enough.
+            t_nsecNextRun = qMin(t_nsecNextRun, static_cast<qint64>(t_nsecNextDeparture));
+        } else if (t_sendBlocked) {
+            // With burst pacing and full buffers, we run again as soon as we can send
+            t_wantsToSend = true;
+        } else {
+            // With burst pacing, we send the next batch after the other flows of the thread had their turn
+            t_nsecNextRun = t_nsecNow;
+        }
+    }
+
+    return t_nsecNextRun;
+}
@@ -0,0 +1,426 @@
+#ifndef UDPFLOW_H
+#define UDPFLOW_H
+
+#include <QObject>
+#include <QMutex>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QList>
+#include <QPair>
+#include <QVector>
+
+#include "udpiobackend.h"
+#include "iouring.h"
+#include "udpstatsring.h"
+#include "payloadgenerator.h"
+#include "crc32c.h"
+#include "sequencewindow.h"
+
+#include <time.h>
+
+class UdpSenderThread;
+
+/* One step of a rate profile: the rate goes linearly from ppmsecStart to ppmsecEnd */
+struct UdpRateStep
+{
+    qint64 nsecDuration;
+    qreal ppmsecStart;
+    qreal ppmsecEnd;
+};
+
+/* Parameters of a flow which can change while it runs.
+ * The main thread publishes a new block for each change, the thread running the flow picks the
+ * newest block up at the beginning of its next Tc. A published block is never changed, so the
+ * thread reads it without any lock (RCU style).
+ */
+struct UdpFlowConfig
+{
+    // Increased with each block published
+    quint64 version = 0;
+    qreal ppmsec = 0;
+    uint tcUsec = 100000;
+    // Payload length of the datagrams. With a size mix, the longest length of the mix.
+    int datagramSDULength = 500;
+    // With a size mix: the payload length of each datagram, in a random order, sent over and over.
+    // Empty without a size mix.
+    QVector<quint16> sizeSchedule;
+    // Average payload length, the one of the pacing rate
+    int averageSDULength = 500;
+    quint8 tos = 0;
+    /* Rate profile: the rate follows these steps instead of ppmsec, which is the peak rate then.
+     * The profile starts again at its end with rateProfileLoop, else the last rate is kept.
+     * A new rateProfileId starts the profile from its beginning.
+     */
+    QVector<UdpRateStep> rateProfile;
+    bool rateProfileLoop = false;
+    quint64 rateProfileId = 0;
+    qint64 nsecStatsInterval = 1000000000;
+    qint64 nsecLossTimeout = 2000000000;
+};
+
+/* One flow of datagrams to the satellite: its parameters and its sending engine.
+ *
+ * A flow has no thread of its own. It is run by a UdpSenderThread, which serves many flows:
+ * the thread calls process() whenever the flow has something to do, that is when the time
+ * returned by the last process() call is reached or when its backend can receive.
+ * The receiving half of the engine (receive()) can run on a UdpReceiverThread instead, so that
+ * receiving does not delay departures and sending does not delay receive timestamps.
+ *
+ * All members prefixed with t_ are only used by the thread running the flow.
+ * All members prefixed with m_ are parameters, set by the main thread while the flow is stopped.
+ * Rate, Tc, size and TOS are also published to a running flow, see UdpFlowConfig.
+ */
+class UdpFlow : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit UdpFlow(QObject *parent = nullptr);
+    ~UdpFlow();
+
+    enum PacingMode {
+        // Send the whole Bc at the beginning of each Tc, as fast as possible
+        BurstPacing = 0,
+        // Spread the packets evenly, each packet has its own departure time
+        SmoothPacing,
+        // Like SmoothPacing, but the departure times are handed over to the kernel (SO_TXTIME)
+        KernelPacing
+    };
+
+    void setTos(quint8 tos);
+    void setDatagramSDULength(int length);
+    // Changes size and rate at once, so that a running flow keeps its bandwidth
+    void setDatagramSDULength(int length, qreal ppmsec);
+    /* Longest payload the flow may get, from the MTU. The receive buffers are sized for it when the
+     * flow starts, so that a longer size while it runs does not cut the echoes.
+     */
+    void setMaxDatagramSDULength(int length);
+    /* Size mix (IMIX): payload lengths and their weights, changed at once with the rate like
+     * setDatagramSDULength(). The size schedule is built here, so sending only reads an array.
+     * An empty mix sends datagrams of setDatagramSDULength() again.
+     */
+    void setSizeMix(const QList<QPair<uint, uint>> &mix, qreal ppmsec);
+    void setPpmsec(qreal ppmsec);
+    qreal ppmsec();
+    /* Rate profile, followed at each Tc by the thread running the flow. The rate set by setPpmsec()
+     * is then only used to spread the flows over the threads. An empty profile sends at that rate again.
+     * With restart, a running flow starts the profile from its beginning, else it keeps its place in it.
+     */
+    void setRateProfile(const QVector<UdpRateStep> &profile, bool loop, bool restart);
+    bool setPort(int port);
+    bool setDestination(QHostAddress address);
+    void setTcUsec(uint tcUsec);
+    void setTxBatchSize(int batchSize);
+    void setRxDrainBudget(int budget);
+    void setUdpGso(bool enabled);
+    void setUdpGro(bool enabled);
+    // Let the kernel (or the NIC) timestamp the datagrams (SO_TIMESTAMPING)
+    void setTimestamping(bool enabled);
+    // Ends each payload with its CRC32C, checked when the echo comes back
+    void setCrc32c(bool enabled);
+    void setPacingMode(PacingMode mode);
+    // Content of the payloads behind timestamp and counter
+    void setPayloadMode(PayloadGenerator::Mode mode);
+    void setIoBackend(UdpIoBackend::Backend backend);
+    // Interval of the stats snapshots
+    void setStatsIntervalMsec(int msec);
+    // Packets which did not come back after this time are lost
+    void setLossTimeoutMsec(int msec);
+    static QString pacingModeName(PacingMode mode);
+    static PacingMode pacingModeFromName(QString name);
+
+    // The thread which runs the flow, given by UdpSenderScheduler. It is kept when the flow stops.
+    void setSenderThread(UdpSenderThread *thread);
+    UdpSenderThread *senderThread();
+    void start();
+    void stop();
+    bool isRunning();
+    // Takes the oldest stats snapshot published by the thread. Returns false if there is none.
+    inline bool takeStatistics(UdpSenderStats &stats) { return m_statsRing.pop(stats); }
+    // Takes the oldest latency histogram published by the receiving half. Returns false if there is none.
+    inline bool takeLatencies(UdpLatencyStats &latencies) { return m_latencyRing.pop(latencies); }
+    // Takes the oldest step of the rate profile which ended. Returns false if there is none.
+    inline bool takeRateStep(UdpRateStepStats &step) { return m_rateStepRing.pop(step); }
+
+    /***** Called by the thread running the flow *****/
+    // Opens the backend. io_uring backends use ring, shared by the flows of the thread.
+    bool open(IoUring *ring);
+    void close();
+    // Does what is due at nsecNow and returns the time at which the flow wants to run again
+    qint64 process(qint64 nsecNow);
+    // Receives the echoes. Called by process(), or by a UdpReceiverThread if receiving is separate.
+    void receive(qint64 nsecNow);
+    // Set by the thread when a UdpReceiverThread receives for the flow
+    inline void setSeparateReceive(bool separate) { t_separateReceive = separate; }
+    inline bool receivesSeparately() const { return t_separateReceive; }
+    inline UdpIoBackend *backend() const { return t_backend; }
+    inline qint64 nsecNextRun() const { return t_nsecNextRun; }
+    // With burst pacing, the backend buffers are full: the flow wants to run as soon as it can send
+    inline bool wantsToSend() const { return t_wantsToSend; }
+    // With smooth pacing, the thread spins before nsecNextRun() instead of sleeping
+    inline bool needsPreciseWakeup() const { return t_pacingMode == SmoothPacing; }
+
+    // Position of the flow in the schedule of its thread, -1 if not scheduled
+    int t_scheduleIndex = -1;
+    // Events the thread watches on the file descriptor of the backend (epoll)
+    quint32 t_pollEvents = 0;
+
+    // sendmmsg() accepts at most UIO_MAXIOV (1024) messages per call
+    static constexpr int MAX_TX_BATCH_SIZE = 1024;
+    // Limits of Tc, in µsec
+    static const uint MIN_TC_USEC = 10;
+    static const uint MAX_TC_USEC = 1000000;
+    // With smooth pacing, we spin instead of sleeping when the next departure is closer than this
+    static const qint64 PACING_SPIN_NSEC = 50000;
+    // With kernel pacing, packets are given to the kernel up to this time before their departure
+    static const qint64 KERNEL_PACING_LOOKAHEAD_NSEC = 2000000;
+    // Limits of the stats interval, in msec
+    static constexpr int MIN_STATS_INTERVAL_MSEC = 10;
+    static constexpr int MAX_STATS_INTERVAL_MSEC = 10000;
+    // Stats snapshots and latency histograms kept for the main thread, powers of 2
+    static const quint32 STATS_RING_SIZE = 64;
+    static const quint32 LATENCY_RING_SIZE = 2;
+    // Steps of a rate profile kept for the main thread, a power of 2: a burst profile may end many steps per second
+    static const quint32 RATE_STEP_RING_SIZE = 256;
+    // Limits of the loss timeout, in msec
+    static constexpr int MIN_LOSS_TIMEOUT_MSEC = 10;
+    static constexpr int MAX_LOSS_TIMEOUT_MSEC = 60000;
+    // Marks of the sending counter kept over the loss timeout
+    static const int COUNTER_MARK_COUNT = 256;
+    // Minimal length of the size schedule: it repeats the weights of the mix as often as needed
+    // to reach it, so that short mixes are still sent in a random order
+    static const int SIZE_SCHEDULE_MIN_LENGTH = 4096;
+    // Timestamp and counter at the beginning of each payload
+    static const int PAYLOAD_HEADER_LENGTH = 16;
+    // CRC32C at the end of the payload, if the payload is long enough for it
+    static const int CRC32C_TRAILER_LENGTH = 4;
+
+    /* Nanoseconds from CLOCK_MONOTONIC. This clock is not changed by NTP and is read through
+     * the vDSO (TSC based on x86), so it is cheap enough to be called in the sending loop.
+     * It is used for pacing, latency and stats timing.
+     */
+    static inline qint64 monotonicNsec()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<qint64>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+signals:
+    // The backend could not apply the new parameters, the flow has to be reopened
+    void restartNeeded();
+
+private slots:
+    void restart();
+
+private:
+    // Sending counter at a given time, to time out the packets which did not come back
+    struct CounterMark
+    {
+        qint64 nsec;
+        quint64 counter;
+    };
+
+    void publishConfig();
+    void applyConfig(const UdpFlowConfig *config, qint64 nsecNow);
+    // Starts the rate profile of t_config at nsecNow
+    void startRateProfile(qint64 nsecNow);
+    // Sets the rate of the Tc beginning at nsecTcStart from the rate profile, publishes the steps which ended
+    void followRateProfile(qint64 nsecTcStart);
+    // Payload length for the backend: the longest of the mix if each datagram has its own length,
+    // else the average one
+    inline int backendLength(const UdpFlowConfig &config) const
+    {
+        return (t_variableLength || config.sizeSchedule.isEmpty()) ? config.datagramSDULength : config.averageSDULength;
+    }
+    /* Maximal pacing rate of the socket in bytes per second. fq counts the frames with their Ethernet
+     * header: UDP (8), IP (20) and Ethernet (14) headers on top of the SDU. With a rate profile,
+     * ppmsec is its peak rate.
+     */
+    static inline quint64 pacingRate(const UdpFlowConfig &config)
+    {
+        return config.ppmsec * 1000 * (config.averageSDULength + 8 + 20 + 14);
+    }
+
+    /* Parameters, only changed while the flow is stopped */
+    /* Defaults are set to avoid a random value */
+
+    // This is the Payoad of udp without header.
+    int m_datagramSDULength = 500;
+    int m_maxDatagramSDULength = 1472;
+    // Size mix: payload lengths in a random order, their longest and their average. Empty without a mix.
+    QVector<quint16> m_sizeSchedule;
+    int m_sizeMixLongest = 0;
+    int m_sizeMixAverage = 0;
+    // Packets per milisecond to send. We work with miliseconds to reduce calculation in the sending algotithm.
+    qreal m_ppmsec = 0;
+    QVector<UdpRateStep> m_rateProfile;
+    bool m_rateProfileLoop = false;
+    quint64 m_rateProfileId = 0;
+    // Destination Port
+    quint16 m_udpPort = 7;
+    // Destination Address
+    QHostAddress m_destination;
+    // Type of Service
+    quint8 m_tos = 0;
+    // tc duration, in µsec
+    uint m_tcUsec = 100000;
+    // Maximal count of datagrams sent with one sendmmsg() call
+    int m_txBatchSize = 1;
+    // Maximal count of datagrams received per loop iteration. 0 = receive until the buffer is empty
+    int m_rxDrainBudget = 0;
+    // Let the kernel segment batches into datagrams (UDP_SEGMENT)
+    bool m_udpGso = false;
+    // Let the kernel coalesce received datagrams (UDP_GRO)
+    bool m_udpGro = false;
+    // Kernel timestamps, to tell the network delay from the delay of our host
+    bool m_timestamping = false;
+    bool m_crc32c = false;
+    // How packets are spread over Tc
+    PacingMode m_pacingMode = BurstPacing;
+    PayloadGenerator::Mode m_payloadMode = PayloadGenerator::ZeroPayload;
+    // How datagrams are sent and received
+    UdpIoBackend::Backend m_ioBackend = UdpIoBackend::SocketBackend;
+    // Time between two stats snapshots
+    qint64 m_nsecStatsInterval = 1000000000;
+    qint64 m_nsecLossTimeout = 2000000000;
+
+    /* Locker when accessing Parameter */
+    QMutex m_Mutex;
+    UdpSenderThread *m_thread = NULL;
+    bool m_running = false;
+
+    // Block the thread reads, and the blocks it may still read until it acknowledges a newer one
+    QAtomicPointer<UdpFlowConfig> m_liveConfig;
+    QList<UdpFlowConfig *> m_retiredConfigs;
+    quint64 m_configVersion = 0;
+
+    // Stats snapshots, from the thread to the main thread
+    UdpStatsRing<UdpSenderStats, STATS_RING_SIZE> m_statsRing;
+    // Latencies, from the receiving half to the main thread
+    UdpStatsRing<UdpLatencyStats, LATENCY_RING_SIZE> m_latencyRing;
+    // Steps of the rate profile, from the thread to the main thread
+    UdpStatsRing<UdpRateStepStats, RATE_STEP_RING_SIZE> m_rateStepRing;
+
+    /* Sending engine, only used by the thread running the flow */
+    UdpIoBackend *t_backend = NULL;
+    // Copy of the live parameters applied
+    UdpFlowConfig t_config;
+    // The fq qdisc paces the socket (SO_MAX_PACING_RATE), its rate follows the bandwidth
+    bool t_socketPacingRate = false;
+    qint64 t_nsecNextRun = 0;
+    bool t_wantsToSend = false;
+
+    // Tc (Time Commited): Time interval in which to send the packets
+    qint64 t_nsecTc = 0;
+    // Bc (Burst Commited): Packets to send per Time interval
+    // With a small Tc, Bc is not an integer. We keep the fraction and add it to the next Bc.
+    qreal t_packetsBc = 0;
+    qreal t_packetsBcFraction = 0;
+    // keep track how much packets we have to send
+    int t_packetBucket = 0;
+    // keep track when to refill the bucket
+    qint64 t_nsecNextRefill = 0;
+
+    /* With smooth and kernel pacing, each packet has its own departure time, t_nsecInterPacket
+     * after the previous one. We keep the schedule as a qreal, so that rounding does not change the rate.
+     */
+    PacingMode t_pacingMode = BurstPacing;
+    qreal t_nsecInterPacket = 0;
+    qreal t_nsecNextDeparture = 0;
+    // With kernel pacing, packets are given to the kernel this time before their departure
+    qint64 t_nsecLookahead = 0;
+    // Departure times are passed to the kernel (SO_TXTIME)
+    bool t_txTime = false;
+    // Each datagram has its length from the size schedule, the backend accepted variableLength
+    bool t_variableLength = false;
+    // The backend was asked for variableLength, when opened with a size mix
+    bool t_variableLengthAsked = false;
+    // Payload length given to the backend
+    int t_backendLength = 0;
+    // Fills the payloads behind timestamp and counter
+    PayloadGenerator t_payload;
+
+    /* Rate profile: the step beeing sent, when it began and how often the profile started again.
+     * t_profileStep is the count of steps once a profile without loop ended.
+     */
+    int t_profileStep = 0;
+    quint64 t_profilePass = 0;
+    qint64 t_nsecStepStart = 0;
+    // Packets of the profile rate in the Tcs of the step so far, sending counter at its beginning
+    qreal t_stepPacketsTarget = 0;
+    quint64 t_stepFirstCounter = 0;
+    // The payloads end with their CRC32C. Set by open(), read by both halves.
+    bool t_crc32c = false;
+
+    int t_txBatchSize = 1;
+    // receive() is called by a UdpReceiverThread, not by process()
+    bool t_separateReceive = false;
+    int t_rxDrainBudget = 0;
+    // Datagrams asked from the backend with one receive() call
+    int t_rxBatchSize = 0;
+
+    /* We keep track of the count of packets sended in order to detect packet loss
+     * The t_sendingCounter is copied into each datagram of a batch. The returned
+     * counter is read from the received datagram.
+    */
+    quint64 t_sendingCounter = 0;
+
+    /* Sequence window of the receiving half: counts the packets received, lost, reordered,
+     * duplicated and late
+     */
+    SequenceWindow t_sequence;
+
+    // Stats
+    quint64 t_statsPacketsNotSent = 0;
+    quint64 t_statsPacketsCorrupted = 0;
+    quint64 t_statsSendCalls = 0;
+    quint64 t_statsReceiveCalls = 0;
+    quint64 t_statsPacingErrorSum = 0;
+    quint64 t_statsPacingErrorCount = 0;
+    qint64 t_statsPacingErrorMax = 0;
+    // Next report epoch, a multiple of t_nsecStatsInterval
+    qint64 t_statNextTime = 0;
+    qint64 t_nsecStatsInterval = 1000000000;
+    qint64 t_nsecStarted = 0;
+
+    /* Shared by the sending half (process()) and the receiving half (receive()), which may run
+     * on different threads. Each counter has one writer, so loads and stores are enough.
+     */
+    // Counters of the receiving half, for the stats
+    QAtomicInteger<quint64> t_sharedPacketsReceived;
+    QAtomicInteger<quint64> t_sharedPacketsLost;
+    QAtomicInteger<quint64> t_sharedReceiveCalls;
+    QAtomicInteger<quint64> t_sharedPacketsReordered;
+    QAtomicInteger<quint64> t_sharedPacketsDuplicated;
+    QAtomicInteger<quint64> t_sharedPacketsLate;
+    QAtomicInteger<quint64> t_sharedPacketsCorrupted;
+    // Packets before this counter are lost if they did not come back yet, set by the sending half
+    QAtomicInteger<quint64> t_sharedCounterTimedOut;
+    // Version of the live parameters applied, the main thread frees the older blocks
+    QAtomicInteger<quint64> t_sharedConfigVersion;
+    // Stats interval applied by the sending half, the receiving half publishes its latencies at the same epochs
+    QAtomicInteger<qint64> t_sharedStatsInterval;
+
+    // Latencies of the echoes received since the last publication, only used by the receiving half
+    UdpLatencyStats t_latencies;
+    qint64 t_latencyNextTime = 0;
+    // RFC 3550 jitter, scaled by 16 to keep the fraction of the 1/16 gain (RFC 3550 A.8)
+    qint64 t_jitterScaled = 0;
+    // Latency of the last echo received, -1 before the first one
+    qint64 t_previousLatency = -1;
+    // Counter of the packet following the last one received in sequence, and its latency, for the IPDV
+    quint64 t_ipdvNextCounter = 0;
+    qint64 t_ipdvPreviousLatency = 0;
+
+    // We consider packets that did not come back after t_nsecLossTimeout as lost.
+    // For this we keep the sending counter over the loss timeout in a circular buffer.
+    // Tc may change while the flow runs, so each counter keeps its time.
+    CounterMark t_counterMarks[COUNTER_MARK_COUNT];
+    int t_counterMarkFirst = 0;
+    int t_counterMarkCount = 0;
+    qint64 t_nsecNextCounterMark = 0;
+    qint64 t_nsecLossTimeout = 2000000000;
+};
+
+#endif // UDPFLOW_H
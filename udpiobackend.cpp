@@ -0,0 +1,516 @@
+#include "udpiobackend.h"
+#include "udpsocketbackend.h"
+#include "udpiouringbackend.h"
+#include "udpxdpbackend.h"
+#include "udppacketbackend.h"
+#include "cpuplacement.h"
+
+#include <QDebug>
+
+#include <netinet/udp.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <time.h>
+#include <stdlib.h>
+
+const int UdpIoBackend::TIMESTAMPING_CONTROL_LENGTH = CMSG_SPACE(sizeof (struct scm_timestamping));
+
+/* Turns hardware timestamping on for the NIC of interfaceName, unless it is on already (e.g. by ptp4l).
+ * This changes the NIC for all its users and needs CAP_NET_ADMIN. Returns false if the NIC can not.
+ */
+static bool enableHardwareTimestamps(int udpSocket, QString interfaceName)
+{
+    struct ifreq t_request;
+    struct hwtstamp_config t_config;
+
+    if (interfaceName.isEmpty() || interfaceName.size() >= IFNAMSIZ) {
+        return false;
+    }
+
+    memset(&t_request, 0, sizeof (t_request));
+    memset(&t_config, 0, sizeof (t_config));
+    strncpy(t_request.ifr_name, interfaceName.toLatin1().constData(), IFNAMSIZ - 1);
+    t_request.ifr_data = reinterpret_cast<char *>(&t_config);
+
+    if (ioctl(udpSocket, SIOCGHWTSTAMP, &t_request) == 0
+            && t_config.tx_type == HWTSTAMP_TX_ON && t_config.rx_filter != HWTSTAMP_FILTER_NONE) {
+        return true;
+    }
+
+    t_config.flags = 0;
+    t_config.tx_type = HWTSTAMP_TX_ON;
+    t_config.rx_filter = HWTSTAMP_FILTER_ALL;
+    if (ioctl(udpSocket, SIOCSHWTSTAMP, &t_request) < 0) {
+        return false;
+    }
+    // The driver may only timestamp some packets (e.g. PTP only), then the software timestamps are used
+    return t_config.tx_type == HWTSTAMP_TX_ON && t_config.rx_filter != HWTSTAMP_FILTER_NONE;
+}
+
+UdpIoBuffer::~UdpIoBuffer()
+{
+    release();
+}
+
+void UdpIoBuffer::allocate(size_t size)
+{
+    void *t_memory = NULL;
+
+    release();
+    if (size == 0) {
+        return;
+    }
+    if (posix_memalign(&t_memory, PAGE_ALIGNMENT, size) != 0) {
+        t_memory = NULL;
+    }
+    Q_CHECK_PTR(t_memory);
+    // Written by the thread which opens the backend, so the pages come from its NUMA node
+    memset(t_memory, 0, size);
+    m_data = static_cast<char *>(t_memory);
+    m_size = size;
+}
+
+void UdpIoBuffer::release()
+{
+    free(m_data);
+    m_data = NULL;
+    m_size = 0;
+}
+
+UdpSendBatch::UdpSendBatch(int batchSize, int datagramLength, int segmentsPerMessage, bool txTime,
+                           struct sockaddr_in *destAddress)
+    : m_payloads(static_cast<size_t>(batchSize) * datagramLength),
+      m_datagramLength(datagramLength),
+      m_segmentsPerMessage(segmentsPerMessage),
+      m_messagesPerBatch((batchSize + segmentsPerMessage - 1) / segmentsPerMessage),
+      m_lastMessage(0)
+{
+    const int t_controlLength = txTime ? CMSG_SPACE(sizeof (quint64)) : 0;
+    struct cmsghdr *t_cmsg;
+
+    m_iovecs.resize(m_messagesPerBatch);
+    m_messages.resize(m_messagesPerBatch);
+    m_control.fill(0, m_messagesPerBatch * t_controlLength);
+    m_txTimes.fill(NULL, m_messagesPerBatch);
+
+    for (int i = 0; i < m_messagesPerBatch; i++) {
+        m_iovecs[i].iov_base = m_payloads.data() + i * m_segmentsPerMessage * m_datagramLength;
+        m_iovecs[i].iov_len = m_segmentsPerMessage * m_datagramLength;
+        memset(&m_messages[i], 0, sizeof (struct mmsghdr));
+        m_messages[i].msg_hdr.msg_name = destAddress;
+        m_messages[i].msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+        m_messages[i].msg_hdr.msg_iov = &m_iovecs[i];
+        m_messages[i].msg_hdr.msg_iovlen = 1;
+        if (txTime) {
+            m_messages[i].msg_hdr.msg_control = m_control.data() + i * t_controlLength;
+            m_messages[i].msg_hdr.msg_controllen = t_controlLength;
+            t_cmsg = CMSG_FIRSTHDR(&m_messages[i].msg_hdr);
+            t_cmsg->cmsg_level = SOL_SOCKET;
+            t_cmsg->cmsg_type = SCM_TXTIME;
+            t_cmsg->cmsg_len = CMSG_LEN(sizeof (quint64));
+            // Only the departure time changes between two batches
+            m_txTimes[i] = reinterpret_cast<quint64 *>(CMSG_DATA(t_cmsg));
+        }
+    }
+}
+
+int UdpSendBatch::prepare(int count, qreal nsecFirstDeparture, qreal nsecInterPacket, const int *lengths)
+{
+    if (lengths != NULL) {
+        Q_ASSERT(m_segmentsPerMessage == 1);
+        for (int i = 0; i < count; i++) {
+            m_iovecs[i].iov_len = lengths[i];
+        }
+        if (m_txTimes[0] != NULL) {
+            for (int i = 0; i < count; i++) {
+                *m_txTimes[i] = nsecFirstDeparture + i * nsecInterPacket;
+            }
+        }
+        return count;
+    }
+
+    // Restore the length of the last message of the previous batch
+    m_iovecs[m_lastMessage].iov_len = m_segmentsPerMessage * m_datagramLength;
+
+    // The last message may carry less segments than the others
+    const int t_messageCount = (count + m_segmentsPerMessage - 1) / m_segmentsPerMessage;
+    m_lastMessage = t_messageCount - 1;
+    m_iovecs[m_lastMessage].iov_len = (count - m_lastMessage * m_segmentsPerMessage) * m_datagramLength;
+
+    if (m_txTimes[0] != NULL) {
+        // A GSO super-buffer leaves with the departure time of its first segment
+        for (int i = 0; i < t_messageCount; i++) {
+            *m_txTimes[i] = nsecFirstDeparture + i * m_segmentsPerMessage * nsecInterPacket;
+        }
+    }
+
+    return t_messageCount;
+}
+
+int UdpSendBatch::datagramsSent(int messagesSent, int count) const
+{
+    if (messagesSent * m_segmentsPerMessage >= count) {
+        return count;
+    }
+    return messagesSent * m_segmentsPerMessage;
+}
+
+UdpIoBackend::~UdpIoBackend()
+{
+}
+
+UdpIoBackend *UdpIoBackend::create(Backend backend, IoUring *ring)
+{
+    switch (backend) {
+    case SocketBackend:
+        return new UdpSocketBackend();
+    case IoUringBackend:
+        return new UdpIoUringBackend(ring);
+    case AfXdpBackend:
+        return new UdpXdpBackend();
+    case PacketMmapBackend:
+        return new UdpPacketBackend();
+    }
+
+    return new UdpSocketBackend();
+}
+
+QString UdpIoBackend::backendName(Backend backend)
+{
+    switch (backend) {
+    case SocketBackend:
+        return "socket";
+    case IoUringBackend:
+        return "io_uring";
+    case AfXdpBackend:
+        return "af_xdp";
+    case PacketMmapBackend:
+        return "packet_mmap";
+    }
+
+    return "socket";
+}
+
+/* Returns the backend from its name. Unknown names return SocketBackend */
+UdpIoBackend::Backend UdpIoBackend::backendFromName(QString name)
+{
+    name = name.trimmed().toLower();
+
+    if (name == backendName(IoUringBackend)) {
+        return IoUringBackend;
+    }
+    if (name == backendName(AfXdpBackend)) {
+        return AfXdpBackend;
+    }
+    if (name == backendName(PacketMmapBackend)) {
+        return PacketMmapBackend;
+    }
+
+    return SocketBackend;
+}
+
+void UdpIoBackend::flush()
+{
+}
+
+bool UdpIoBackend::concurrentReceive() const
+{
+    return false;
+}
+
+bool UdpIoBackend::reconfigure(const UdpIoConfig &/* config */)
+{
+    return false;
+}
+
+int UdpIoBackend::openUdpSocket(UdpIoConfig &config)
+{
+    /********************************************************************
+    * Create a Socket and bind it
+    *********************************************************************/
+    int t_udpSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (t_udpSocket < 0) {
+        qDebug() << "UdpIoBackend::openUdpSocket: could not open the socket";
+        return -1;
+    }
+
+    int t_result = setsockopt(t_udpSocket, IPPROTO_IP, IP_TOS,
+                              (char *)&config.tos, sizeof (config.tos));
+    if (t_result < 0) {
+        qDebug() << "UdpIoBackend::openUdpSocket: could not set TOS";
+        ::close(t_udpSocket);
+        return -1;
+    }
+
+    /* We do not specify from which port we send, and bind to any interface or
+     * any IP on the computer
+     * We bind in order to receive the response from the satellite (udpecho)
+     */
+    struct sockaddr_in t_myAddress;
+    memset(&t_myAddress, 0, sizeof(struct sockaddr_in));
+    t_myAddress.sin_family = AF_INET;
+    t_myAddress.sin_addr.s_addr = INADDR_ANY;
+    t_result = bind(t_udpSocket,
+                    (struct sockaddr *)&t_myAddress, sizeof (t_myAddress));
+    if (t_result < 0) {
+        qDebug() << "UdpIoBackend::openUdpSocket: could not bind the socket";
+        ::close(t_udpSocket);
+        return -1;
+    }
+
+    /* We need the socket to be non blocking, so that we can send while no
+     * packets to write and vice versa */
+    t_result = fcntl(t_udpSocket, F_SETFL, O_NONBLOCK);
+    if (t_result < 0) {
+        qDebug() << "UdpIoBackend::openUdpSocket: could not set the socket non-blocking";
+        ::close(t_udpSocket);
+        return -1;
+    }
+
+    /********************************************************************
+    * Create the address structures to reach the satellite (udpecho)
+    *********************************************************************/
+    memset(&m_destAddress, 0, sizeof(struct sockaddr_in));
+    m_destAddress.sin_family = AF_INET;
+    m_destAddress.sin_addr.s_addr=htonl(config.destination.toIPv4Address());
+    m_destAddress.sin_port=htons(config.udpPort);
+
+    /* With kernel pacing, we hand the departure times over to the qdisc (fq or etf) with SO_TXTIME.
+     * If SO_TXTIME is not supported, the fq qdisc can still pace the socket to a maximum rate.
+     */
+    if (config.txTime) {
+        struct sock_txtime t_txTimeConfig;
+        memset(&t_txTimeConfig, 0, sizeof (t_txTimeConfig));
+        // fq expects departure times from CLOCK_MONOTONIC, the same clock as the thread
+        t_txTimeConfig.clockid = CLOCK_MONOTONIC;
+        t_result = setsockopt(t_udpSocket, SOL_SOCKET, SO_TXTIME, &t_txTimeConfig, sizeof (t_txTimeConfig));
+        if (t_result < 0) {
+            config.txTime = false;
+        }
+    }
+    if (!config.txTime && config.maxPacingRate > 0) {
+        t_result = setsockopt(t_udpSocket, SOL_SOCKET, SO_MAX_PACING_RATE,
+                              &config.maxPacingRate, sizeof (config.maxPacingRate));
+        if (t_result < 0) {
+            config.maxPacingRate = 0;
+        }
+    }
+
+    /* With UDP GSO, the kernel cuts one big send into datagrams of datagramSDULength.
+     * One message (super-buffer) carries up to m_segmentsPerMessage datagrams.
+     * Without GSO, each message is one datagram.
+     */
+    m_segmentsPerMessage = 1;
+    if (config.udpGso) {
+        // The super-buffer must fit into one UDP datagram (64k) and the kernel limits the segment count
+        m_segmentsPerMessage = qMin(UDP_MAX_GSO_SEGMENTS, UDP_MAX_GSO_PAYLOAD / config.datagramSDULength);
+        int t_gsoSize = config.datagramSDULength;
+        t_result = setsockopt(t_udpSocket, SOL_UDP, UDP_SEGMENT, &t_gsoSize, sizeof (t_gsoSize));
+        if (t_result < 0 || m_segmentsPerMessage < 1) {
+            // The kernel does not support GSO, we fall back to one datagram per message
+            qDebug() << "UdpIoBackend::openUdpSocket: could not enable UDP GSO, sending without it";
+            m_segmentsPerMessage = 1;
+            config.udpGso = false;
+        }
+    }
+
+    /* With UDP GRO, the kernel coalesces echoed datagrams into buffers of up to 64k */
+    if (config.udpGro) {
+        int t_enable = 1;
+        t_result = setsockopt(t_udpSocket, SOL_UDP, UDP_GRO, &t_enable, sizeof (t_enable));
+        if (t_result < 0) {
+            // The kernel does not support GRO, we receive one datagram per buffer
+            qDebug() << "UdpIoBackend::openUdpSocket: could not enable UDP GRO, receiving without it";
+            config.udpGro = false;
+        }
+    }
+
+    /* With timestamping, the kernel (or the NIC) timestamps each datagram when it leaves and when it
+     * comes in. The send timestamps come back on the error queue, numbered by the count of datagrams
+     * sent before (OPT_ID), without the payload (OPT_TSONLY). With GSO, a whole message would get
+     * one number, so we do not timestamp then.
+     */
+    config.hardwareTimestamps = false;
+    if (config.timestamping && config.udpGso) {
+        qDebug() << "UdpIoBackend::openUdpSocket: no timestamping with UDP GSO";
+        config.timestamping = false;
+    }
+    if (config.timestamping) {
+        int t_flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE
+                | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+        if (enableHardwareTimestamps(t_udpSocket, CpuPlacement::routeInterface(config.destination))) {
+            t_flags |= SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+            config.hardwareTimestamps = true;
+        }
+        t_result = setsockopt(t_udpSocket, SOL_SOCKET, SO_TIMESTAMPING, &t_flags, sizeof (t_flags));
+        if (t_result < 0) {
+            qDebug() << "UdpIoBackend::openUdpSocket: could not enable timestamping, measuring without it";
+            config.timestamping = false;
+            config.hardwareTimestamps = false;
+        }
+    }
+    if (config.timestamping) {
+        const int t_controlLength = TIMESTAMPING_CONTROL_LENGTH
+                + CMSG_SPACE(sizeof (struct sock_extended_err) + sizeof (struct sockaddr_in));
+        m_sendTimestamps.fill(UdpIoSendTimestamp(), SEND_TIMESTAMP_SLOTS);
+        m_errorQueueControl.fill(0, ERROR_QUEUE_BATCH_SIZE * t_controlLength);
+        m_errorQueueMessages.resize(ERROR_QUEUE_BATCH_SIZE);
+        for (int i = 0; i < ERROR_QUEUE_BATCH_SIZE; i++) {
+            memset(&m_errorQueueMessages[i], 0, sizeof (struct mmsghdr));
+            m_errorQueueMessages[i].msg_hdr.msg_control = m_errorQueueControl.data() + i * t_controlLength;
+        }
+    } else {
+        m_sendTimestamps.clear();
+    }
+
+    // The segments of a GSO message all have the same length
+    if (config.variableLength && config.udpGso) {
+        qDebug() << "UdpIoBackend::openUdpSocket: no size mix with UDP GSO";
+        config.variableLength = false;
+    }
+    m_sendLengths.fill(config.datagramSDULength, config.variableLength ? config.txBatchSize : 0);
+
+    m_socketConfig = config;
+    return t_udpSocket;
+}
+
+void UdpIoBackend::readSendTimestamps(int udpSocket)
+{
+    const int t_controlLength = m_errorQueueControl.size() / ERROR_QUEUE_BATCH_SIZE;
+    struct cmsghdr *t_cmsg;
+    struct sock_extended_err t_error;
+    bool t_hasError;
+    qint64 t_nsec = 0;
+    bool t_hardware = false;
+    bool t_hasTimestamp;
+    int t_result;
+
+    do {
+        // The kernel overwrites the control length, so we have to set it before each call
+        for (int i = 0; i < ERROR_QUEUE_BATCH_SIZE; i++) {
+            m_errorQueueMessages[i].msg_hdr.msg_controllen = t_controlLength;
+        }
+        t_result = recvmmsg(udpSocket, m_errorQueueMessages.data(), ERROR_QUEUE_BATCH_SIZE, MSG_ERRQUEUE, NULL);
+
+        for (int i = 0; i < t_result; i++) {
+            t_hasError = false;
+            t_hasTimestamp = false;
+            for (t_cmsg = CMSG_FIRSTHDR(&m_errorQueueMessages[i].msg_hdr); t_cmsg != NULL;
+                 t_cmsg = CMSG_NXTHDR(&m_errorQueueMessages[i].msg_hdr, t_cmsg)) {
+                if (t_cmsg->cmsg_level == SOL_IP && t_cmsg->cmsg_type == IP_RECVERR) {
+                    memcpy(&t_error, CMSG_DATA(t_cmsg), sizeof (t_error));
+                    t_hasError = true;
+                } else if (parseTimestamping(t_cmsg, t_nsec, t_hardware)) {
+                    t_hasTimestamp = true;
+                }
+            }
+            if (t_hasError && t_hasTimestamp
+                    && t_error.ee_errno == ENOMSG && t_error.ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+                UdpIoSendTimestamp &t_timestamp = m_sendTimestamps[t_error.ee_data % SEND_TIMESTAMP_SLOTS];
+                t_timestamp.id = t_error.ee_data;
+                t_timestamp.nsec = t_nsec;
+                t_timestamp.hardware = t_hardware;
+            }
+        }
+    } while (t_result == ERROR_QUEUE_BATCH_SIZE);
+}
+
+bool UdpIoBackend::parseTimestamping(struct cmsghdr *cmsg, qint64 &nsec, bool &hardware)
+{
+    struct scm_timestamping t_timestamps;
+
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPING) {
+        return false;
+    }
+    memcpy(&t_timestamps, CMSG_DATA(cmsg), sizeof (t_timestamps));
+
+    // ts[0] is the software timestamp, ts[2] the raw hardware one. The hardware one is preferred.
+    if (t_timestamps.ts[2].tv_sec != 0 || t_timestamps.ts[2].tv_nsec != 0) {
+        nsec = static_cast<qint64>(t_timestamps.ts[2].tv_sec) * 1000000000 + t_timestamps.ts[2].tv_nsec;
+        hardware = true;
+        return true;
+    }
+    if (t_timestamps.ts[0].tv_sec != 0 || t_timestamps.ts[0].tv_nsec != 0) {
+        nsec = static_cast<qint64>(t_timestamps.ts[0].tv_sec) * 1000000000 + t_timestamps.ts[0].tv_nsec;
+        hardware = false;
+        return true;
+    }
+    return false;
+}
+
+bool UdpIoBackend::reconfigureUdpSocket(int udpSocket, const UdpIoConfig &config)
+{
+    int t_result;
+
+    if (config.tos != m_socketConfig.tos) {
+        t_result = setsockopt(udpSocket, IPPROTO_IP, IP_TOS,
+                              (char *)&config.tos, sizeof (config.tos));
+        if (t_result < 0) {
+            qDebug() << "UdpIoBackend::reconfigureUdpSocket: could not set TOS";
+            return false;
+        }
+        m_socketConfig.tos = config.tos;
+    }
+
+    // Only if the fq qdisc paces the socket instead of SO_TXTIME
+    if (m_socketConfig.maxPacingRate > 0 && !m_socketConfig.txTime && config.maxPacingRate > 0
+            && config.maxPacingRate != m_socketConfig.maxPacingRate) {
+        t_result = setsockopt(udpSocket, SOL_SOCKET, SO_MAX_PACING_RATE,
+                              &config.maxPacingRate, sizeof (config.maxPacingRate));
+        if (t_result < 0) {
+            qDebug() << "UdpIoBackend::reconfigureUdpSocket: could not set the pacing rate";
+            return false;
+        }
+        m_socketConfig.maxPacingRate = config.maxPacingRate;
+    }
+
+    if (config.datagramSDULength != m_socketConfig.datagramSDULength) {
+        if (m_socketConfig.udpGso) {
+            // The kernel cuts the super-buffers at the new length, which may fit less segments
+            const int t_segments = qMin(UDP_MAX_GSO_SEGMENTS, UDP_MAX_GSO_PAYLOAD / qMax(1, config.datagramSDULength));
+            int t_gsoSize = config.datagramSDULength;
+            if (t_segments < 1) {
+                return false;
+            }
+            t_result = setsockopt(udpSocket, SOL_UDP, UDP_SEGMENT, &t_gsoSize, sizeof (t_gsoSize));
+            if (t_result < 0) {
+                qDebug() << "UdpIoBackend::reconfigureUdpSocket: could not change the GSO size";
+                return false;
+            }
+            m_segmentsPerMessage = t_segments;
+        }
+        m_socketConfig.datagramSDULength = config.datagramSDULength;
+    }
+
+    return true;
+}
+
+void UdpIoBackend::addReceivedBuffer(const char *buffer, int length, int segmentSize,
+                                     qint64 nsecKernelTimestamp, bool hardwareTimestamp, bool truncated)
+{
+    if (segmentSize <= 0) {
+        return;
+    }
+
+    // Each segment is one echoed datagram. The last segment may be shorter.
+    for (int t_offset = 0; t_offset < length; t_offset += segmentSize) {
+        if (m_receivedCount >= m_receivedDatagrams.size()) {
+            // Cannot happen as the backends size m_receivedDatagrams for their buffers
+            return;
+        }
+        m_receivedDatagrams[m_receivedCount].payload = buffer + t_offset;
+        m_receivedDatagrams[m_receivedCount].length = qMin(segmentSize, length - t_offset);
+        // A coalesced buffer has the timestamp of its first datagram
+        m_receivedDatagrams[m_receivedCount].nsecKernelTimestamp = nsecKernelTimestamp;
+        m_receivedDatagrams[m_receivedCount].hardwareTimestamp = hardwareTimestamp;
+        m_receivedDatagrams[m_receivedCount].truncated = truncated && t_offset + segmentSize >= length;
+        m_receivedCount++;
+    }
+}
@@ -0,0 +1,269 @@
+#ifndef UDPIOBACKEND_H
+#define UDPIOBACKEND_H
+
+#include <QHostAddress>
+#include <QString>
+#include <QVector>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+class IoUring;
+
+/* Parameters of an I/O backend. The thread fills them before open().
+ * open() clears the options the kernel refused, so that the thread can fall back.
+ */
+struct UdpIoConfig
+{
+    QHostAddress destination;
+    quint16 udpPort = 7;
+    quint8 tos = 0;
+    int datagramSDULength = 500;
+    // Maximal count of datagrams sent at once
+    int txBatchSize = 1;
+    bool udpGso = false;
+    bool udpGro = false;
+    // Departure times are passed to the kernel (SO_TXTIME)
+    bool txTime = false;
+    // Maximal pacing rate of the socket in bytes per second (SO_MAX_PACING_RATE), 0 for none.
+    // With txTime, it is only used if SO_TXTIME is refused.
+    quint64 maxPacingRate = 0;
+    // Kernel timestamps of the datagrams sent and received (SO_TIMESTAMPING)
+    bool timestamping = false;
+    // Set by open(): the NIC timestamps the datagrams, else the kernel does in software
+    bool hardwareTimestamps = false;
+    // Each datagram has its own length (size mix), set with setSendLength(). datagramSDULength is the longest.
+    bool variableLength = false;
+    // Longest datagram the flow may send without reopening (MTU). The receive buffers have room for it.
+    int maxDatagramSDULength = 1472;
+};
+
+/* A received datagram. The payload is valid until the next call to receive() */
+struct UdpIoDatagram
+{
+    const char *payload;
+    int length;
+    // Kernel receive timestamp, 0 if none. Software timestamps are from CLOCK_REALTIME,
+    // hardware timestamps from the clock of the NIC.
+    qint64 nsecKernelTimestamp = 0;
+    bool hardwareTimestamp = false;
+    // The buffer was too short: the end of the datagram is missing
+    bool truncated = false;
+};
+
+/* Kernel send timestamp of a datagram, read from the error queue of the socket */
+struct UdpIoSendTimestamp
+{
+    // Count of datagrams sent on the socket before this one (SOF_TIMESTAMPING_OPT_ID)
+    quint32 id = 0;
+    qint64 nsec = 0;
+    bool hardware = false;
+};
+
+/* Zero-filled heap memory for the payloads of a backend, aligned to a page.
+ * Jumbo datagrams span many cache lines, so the buffers start on a page and the slots cut out of them
+ * with a stride of alignedLength() each start on a cache line.
+ */
+class UdpIoBuffer
+{
+public:
+    UdpIoBuffer() {}
+    explicit UdpIoBuffer(size_t size) { allocate(size); }
+    ~UdpIoBuffer();
+
+    // Replaces the memory by size zero bytes
+    void allocate(size_t size);
+    void release();
+    inline char *data() { return m_data; }
+    inline const char *constData() const { return m_data; }
+    inline size_t size() const { return m_size; }
+
+    // Length rounded up to a whole count of cache lines
+    static inline int alignedLength(int length) { return (length + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1); }
+
+    static const int CACHE_LINE_SIZE = 64;
+    static const int PAGE_ALIGNMENT = 4096;
+
+private:
+    Q_DISABLE_COPY(UdpIoBuffer)
+
+    char *m_data = NULL;
+    size_t m_size = 0;
+};
+
+/* The datagrams of one batch and their message headers, ready for sendmmsg() or sendmsg().
+ * The payloads follow each other, so that a GSO super-buffer is just a slice of the batch.
+ * Each message gets its own header, all pointing to the same destination.
+ */
+class UdpSendBatch
+{
+public:
+    UdpSendBatch(int batchSize, int datagramLength, int segmentsPerMessage, bool txTime,
+                 struct sockaddr_in *destAddress);
+
+    inline char *payload(int i) { return m_payloads.data() + i * m_datagramLength; }
+    inline struct mmsghdr *messages() { return m_messages.data(); }
+    inline int segmentsPerMessage() const { return m_segmentsPerMessage; }
+    inline int datagramLength() const { return m_datagramLength; }
+
+    /* Sets up the messages for the first count datagrams and returns the count of messages.
+     * With lengths, datagram i is lengths[i] bytes long. This needs one datagram per message (no GSO).
+     */
+    int prepare(int count, qreal nsecFirstDeparture, qreal nsecInterPacket, const int *lengths = NULL);
+    // Count of datagrams in the first messagesSent messages of a batch of count datagrams
+    int datagramsSent(int messagesSent, int count) const;
+
+private:
+    Q_DISABLE_COPY(UdpSendBatch)
+
+    UdpIoBuffer m_payloads;
+    QVector<struct iovec> m_iovecs;
+    QVector<struct mmsghdr> m_messages;
+    // With SO_TXTIME, each message carries its departure time in a SCM_TXTIME control message
+    QVector<char> m_control;
+    QVector<quint64 *> m_txTimes;
+    int m_datagramLength;
+    int m_segmentsPerMessage;
+    int m_messagesPerBatch;
+    // The last message of the previous batch may have been shortened
+    int m_lastMessage;
+};
+
+/* The way UdpFlow sends and receives its datagrams.
+ *
+ * The flow keeps pacing, counters, loss detection and stats. A backend only moves payloads:
+ * - prepareSend() reserves payloads, the flow writes timestamp and counter with sendPayload(i),
+ *   send() hands them over to the kernel.
+ * - receive() fetches echoed datagrams, the flow reads them with receivedDatagram(i).
+ * - the thread running the flow waits for pollFd() to know when something can be received (or sent).
+ *
+ * A backend is created, opened, used and closed by the thread which runs the flow.
+ */
+class UdpIoBackend
+{
+public:
+    enum Backend {
+        // UDP socket with sendmmsg() and recvmmsg()
+        SocketBackend = 0,
+        // UDP socket driven by io_uring: no system call to receive, one per loop to send and wait
+        IoUringBackend,
+        // AF_XDP socket with prebuilt Ethernet frames, bypasses the network stack
+        AfXdpBackend,
+        // AF_PACKET socket with memory mapped TX and RX rings (TPACKET_V3) and prebuilt Ethernet frames
+        PacketMmapBackend
+    };
+
+    virtual ~UdpIoBackend();
+
+    // io_uring backends use ring if given, or create their own
+    static UdpIoBackend *create(Backend backend, IoUring *ring = NULL);
+    static QString backendName(Backend backend);
+    static Backend backendFromName(QString name);
+
+    // Returns false if the backend could not be opened
+    virtual bool open(UdpIoConfig &config) = 0;
+    virtual void close() = 0;
+    /* Applies tos, datagramSDULength and maxPacingRate of config to the open backend. The socket
+     * stays, so the echoes in flight still come back. Returns false if the backend can not change
+     * them while it is open, the flow then has to be reopened.
+     */
+    virtual bool reconfigure(const UdpIoConfig &config);
+
+    // Reserves up to count payloads and returns how many are available (0 if the buffers are full)
+    virtual int prepareSend(int count) = 0;
+    inline char *sendPayload(int i) const { return m_sendPayloads[i]; }
+    // With variableLength, the length of prepared payload i
+    inline void setSendLength(int i, int length) { m_sendLengths[i] = length; }
+    // Sends the first count prepared payloads. With txTime, datagram i leaves at
+    // nsecFirstDeparture + i * nsecInterPacket. Returns the count of datagrams sent.
+    virtual int send(int count, qreal nsecFirstDeparture, qreal nsecInterPacket) = 0;
+
+    // Receives up to maxCount datagrams (more with GRO) and returns their count
+    virtual int receive(int maxCount) = 0;
+    inline const UdpIoDatagram &receivedDatagram(int i) const { return m_receivedDatagrams[i]; }
+    // True if receive() may run on another thread while prepareSend() and send() run
+    virtual bool concurrentReceive() const;
+
+    // Hands the datagrams of send() over to the kernel, if the backend defers them
+    virtual void flush();
+    // File descriptor which is readable when something can be received (writable when something
+    // can be sent), -1 if there is none (io_uring backends sharing a ring)
+    inline int pollFd() const { return m_pollFd; }
+
+    // Datagrams which were accepted by send() but failed later (asynchronous backends only)
+    inline quint64 sendErrors() const { return m_sendErrors; }
+
+    /* Kernel send timestamp of the datagram sent after count others, read by the last receive().
+     * Returns false if there is none (yet). Only with timestamping.
+     */
+    inline bool sendTimestamp(quint64 count, qint64 &nsec, bool &hardware) const
+    {
+        if (m_sendTimestamps.isEmpty()) {
+            return false;
+        }
+        const UdpIoSendTimestamp &t_timestamp = m_sendTimestamps[count % SEND_TIMESTAMP_SLOTS];
+        if (t_timestamp.nsec == 0 || t_timestamp.id != static_cast<quint32>(count)) {
+            return false;
+        }
+        nsec = t_timestamp.nsec;
+        hardware = t_timestamp.hardware;
+        return true;
+    }
+
+    // Count of preallocated payloads for recvmmsg()
+    static const int RX_BATCH_SIZE = 64;
+    // Older kernels accept at most 64 segments per GSO send (UDP_MAX_SEGMENTS)
+    static constexpr int UDP_MAX_GSO_SEGMENTS = 64;
+    // Maximal UDP payload of a GSO super-buffer
+    static const int UDP_MAX_GSO_PAYLOAD = 65507;
+    // Count of preallocated buffers for recvmmsg() with GRO. Each buffer holds a coalesced 64k datagram
+    static const int RX_GRO_BATCH_SIZE = 8;
+    static const int UDP_MAX_GRO_PAYLOAD = 65535;
+    /* Send timestamps kept until the echo comes back: 8 ms of datagrams at 1 Mpps. With more datagrams
+     * in flight, the timestamps are overwritten before their echo comes back: the flow counts these
+     * echoes as missed (UdpLatencyStats::networkMissed).
+     */
+    static const int SEND_TIMESTAMP_SLOTS = 8192;
+    // Messages read from the error queue per call
+    static const int ERROR_QUEUE_BATCH_SIZE = 64;
+
+protected:
+    // Creates, configures and binds a non-blocking UDP socket. Returns -1 on error.
+    int openUdpSocket(UdpIoConfig &config);
+    // Changes TOS, pacing rate and GSO segment size of a socket opened by openUdpSocket()
+    bool reconfigureUdpSocket(int udpSocket, const UdpIoConfig &config);
+    // Adds the datagrams of a received buffer, cut in segments of segmentSize (GRO).
+    // If the buffer was truncated, its last datagram is.
+    void addReceivedBuffer(const char *buffer, int length, int segmentSize,
+                           qint64 nsecKernelTimestamp = 0, bool hardwareTimestamp = false,
+                           bool truncated = false);
+    // Reads the send timestamps from the error queue of a socket opened with timestamping
+    void readSendTimestamps(int udpSocket);
+    // Control message space of a received datagram with timestamping
+    static const int TIMESTAMPING_CONTROL_LENGTH;
+    // Reads the timestamp of a SCM_TIMESTAMPING control message. Returns false if there is none.
+    static bool parseTimestamping(struct cmsghdr *cmsg, qint64 &nsec, bool &hardware);
+
+    // Payloads reserved by prepareSend()
+    QVector<char *> m_sendPayloads;
+    // Their lengths, set by the flow with variableLength. Empty otherwise.
+    QVector<int> m_sendLengths;
+    // Datagrams fetched by receive()
+    QVector<UdpIoDatagram> m_receivedDatagrams;
+    int m_receivedCount = 0;
+    quint64 m_sendErrors = 0;
+
+    // Set by openUdpSocket()
+    struct sockaddr_in m_destAddress;
+    // Options of the socket, as accepted by the kernel
+    UdpIoConfig m_socketConfig;
+    int m_segmentsPerMessage = 1;
+    // Send timestamps, slot = count % SEND_TIMESTAMP_SLOTS. Empty without timestamping.
+    QVector<UdpIoSendTimestamp> m_sendTimestamps;
+    QVector<char> m_errorQueueControl;
+    QVector<struct mmsghdr> m_errorQueueMessages;
+    // File descriptor returned by pollFd()
+    int m_pollFd = -1;
+};
+
+#endif // UDPIOBACKEND_H
@@ -0,0 +1,392 @@
+#include "udpiouringbackend.h"
+
+#include <QDebug>
+
+#include <netinet/udp.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+
+UdpIoUringBackend::UdpIoUringBackend(IoUring *ring)
+    : m_ring(ring),
+      m_ownRing(ring == NULL)
+{
+    if (m_ownRing) {
+        m_ring = new IoUring();
+    }
+    memset(&m_receiveMsg, 0, sizeof (m_receiveMsg));
+}
+
+UdpIoUringBackend::~UdpIoUringBackend()
+{
+    close();
+    if (m_ownRing) {
+        delete m_ring;
+    }
+}
+
+bool UdpIoUringBackend::open(UdpIoConfig &config)
+{
+    // The multishot receive and the error queue would need their own control buffers, not done yet
+    config.timestamping = false;
+    m_udpSocket = openUdpSocket(config);
+    if (m_udpSocket < 0) {
+        return false;
+    }
+
+    m_messagesPerBatch = (config.txBatchSize + m_segmentsPerMessage - 1) / m_segmentsPerMessage;
+    if (m_ownRing) {
+        // All slots may be in flight, keep some room for the receive and cancel requests
+        unsigned t_entries = 8;
+        while (t_entries < static_cast<unsigned>(m_messagesPerBatch * SEND_SLOTS + 8) && t_entries < 4096) {
+            t_entries *= 2;
+        }
+        if (!m_ring->open(t_entries)) {
+            qDebug() << "UdpIoUringBackend::open: io_uring is not available";
+            close();
+            return false;
+        }
+        m_pollFd = m_ring->fd();
+    }
+
+    m_fileIndex = m_ring->registerFile(m_udpSocket);
+
+    /* Send slots: each has its own payloads and message headers */
+    for (int i = 0; i < SEND_SLOTS; i++) {
+        m_sendBatches.append(new UdpSendBatch(config.txBatchSize, config.datagramSDULength,
+                                              m_segmentsPerMessage, config.txTime, &m_destAddress));
+    }
+    m_slotPending.fill(0, SEND_SLOTS);
+    m_sendRequests.resize(SEND_SLOTS * m_messagesPerBatch);
+    for (int i = 0; i < m_sendRequests.size(); i++) {
+        m_sendRequests[i].backend = this;
+        m_sendRequests[i].type = IoUringRequest::SendRequest;
+        m_sendRequests[i].slot = i / m_messagesPerBatch;
+        m_sendRequests[i].datagrams = 0;
+    }
+    m_sendPayloads.resize(config.txBatchSize);
+    m_nextSlot = 0;
+    m_sendsInFlight = 0;
+
+    /* Provided buffers: the kernel picks a free one for each datagram (or GRO buffer).
+     * Each buffer starts with the recvmsg header and the control message, then the payload.
+     */
+    m_udpGro = config.udpGro;
+    m_bufferCount = m_udpGro ? RX_GRO_BUFFERS : RX_BUFFERS;
+    m_receiveMsg.msg_controllen = m_udpGro ? CMSG_SPACE(sizeof (int)) : 0;
+    m_receiveHeaderLength = sizeof (struct io_uring_recvmsg_out) + m_receiveMsg.msg_controllen;
+    // Room for the longest datagram of the MTU, as the size may grow while the flow runs
+    m_receiveBufferLength = UdpIoBuffer::alignedLength(m_receiveHeaderLength
+                                                       + (m_udpGro ? UDP_MAX_GRO_PAYLOAD
+                                                                   : qMax(config.datagramSDULength, config.maxDatagramSDULength)));
+    m_receiveBuffers.allocate(static_cast<size_t>(m_bufferCount) * m_receiveBufferLength);
+    m_receivedDatagrams.resize(m_bufferCount
+                               * (m_udpGro ? (m_receiveBufferLength - m_receiveHeaderLength) / qMax(1, config.datagramSDULength) + 1 : 1));
+    m_receivedCount = 0;
+    m_returnedCount = 0;
+    m_queuedBuffers.clear();
+    m_queuedBufferEnds.clear();
+    m_returnedBuffers.clear();
+
+    m_bufferRing = m_ring->registerBufferRing(m_bufferCount, m_bufferGroup);
+    if (m_bufferRing == NULL) {
+        qDebug() << "UdpIoUringBackend::open: provided buffer rings are not supported";
+        close();
+        return false;
+    }
+    m_bufferTail = 0;
+    for (unsigned i = 0; i < m_bufferCount; i++) {
+        m_returnedBuffers.append(i);
+    }
+    recycleBuffers();
+
+    m_receiveRequest.backend = this;
+    m_receiveRequest.type = IoUringRequest::ReceiveRequest;
+    m_cancelRequest.backend = this;
+    m_cancelRequest.type = IoUringRequest::CancelRequest;
+    armReceive();
+
+    return true;
+}
+
+void UdpIoUringBackend::close()
+{
+    if (m_ring->isOpen()) {
+        if (m_receiveArmed && !m_cancelPending) {
+            struct io_uring_sqe *t_sqe = m_ring->getSqe(&m_cancelRequest);
+            if (t_sqe != NULL) {
+                t_sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                t_sqe->addr = reinterpret_cast<quint64>(&m_receiveRequest);
+                m_cancelPending = true;
+            }
+        }
+        // The kernel still references our buffers and requests until they complete
+        for (int i = 0; i < 100 && (m_receiveArmed || m_cancelPending || m_sendsInFlight > 0); i++) {
+            m_ring->submitAndWait(10000000);
+            m_ring->reap();
+        }
+
+        m_ring->unregisterBufferRing(m_bufferRing, m_bufferCount, m_bufferGroup);
+        m_ring->unregisterFile(m_fileIndex);
+    } else if (m_bufferRing != NULL) {
+        m_ring->unregisterBufferRing(m_bufferRing, m_bufferCount, m_bufferGroup);
+    }
+    m_bufferRing = NULL;
+    m_fileIndex = -1;
+    m_receiveArmed = false;
+    m_cancelPending = false;
+    m_ring->forgetBackend(this);
+
+    if (m_ownRing) {
+        m_ring->close();
+        m_pollFd = -1;
+    }
+
+    if (m_udpSocket >= 0) {
+        ::close(m_udpSocket);
+        m_udpSocket = -1;
+    }
+
+    qDeleteAll(m_sendBatches);
+    m_sendBatches.clear();
+}
+
+bool UdpIoUringBackend::reconfigure(const UdpIoConfig &config)
+{
+    if (config.datagramSDULength != m_socketConfig.datagramSDULength) {
+        // The requests of the slots in flight point to their messages, whose count changes with GSO
+        if (m_socketConfig.udpGso) {
+            return false;
+        }
+        // With GRO, a buffer of shorter datagrams holds more than m_receivedDatagrams has room for
+        if (m_udpGro && config.datagramSDULength < m_socketConfig.datagramSDULength) {
+            return false;
+        }
+        // The echoes would be cut (the MTU grew since open()): reopen with bigger provided buffers
+        if (!m_udpGro && config.datagramSDULength > m_receiveBufferLength - m_receiveHeaderLength) {
+            return false;
+        }
+    }
+
+    // The slots get the new length when they are free again, see prepareSend()
+    return reconfigureUdpSocket(m_udpSocket, config);
+}
+
+int UdpIoUringBackend::prepareSend(int count)
+{
+    if (m_slotPending[m_nextSlot] > 0) {
+        // The kernel may have completed the slot in the meantime
+        m_ring->reap();
+        if (m_slotPending[m_nextSlot] > 0) {
+            // All slots are in flight, the socket buffer is probably full
+            return 0;
+        }
+    }
+
+    UdpSendBatch *t_batch = m_sendBatches[m_nextSlot];
+    if (t_batch->datagramLength() != m_socketConfig.datagramSDULength) {
+        // reconfigure() changed the length since the slot was used
+        delete t_batch;
+        t_batch = new UdpSendBatch(m_socketConfig.txBatchSize, m_socketConfig.datagramSDULength,
+                                   m_segmentsPerMessage, m_socketConfig.txTime, &m_destAddress);
+        m_sendBatches[m_nextSlot] = t_batch;
+    }
+    count = qMin(count, m_sendPayloads.size());
+    for (int i = 0; i < count; i++) {
+        m_sendPayloads[i] = t_batch->payload(i);
+    }
+    return count;
+}
+
+int UdpIoUringBackend::send(int count, qreal nsecFirstDeparture, qreal nsecInterPacket)
+{
+    UdpSendBatch *t_batch = m_sendBatches[m_nextSlot];
+    const int t_messageCount = t_batch->prepare(count, nsecFirstDeparture, nsecInterPacket,
+                                                m_sendLengths.isEmpty() ? NULL : m_sendLengths.constData());
+    IoUringRequest *t_request;
+    struct io_uring_sqe *t_sqe;
+    int t_messagesQueued = 0;
+
+    for (int i = 0; i < t_messageCount; i++) {
+        t_request = &m_sendRequests[m_nextSlot * m_messagesPerBatch + i];
+        t_sqe = m_ring->getSqe(t_request);
+        if (t_sqe == NULL) {
+            // The submission queue is full, hand it over to the kernel and try again
+            m_ring->submitAndWait(0);
+            t_sqe = m_ring->getSqe(t_request);
+            if (t_sqe == NULL) {
+                break;
+            }
+        }
+        t_sqe->opcode = IORING_OP_SENDMSG;
+        if (m_fileIndex >= 0) {
+            t_sqe->fd = m_fileIndex;
+            t_sqe->flags = IOSQE_FIXED_FILE;
+        } else {
+            t_sqe->fd = m_udpSocket;
+        }
+        t_sqe->addr = reinterpret_cast<quint64>(&t_batch->messages()[i].msg_hdr);
+        t_sqe->len = 1;
+        t_request->datagrams = t_batch->datagramsSent(i + 1, count) - t_batch->datagramsSent(i, count);
+        t_messagesQueued++;
+    }
+
+    if (t_messagesQueued == 0) {
+        return 0;
+    }
+
+    m_slotPending[m_nextSlot] = t_messagesQueued;
+    m_sendsInFlight += t_messagesQueued;
+    m_nextSlot = (m_nextSlot + 1) % SEND_SLOTS;
+
+    return t_batch->datagramsSent(t_messagesQueued, count);
+}
+
+int UdpIoUringBackend::receive(int maxCount)
+{
+    int t_buffers = 0;
+
+    /* The datagrams returned by the last call have been processed: give the buffers they emptied
+     * back to the kernel and drop them. Other backends of the ring may have queued new datagrams since.
+     */
+    recycleBuffers();
+    if (m_returnedCount > 0) {
+        m_receivedCount -= m_returnedCount;
+        memmove(m_receivedDatagrams.data(), m_receivedDatagrams.constData() + m_returnedCount,
+                m_receivedCount * sizeof (UdpIoDatagram));
+        for (int i = 0; i < m_queuedBufferEnds.size(); i++) {
+            m_queuedBufferEnds[i] -= m_returnedCount;
+        }
+        m_returnedCount = 0;
+    }
+
+    m_ring->reap();
+    if (!m_receiveArmed) {
+        // The multishot receive stops when it runs out of buffers
+        armReceive();
+    }
+
+    // The datagrams beyond maxCount stay queued for the next call, so do their buffers
+    m_returnedCount = qMin(maxCount, m_receivedCount);
+    while (t_buffers < m_queuedBufferEnds.size() && m_queuedBufferEnds[t_buffers] <= m_returnedCount) {
+        m_returnedBuffers.append(m_queuedBuffers[t_buffers]);
+        t_buffers++;
+    }
+    m_queuedBuffers.remove(0, t_buffers);
+    m_queuedBufferEnds.remove(0, t_buffers);
+    return m_returnedCount;
+}
+
+void UdpIoUringBackend::flush()
+{
+    // A shared ring is submitted once for all its backends by the thread
+    if (m_ownRing && m_ring->pendingSubmissions() > 0) {
+        m_ring->submitAndWait(0);
+    }
+}
+
+void UdpIoUringBackend::complete(IoUringRequest *request, const io_uring_cqe *cqe)
+{
+    const char *t_buffer;
+    const struct io_uring_recvmsg_out *t_out;
+    struct msghdr t_control;
+    struct cmsghdr *t_cmsg;
+    int t_payloadLength;
+    int t_segmentSize;
+    quint16 t_bufferId;
+
+    switch (request->type) {
+    case IoUringRequest::SendRequest:
+        m_slotPending[request->slot]--;
+        m_sendsInFlight--;
+        if (cqe->res < 0) {
+            m_sendErrors += request->datagrams;
+        }
+        break;
+
+    case IoUringRequest::ReceiveRequest:
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            m_receiveArmed = false;
+        }
+        if (cqe->res < 0 || !(cqe->flags & IORING_CQE_F_BUFFER)) {
+            // ENOBUFS when all buffers are in use, the receive is armed again later
+            break;
+        }
+        t_bufferId = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        m_queuedBuffers.append(t_bufferId);
+
+        t_buffer = m_receiveBuffers.constData() + t_bufferId * m_receiveBufferLength;
+        t_out = reinterpret_cast<const struct io_uring_recvmsg_out *>(t_buffer);
+        t_payloadLength = qMin(static_cast<int>(t_out->payloadlen), cqe->res - m_receiveHeaderLength);
+
+        // Without a GRO control message, the buffer holds one datagram
+        t_segmentSize = t_payloadLength;
+        if (m_udpGro && t_out->controllen > 0) {
+            memset(&t_control, 0, sizeof (t_control));
+            t_control.msg_control = const_cast<char *>(t_buffer) + sizeof (struct io_uring_recvmsg_out);
+            t_control.msg_controllen = t_out->controllen;
+            for (t_cmsg = CMSG_FIRSTHDR(&t_control); t_cmsg != NULL; t_cmsg = CMSG_NXTHDR(&t_control, t_cmsg)) {
+                if (t_cmsg->cmsg_level == SOL_UDP && t_cmsg->cmsg_type == UDP_GRO) {
+                    memcpy(&t_segmentSize, CMSG_DATA(t_cmsg), sizeof (int));
+                    break;
+                }
+            }
+        }
+        addReceivedBuffer(t_buffer + m_receiveHeaderLength, t_payloadLength, t_segmentSize, 0, false,
+                          t_out->flags & MSG_TRUNC);
+        m_queuedBufferEnds.append(m_receivedCount);
+        break;
+
+    case IoUringRequest::CancelRequest:
+        m_cancelPending = false;
+        break;
+    }
+}
+
+void UdpIoUringBackend::armReceive()
+{
+    struct io_uring_sqe *t_sqe = m_ring->getSqe(&m_receiveRequest);
+    if (t_sqe == NULL) {
+        // Try again with the next receive()
+        return;
+    }
+
+    t_sqe->opcode = IORING_OP_RECVMSG;
+    if (m_fileIndex >= 0) {
+        t_sqe->fd = m_fileIndex;
+        t_sqe->flags = IOSQE_FIXED_FILE;
+    } else {
+        t_sqe->fd = m_udpSocket;
+    }
+    t_sqe->flags |= IOSQE_BUFFER_SELECT;
+    t_sqe->buf_group = m_bufferGroup;
+    t_sqe->addr = reinterpret_cast<quint64>(&m_receiveMsg);
+    t_sqe->len = 1;
+    t_sqe->ioprio = IORING_RECV_MULTISHOT;
+    m_receiveArmed = true;
+}
+
+void UdpIoUringBackend::recycleBuffers()
+{
+    if (m_returnedBuffers.isEmpty()) {
+        return;
+    }
+
+    /* The buffers follow each other in the ring. We do not use m_bufferRing->bufs as its flexible
+     * array is declared in a way which moves it by 8 bytes in C++.
+     */
+    struct io_uring_buf *t_bufs = reinterpret_cast<struct io_uring_buf *>(m_bufferRing);
+    const unsigned t_mask = m_bufferCount - 1;
+    struct io_uring_buf *t_buf;
+    for (int i = 0; i < m_returnedBuffers.size(); i++) {
+        t_buf = &t_bufs[(m_bufferTail + i) & t_mask];
+        t_buf->addr = reinterpret_cast<quint64>(m_receiveBuffers.data() + m_returnedBuffers[i] * m_receiveBufferLength);
+        t_buf->len = m_receiveBufferLength;
+        t_buf->bid = m_returnedBuffers[i];
+    }
+    m_bufferTail += m_returnedBuffers.size();
+    m_returnedBuffers.clear();
+
+    // The kernel reads the tail (which overlays the last field of the first buffer), publish it after the buffers
+    __atomic_store_n(&t_bufs[0].resv, static_cast<quint16>(m_bufferTail), __ATOMIC_RELEASE);
+}
@@ -0,0 +1,94 @@
+#ifndef UDPIOURINGBACKEND_H
+#define UDPIOURINGBACKEND_H
+
+#include "udpiobackend.h"
+#include "iouring.h"
+
+/* A UDP socket driven by io_uring.
+ *
+ * - Sending: each message of a batch becomes a sendmsg submission. The submissions are given to
+ *   the kernel with the next flush(), or by the thread for a shared ring.
+ *   A batch stays in its send slot until the kernel completed all its messages.
+ * - Receiving: one multishot recvmsg keeps receiving into a ring of provided buffers.
+ *   receive() only reads the completion queue, without any system call.
+ * - The socket is a registered file, so the kernel does not look it up for each operation.
+ *
+ * The ring is used by one thread only, so receive() can not run on a receiver thread.
+ * The ring can be shared by many backends (flows) of the same thread. The thread then waits for
+ * the ring instead of pollFd(), and finds the backends which got completions with
+ * IoUring::takeCompletedBackends().
+ */
+class UdpIoUringBackend : public UdpIoBackend
+{
+public:
+    // Uses ring if given, or creates its own
+    explicit UdpIoUringBackend(IoUring *ring = NULL);
+    ~UdpIoUringBackend();
+
+    bool open(UdpIoConfig &config) override;
+    void close() override;
+    bool reconfigure(const UdpIoConfig &config) override;
+
+    int prepareSend(int count) override;
+    int send(int count, qreal nsecFirstDeparture, qreal nsecInterPacket) override;
+    int receive(int maxCount) override;
+    void flush() override;
+
+    // Called by the ring for each completion of our requests
+    void complete(IoUringRequest *request, const struct io_uring_cqe *cqe);
+
+    // Batches which may be in flight at the same time
+    static const int SEND_SLOTS = 16;
+    // Provided receive buffers (a power of 2)
+    static const int RX_BUFFERS = 256;
+    static const int RX_GRO_BUFFERS = 32;
+
+private:
+    friend class IoUring;
+
+    void armReceive();
+    void recycleBuffers();
+
+    IoUring *m_ring;
+    bool m_ownRing;
+    // Listed by the ring as having got completions
+    bool m_completed = false;
+
+    int m_udpSocket = -1;
+    // Index of the socket in the registered files, -1 if not registered
+    int m_fileIndex = -1;
+
+    /* Send slots */
+    QVector<UdpSendBatch *> m_sendBatches;
+    // Messages of each slot still in flight
+    QVector<int> m_slotPending;
+    QVector<IoUringRequest> m_sendRequests;
+    int m_messagesPerBatch = 0;
+    int m_nextSlot = 0;
+    int m_sendsInFlight = 0;
+
+    /* Multishot receive into provided buffers */
+    bool m_udpGro = false;
+    struct msghdr m_receiveMsg;
+    IoUringRequest m_receiveRequest;
+    IoUringRequest m_cancelRequest;
+    bool m_receiveArmed = false;
+    bool m_cancelPending = false;
+    struct io_uring_buf_ring *m_bufferRing = NULL;
+    int m_bufferGroup = -1;
+    unsigned m_bufferCount = 0;
+    unsigned m_bufferTail = 0;
+    int m_receiveBufferLength = 0;
+    // Header, name and control in front of the payload of each buffer
+    int m_receiveHeaderLength = 0;
+    UdpIoBuffer m_receiveBuffers;
+    /* Buffers of the datagrams queued by complete(), and the count of datagrams queued up to the
+     * end of each. A buffer is recycled once receive() returned all its datagrams.
+     */
+    QVector<quint16> m_queuedBuffers;
+    QVector<int> m_queuedBufferEnds;
+    QVector<quint16> m_returnedBuffers;
+    int m_returnedCount = 0;
+};
+
+#endif // UDPIOURINGBACKEND_H
@@ -0,0 +1,311 @@
+#include "udppacketbackend.h"
+
+#include <QDebug>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/ethernet.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <linux/filter.h>
+
+UdpPacketBackend::UdpPacketBackend()
+{
+}
+
+UdpPacketBackend::~UdpPacketBackend()
+{
+    close();
+}
+
+bool UdpPacketBackend::open(UdpIoConfig &config)
+{
+    int t_result;
+    int t_value;
+
+    if (!openRaw(config)) {
+        return false;
+    }
+
+    // Protocol 0: the socket receives nothing until it is bound, after the filter is attached
+    m_packetSocket = socket(AF_PACKET, SOCK_RAW, 0);
+    if (m_packetSocket < 0) {
+        qDebug() << "UdpPacketBackend::open: could not open the AF_PACKET socket, errno" << errno;
+        close();
+        return false;
+    }
+
+    t_value = TPACKET_V3;
+    t_result = setsockopt(m_packetSocket, SOL_PACKET, PACKET_VERSION, &t_value, sizeof (t_value));
+    if (t_result < 0) {
+        qDebug() << "UdpPacketBackend::open: TPACKET_V3 is not supported";
+        close();
+        return false;
+    }
+
+    if (!attachFilter()) {
+        close();
+        return false;
+    }
+
+    /* A frame the kernel refuses is skipped instead of blocking the TX ring.
+     * The frames go directly to the driver, without the qdisc (if the kernel can).
+     */
+    t_value = 1;
+    setsockopt(m_packetSocket, SOL_PACKET, PACKET_LOSS, &t_value, sizeof (t_value));
+    setsockopt(m_packetSocket, SOL_PACKET, PACKET_QDISC_BYPASS, &t_value, sizeof (t_value));
+#ifdef PACKET_IGNORE_OUTGOING
+    // Our own frames are dropped by the filter anyway, this spares the work
+    setsockopt(m_packetSocket, SOL_PACKET, PACKET_IGNORE_OUTGOING, &t_value, sizeof (t_value));
+#endif
+
+    /* TX ring: frames of the same size, with the Ethernet frame behind the TPACKET_V3 header.
+     * They have room for a full Ethernet frame, so that the datagram length can change while the flow runs.
+     */
+    m_txDataOffset = TPACKET3_HDRLEN - sizeof (struct sockaddr_ll);
+    m_txFrameSize = TPACKET_ALIGN(m_txDataOffset + qMax(m_frameLength, ETH_FRAME_LEN));
+    if (m_txFrameSize > PACKET_TX_BLOCK_SIZE) {
+        qDebug() << "UdpPacketBackend::open: datagrams of" << m_datagramSDULength << "bytes are too big";
+        close();
+        return false;
+    }
+    m_txFramesPerBlock = PACKET_TX_BLOCK_SIZE / m_txFrameSize;
+    const int t_txBlockCount = (PACKET_TX_FRAMES + m_txFramesPerBlock - 1) / m_txFramesPerBlock;
+    m_txFrameCount = t_txBlockCount * m_txFramesPerBlock;
+
+    struct tpacket_req3 t_request;
+    memset(&t_request, 0, sizeof (t_request));
+    t_request.tp_block_size = PACKET_TX_BLOCK_SIZE;
+    t_request.tp_block_nr = t_txBlockCount;
+    t_request.tp_frame_size = m_txFrameSize;
+    t_request.tp_frame_nr = m_txFrameCount;
+    t_result = setsockopt(m_packetSocket, SOL_PACKET, PACKET_TX_RING, &t_request, sizeof (t_request));
+    if (t_result < 0) {
+        qDebug() << "UdpPacketBackend::open: could not create the TX ring, errno" << errno;
+        close();
+        return false;
+    }
+
+    /* RX ring: the frame size only matters for the checks of the kernel with TPACKET_V3 */
+    const int t_rxFrameSize = TPACKET_ALIGNMENT << 7;
+    memset(&t_request, 0, sizeof (t_request));
+    t_request.tp_block_size = PACKET_RX_BLOCK_SIZE;
+    t_request.tp_block_nr = PACKET_RX_BLOCKS;
+    t_request.tp_frame_size = t_rxFrameSize;
+    t_request.tp_frame_nr = PACKET_RX_BLOCKS * (PACKET_RX_BLOCK_SIZE / t_rxFrameSize);
+    t_request.tp_retire_blk_tov = PACKET_RX_BLOCK_TIMEOUT;
+    t_result = setsockopt(m_packetSocket, SOL_PACKET, PACKET_RX_RING, &t_request, sizeof (t_request));
+    if (t_result < 0) {
+        qDebug() << "UdpPacketBackend::open: could not create the RX ring, errno" << errno;
+        close();
+        return false;
+    }
+
+    /* Both rings are mapped at once, the RX ring comes first */
+    const size_t t_rxRingSize = static_cast<size_t>(PACKET_RX_BLOCKS) * PACKET_RX_BLOCK_SIZE;
+    m_ringSize = t_rxRingSize + static_cast<size_t>(t_txBlockCount) * PACKET_TX_BLOCK_SIZE;
+    void *t_map = mmap(NULL, m_ringSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_packetSocket, 0);
+    if (t_map == MAP_FAILED) {
+        qDebug() << "UdpPacketBackend::open: could not map the rings, errno" << errno;
+        close();
+        return false;
+    }
+    m_ring = static_cast<char *>(t_map);
+    m_rxRing = m_ring;
+    m_txRing = m_ring + t_rxRingSize;
+
+    /* Build the sending frames once. The kernel hands over the ring with all frames available. */
+    m_maxFrameLength = m_txFrameSize - m_txDataOffset;
+    m_headerGeneration = 0;
+    m_frameGenerations.fill(0, m_txFrameCount);
+    for (int i = 0; i < m_txFrameCount; i++) {
+        struct tpacket3_hdr *t_header = txFrame(i);
+        t_header->tp_next_offset = 0;
+        t_header->tp_len = m_frameLength;
+        buildFrameHeader(reinterpret_cast<char *>(t_header) + m_txDataOffset);
+    }
+    m_txHead = 0;
+    m_sendPayloads.resize(config.txBatchSize);
+
+    m_rxBlock = 0;
+    m_rxPacket = NULL;
+    m_rxPacketsLeft = 0;
+    m_rxReleasedBlock = 0;
+    m_receivedDatagrams.resize(RX_BATCH_SIZE);
+    m_receivedCount = 0;
+
+    /* Bind to the interface: sending uses it, and from now on the IPv4 frames pass the filter */
+    struct sockaddr_ll t_address;
+    memset(&t_address, 0, sizeof (t_address));
+    t_address.sll_family = AF_PACKET;
+    t_address.sll_protocol = htons(ETH_P_IP);
+    t_address.sll_ifindex = m_interfaceIndex;
+    t_result = bind(m_packetSocket, (struct sockaddr *)&t_address, sizeof (t_address));
+    if (t_result < 0) {
+        qDebug() << "UdpPacketBackend::open: could not bind to" << m_interfaceName << "errno" << errno;
+        close();
+        return false;
+    }
+    m_pollFd = m_packetSocket;
+
+    return true;
+}
+
+void UdpPacketBackend::close()
+{
+    if (m_ring != NULL) {
+        munmap(m_ring, m_ringSize);
+        m_ring = NULL;
+        m_rxRing = NULL;
+        m_txRing = NULL;
+        m_rxPacket = NULL;
+    }
+    if (m_packetSocket >= 0) {
+        ::close(m_packetSocket);
+        m_packetSocket = -1;
+        m_pollFd = -1;
+    }
+
+    closeRaw();
+}
+
+int UdpPacketBackend::prepareSend(int count)
+{
+    struct tpacket3_hdr *t_header;
+    int t_frame;
+    int i;
+
+    /* The next frames of the ring, as long as the kernel is done with them.
+     * Once sent, the kernel sets them back to TP_STATUS_AVAILABLE, maybe with timestamp flags.
+     */
+    count = qMin(count, m_sendPayloads.size());
+    for (i = 0; i < count; i++) {
+        t_frame = (m_txHead + i) % m_txFrameCount;
+        t_header = txFrame(t_frame);
+        if (__atomic_load_n(&t_header->tp_status, __ATOMIC_ACQUIRE) & (TP_STATUS_SEND_REQUEST|TP_STATUS_SENDING)) {
+            break;
+        }
+        // The thread only writes the payload, the headers are already there unless reconfigure() changed them
+        t_header->tp_len = m_frameLength;
+        refreshFrameHeader(reinterpret_cast<char *>(t_header) + m_txDataOffset, t_frame);
+        m_sendPayloads[i] = reinterpret_cast<char *>(t_header) + m_txDataOffset + FRAME_HEADER_LENGTH;
+    }
+
+    return i;
+}
+
+int UdpPacketBackend::send(int count, qreal /* nsecFirstDeparture */, qreal /* nsecInterPacket */)
+{
+    for (int i = 0; i < count; i++) {
+        __atomic_store_n(&txFrame(m_txHead)->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+        m_txHead = (m_txHead + 1) % m_txFrameCount;
+    }
+
+    /* One system call for the whole batch. If the driver is busy, the frames which are left
+     * keep their request and leave with the next send(). Other errors (e.g. the interface went
+     * down) keep them as well: the ring fills up and the packets are counted as not sent.
+     * Each error is reported once, not for each batch.
+     */
+    if (::send(m_packetSocket, NULL, 0, MSG_DONTWAIT) < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS && errno != m_sendErrno) {
+            qDebug() << "UdpPacketBackend::send: could not send the TX ring, errno" << errno;
+            m_sendErrno = errno;
+        }
+    } else {
+        m_sendErrno = 0;
+    }
+
+    return count;
+}
+
+int UdpPacketBackend::receive(int maxCount)
+{
+    struct tpacket_block_desc *t_block;
+    const struct tpacket3_hdr *t_header;
+    const char *t_payload;
+    int t_payloadLength;
+    bool t_truncated;
+    int t_blocksRead = 0;
+
+    /* The blocks read completely by the last call have been processed, give them back to the kernel */
+    while (m_rxReleasedBlock != m_rxBlock) {
+        __atomic_store_n(&rxBlock(m_rxReleasedBlock)->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        m_rxReleasedBlock = (m_rxReleasedBlock + 1) % PACKET_RX_BLOCKS;
+    }
+
+    m_receivedCount = 0;
+    maxCount = qMin(maxCount, m_receivedDatagrams.size());
+    while (m_receivedCount < maxCount) {
+        t_block = rxBlock(m_rxBlock);
+        if (m_rxPacket == NULL) {
+            if (!(__atomic_load_n(&t_block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+                // The kernel is still filling this block
+                break;
+            }
+            m_rxPacket = reinterpret_cast<char *>(t_block) + t_block->hdr.bh1.offset_to_first_pkt;
+            m_rxPacketsLeft = t_block->hdr.bh1.num_pkts;
+        }
+
+        while (m_rxPacketsLeft > 0 && m_receivedCount < maxCount) {
+            t_header = reinterpret_cast<const struct tpacket3_hdr *>(m_rxPacket);
+            t_payload = echoPayload(m_rxPacket + t_header->tp_mac, t_header->tp_snaplen, t_payloadLength, t_truncated);
+            if (t_payload != NULL) {
+                m_receivedDatagrams[m_receivedCount].payload = t_payload;
+                m_receivedDatagrams[m_receivedCount].length = t_payloadLength;
+                m_receivedDatagrams[m_receivedCount].truncated = t_truncated;
+                m_receivedCount++;
+            }
+            m_rxPacket += t_header->tp_next_offset;
+            m_rxPacketsLeft--;
+        }
+        if (m_rxPacketsLeft > 0) {
+            // maxCount reached, we go on in this block with the next call
+            break;
+        }
+
+        // The block is read. It is released with the next call, as our datagrams point into it.
+        t_blocksRead++;
+        if (t_blocksRead == PACKET_RX_BLOCKS - 1) {
+            // Keep at least one block to tell released and unreleased blocks apart
+            break;
+        }
+        m_rxBlock = (m_rxBlock + 1) % PACKET_RX_BLOCKS;
+        m_rxPacket = NULL;
+    }
+
+    return m_receivedCount;
+}
+
+/* Classic BPF filter on the socket, so that only our echoes are copied into the RX ring:
+ *   IPv4, UDP, not a fragment, from the satellite, to our port
+ * Classic BPF loads in network byte order, so the constants are in host byte order.
+ */
+bool UdpPacketBackend::attachFilter()
+{
+    struct sock_filter t_filter[] = {
+        BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 12),                                 // EtherType
+        BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, ETHERTYPE_IP, 0, 10),
+        BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 23),                                 // IP protocol
+        BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, IPPROTO_UDP, 0, 8),
+        BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 26),                                 // IP source
+        BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, ntohl(m_destinationIp), 0, 6),
+        BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 20),                                 // Fragment offset
+        BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x1fff, 4, 0),
+        BPF_STMT(BPF_LDX|BPF_B|BPF_MSH, 14),                                // X = IP header length
+        BPF_STMT(BPF_LD|BPF_H|BPF_IND, 14 + 2),                             // UDP destination port
+        BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, ntohs(m_sourcePort), 0, 1),
+        BPF_STMT(BPF_RET|BPF_K, 0x40000),                                   // accept the whole frame
+        BPF_STMT(BPF_RET|BPF_K, 0)                                          // drop
+    };
+    struct sock_fprog t_program;
+    t_program.len = sizeof (t_filter) / sizeof (struct sock_filter);
+    t_program.filter = t_filter;
+
+    if (setsockopt(m_packetSocket, SOL_SOCKET, SO_ATTACH_FILTER, &t_program, sizeof (t_program)) < 0) {
+        qDebug() << "UdpPacketBackend::attachFilter: could not attach the filter, errno" << errno;
+        return false;
+    }
+
+    return true;
+}
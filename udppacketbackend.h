@@ -0,0 +1,77 @@
+#ifndef UDPPACKETBACKEND_H
+#define UDPPACKETBACKEND_H
+
+#include "udprawbackend.h"
+
+#include <linux/if_packet.h>
+
+/* An AF_PACKET socket with memory mapped rings (PACKET_MMAP, TPACKET_V3).
+ *
+ * - TX ring: each frame is built once with its Ethernet, IPv4 and UDP headers, later only the
+ *   payload is rewritten. A batch is marked ready and flushed with a single send().
+ * - RX ring: the kernel fills blocks of frames and hands a whole block over at once, when it
+ *   is full or after PACKET_RX_BLOCK_TIMEOUT ms. A classic BPF filter on the socket only lets
+ *   our echoes in.
+ *
+ * Unlike AF_XDP, it works with any driver and any frame size, but the kernel still copies
+ * each frame. The echoes also go on to the network stack.
+ * At low packet rates, the block timeout adds up to PACKET_RX_BLOCK_TIMEOUT ms to the latency.
+ */
+class UdpPacketBackend : public UdpRawBackend
+{
+public:
+    UdpPacketBackend();
+    ~UdpPacketBackend();
+
+    bool open(UdpIoConfig &config) override;
+    void close() override;
+
+    int prepareSend(int count) override;
+    int send(int count, qreal nsecFirstDeparture, qreal nsecInterPacket) override;
+    int receive(int maxCount) override;
+
+    // Minimal count of frames in the TX ring
+    static const int PACKET_TX_FRAMES = 2048;
+    static const int PACKET_TX_BLOCK_SIZE = 1 << 16;
+    static const int PACKET_RX_BLOCKS = 64;
+    static const int PACKET_RX_BLOCK_SIZE = 1 << 16;
+    // In milliseconds
+    static const int PACKET_RX_BLOCK_TIMEOUT = 1;
+
+private:
+    bool attachFilter();
+    inline struct tpacket3_hdr *txFrame(int i) const {
+        return reinterpret_cast<struct tpacket3_hdr *>(m_txRing + (i / m_txFramesPerBlock) * PACKET_TX_BLOCK_SIZE
+                                                       + (i % m_txFramesPerBlock) * m_txFrameSize);
+    }
+    inline struct tpacket_block_desc *rxBlock(int i) const {
+        return reinterpret_cast<struct tpacket_block_desc *>(m_rxRing + i * PACKET_RX_BLOCK_SIZE);
+    }
+
+    int m_packetSocket = -1;
+    char *m_ring = NULL;
+    size_t m_ringSize = 0;
+
+    // The TX ring follows the RX ring in the mapping
+    char *m_txRing = NULL;
+    int m_txFrameSize = 0;
+    int m_txFramesPerBlock = 0;
+    int m_txFrameCount = 0;
+    // The Ethernet frame starts at this offset of a TX ring frame
+    int m_txDataOffset = 0;
+    // Next frame to send. The kernel sends the frames in the same order.
+    int m_txHead = 0;
+    // Last error of the TX ring send, reported once
+    int m_sendErrno = 0;
+
+    char *m_rxRing = NULL;
+    // Block we are reading
+    int m_rxBlock = 0;
+    // Next packet of m_rxBlock and count of packets left, m_rxPacket is NULL until the block is ready
+    char *m_rxPacket = NULL;
+    int m_rxPacketsLeft = 0;
+    // First block not given back to the kernel yet
+    int m_rxReleasedBlock = 0;
+};
+
+#endif // UDPPACKETBACKEND_H
@@ -0,0 +1,271 @@
+#include "udprawbackend.h"
+
+#include <QDebug>
+
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <net/route.h>
+#include <ifaddrs.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+bool UdpRawBackend::openRaw(UdpIoConfig &config)
+{
+    struct sockaddr_in t_address;
+    socklen_t t_addressLength = sizeof (t_address);
+    int t_result;
+
+    m_datagramSDULength = config.datagramSDULength;
+    m_frameLength = FRAME_HEADER_LENGTH + m_datagramSDULength;
+    m_destinationIp = htonl(config.destination.toIPv4Address());
+    m_destinationPort = htons(config.udpPort);
+    m_tos = config.tos;
+
+    // We build the frames ourselves: no segmentation or departure time offload from the UDP stack
+    config.udpGso = false;
+    config.udpGro = false;
+    config.txTime = false;
+    config.maxPacingRate = 0;
+    // The frames bypass the UDP socket, which would timestamp them
+    config.timestamping = false;
+    config.hardwareTimestamps = false;
+    // The IP and UDP headers of the prebuilt frames carry one length
+    config.variableLength = false;
+
+    /* Reserve an UDP port. Connecting the socket also lets the kernel choose our source address */
+    m_portSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_portSocket < 0) {
+        qDebug() << "UdpRawBackend::openRaw: could not open the socket";
+        return false;
+    }
+    memset(&t_address, 0, sizeof (t_address));
+    t_address.sin_family = AF_INET;
+    t_address.sin_addr.s_addr = m_destinationIp;
+    t_address.sin_port = m_destinationPort;
+    t_result = connect(m_portSocket, (struct sockaddr *)&t_address, sizeof (t_address));
+    if (t_result < 0) {
+        qDebug() << "UdpRawBackend::openRaw: no route to the satellite";
+        closeRaw();
+        return false;
+    }
+    getsockname(m_portSocket, (struct sockaddr *)&t_address, &t_addressLength);
+    m_sourceIp = t_address.sin_addr.s_addr;
+    m_sourcePort = t_address.sin_port;
+
+    /* Find the interface which owns our source address */
+    struct ifaddrs *t_interfaces;
+    struct ifaddrs *t_interface;
+    bool t_loopback = false;
+    if (getifaddrs(&t_interfaces) < 0) {
+        closeRaw();
+        return false;
+    }
+    for (t_interface = t_interfaces; t_interface != NULL; t_interface = t_interface->ifa_next) {
+        if (t_interface->ifa_addr != NULL && t_interface->ifa_addr->sa_family == AF_INET
+                && reinterpret_cast<struct sockaddr_in *>(t_interface->ifa_addr)->sin_addr.s_addr == m_sourceIp) {
+            m_interfaceName = t_interface->ifa_name;
+            t_loopback = t_interface->ifa_flags & IFF_LOOPBACK;
+            break;
+        }
+    }
+    freeifaddrs(t_interfaces);
+    if (m_interfaceName.isEmpty() || t_loopback) {
+        qDebug() << "UdpRawBackend::openRaw: the satellite must be reached through an Ethernet interface";
+        closeRaw();
+        return false;
+    }
+    m_interfaceIndex = if_nametoindex(m_interfaceName.toLatin1().constData());
+
+    struct ifreq t_request;
+    memset(&t_request, 0, sizeof (t_request));
+    strncpy(t_request.ifr_name, m_interfaceName.toLatin1().constData(), IFNAMSIZ - 1);
+    if (ioctl(m_portSocket, SIOCGIFHWADDR, &t_request) < 0 || t_request.ifr_hwaddr.sa_family != ARPHRD_ETHER) {
+        qDebug() << "UdpRawBackend::openRaw: " << m_interfaceName << "is not an Ethernet interface";
+        closeRaw();
+        return false;
+    }
+    memcpy(m_sourceMac, t_request.ifr_hwaddr.sa_data, 6);
+
+    /* The next hop is the gateway of the most specific route, or the satellite itself.
+     * /proc/net/route prints the addresses as they are in memory (network byte order).
+     */
+    quint32 t_nextHop = m_destinationIp;
+    FILE *t_file = fopen("/proc/net/route", "r");
+    if (t_file != NULL) {
+        char t_line[256];
+        char t_name[IFNAMSIZ + 1];
+        unsigned int t_destination, t_gateway, t_flags, t_refCount, t_use, t_metric, t_mask;
+        int t_bestMaskLength = -1;
+        while (fgets(t_line, sizeof (t_line), t_file) != NULL) {
+            if (sscanf(t_line, "%16s %x %x %x %u %u %u %x", t_name, &t_destination, &t_gateway, &t_flags,
+                       &t_refCount, &t_use, &t_metric, &t_mask) != 8) {
+                // Header line
+                continue;
+            }
+            if (m_interfaceName != t_name || (m_destinationIp & t_mask) != t_destination
+                    || __builtin_popcount(t_mask) <= t_bestMaskLength) {
+                continue;
+            }
+            t_bestMaskLength = __builtin_popcount(t_mask);
+            t_nextHop = (t_flags & RTF_GATEWAY) ? t_gateway : m_destinationIp;
+        }
+        fclose(t_file);
+    }
+
+    if (!resolveNextHop(t_nextHop, m_portSocket)) {
+        qDebug() << "UdpRawBackend::openRaw: could not resolve the MAC address of the next hop";
+        closeRaw();
+        return false;
+    }
+
+    return true;
+}
+
+void UdpRawBackend::closeRaw()
+{
+    if (m_portSocket >= 0) {
+        ::close(m_portSocket);
+        m_portSocket = -1;
+    }
+    m_interfaceName.clear();
+}
+
+/* Looks up the MAC address of nextHop in the neighbour table (/proc/net/arp).
+ * If it is not known yet, a datagram through the normal socket makes the kernel resolve it.
+ */
+bool UdpRawBackend::resolveNextHop(quint32 nextHop, int probeSocket)
+{
+    char t_line[256];
+    char t_ip[64], t_mac[64], t_mask[64], t_device[64];
+    unsigned int t_hwType, t_flags;
+    unsigned int t_bytes[6];
+    struct in_addr t_address;
+
+    for (int t_try = 0; t_try < 20; t_try++) {
+        FILE *t_file = fopen("/proc/net/arp", "r");
+        if (t_file == NULL) {
+            return false;
+        }
+        while (fgets(t_line, sizeof (t_line), t_file) != NULL) {
+            if (sscanf(t_line, "%63s %x %x %63s %63s %63s", t_ip, &t_hwType, &t_flags, t_mac, t_mask, t_device) != 6) {
+                continue;
+            }
+            if (inet_aton(t_ip, &t_address) == 0 || t_address.s_addr != nextHop
+                    || m_interfaceName != t_device || !(t_flags & ATF_COM)) {
+                continue;
+            }
+            if (sscanf(t_mac, "%x:%x:%x:%x:%x:%x", &t_bytes[0], &t_bytes[1], &t_bytes[2],
+                       &t_bytes[3], &t_bytes[4], &t_bytes[5]) == 6) {
+                for (int i = 0; i < 6; i++) {
+                    m_nextHopMac[i] = t_bytes[i];
+                }
+                fclose(t_file);
+                return true;
+            }
+        }
+        fclose(t_file);
+
+        // Not resolved yet: an empty datagram starts the ARP resolution
+        ::send(probeSocket, NULL, 0, MSG_DONTWAIT);
+        usleep(100000);
+    }
+
+    return false;
+}
+
+bool UdpRawBackend::reconfigure(const UdpIoConfig &config)
+{
+    if (FRAME_HEADER_LENGTH + config.datagramSDULength > m_maxFrameLength) {
+        return false;
+    }
+    if (config.tos == m_tos && config.datagramSDULength == m_datagramSDULength) {
+        return true;
+    }
+
+    m_tos = config.tos;
+    m_datagramSDULength = config.datagramSDULength;
+    m_frameLength = FRAME_HEADER_LENGTH + m_datagramSDULength;
+    m_headerGeneration++;
+
+    return true;
+}
+
+void UdpRawBackend::buildFrameHeader(char *frame) const
+{
+    quint8 *t_frame = reinterpret_cast<quint8 *>(frame);
+    const quint16 t_ipLength = 20 + 8 + m_datagramSDULength;
+    const quint16 t_udpLength = 8 + m_datagramSDULength;
+    quint32 t_checksum = 0;
+
+    /* Ethernet */
+    memcpy(t_frame, m_nextHopMac, 6);
+    memcpy(t_frame + 6, m_sourceMac, 6);
+    t_frame[12] = 0x08;
+    t_frame[13] = 0x00;
+
+    /* IPv4, no options, don't fragment. The identification is not needed with DF. */
+    quint8 *t_ip = t_frame + 14;
+    t_ip[0] = 0x45;
+    t_ip[1] = m_tos;
+    t_ip[2] = t_ipLength >> 8;
+    t_ip[3] = t_ipLength & 0xff;
+    t_ip[4] = 0;
+    t_ip[5] = 0;
+    t_ip[6] = 0x40;
+    t_ip[7] = 0;
+    t_ip[8] = 64;
+    t_ip[9] = IPPROTO_UDP;
+    t_ip[10] = 0;
+    t_ip[11] = 0;
+    memcpy(t_ip + 12, &m_sourceIp, 4);
+    memcpy(t_ip + 16, &m_destinationIp, 4);
+    for (int i = 0; i < 20; i += 2) {
+        t_checksum += (t_ip[i] << 8) | t_ip[i + 1];
+    }
+    while (t_checksum >> 16) {
+        t_checksum = (t_checksum & 0xffff) + (t_checksum >> 16);
+    }
+    t_checksum = ~t_checksum & 0xffff;
+    t_ip[10] = t_checksum >> 8;
+    t_ip[11] = t_checksum & 0xff;
+
+    /* UDP. A checksum of 0 means "no checksum" with IPv4, so the payload can change freely */
+    quint8 *t_udp = t_ip + 20;
+    memcpy(t_udp, &m_sourcePort, 2);
+    memcpy(t_udp + 2, &m_destinationPort, 2);
+    t_udp[4] = t_udpLength >> 8;
+    t_udp[5] = t_udpLength & 0xff;
+    t_udp[6] = 0;
+    t_udp[7] = 0;
+}
+
+const char *UdpRawBackend::echoPayload(const char *frame, int frameLength, int &payloadLength, bool &truncated) const
+{
+    const quint8 *t_frame = reinterpret_cast<const quint8 *>(frame);
+
+    if (frameLength < FRAME_HEADER_LENGTH || t_frame[12] != 0x08 || t_frame[13] != 0x00) {
+        return NULL;
+    }
+
+    const quint8 *t_ip = t_frame + 14;
+    const int t_ipHeaderLength = (t_ip[0] & 0x0f) * 4;
+    if ((t_ip[0] >> 4) != 4 || t_ip[9] != IPPROTO_UDP || t_ipHeaderLength < 20
+            || frameLength < 14 + t_ipHeaderLength + 8
+            || memcmp(t_ip + 12, &m_destinationIp, 4) != 0) {
+        return NULL;
+    }
+
+    // The satellite swaps the ports
+    const quint8 *t_udp = t_ip + t_ipHeaderLength;
+    if (memcmp(t_udp, &m_destinationPort, 2) != 0 || memcmp(t_udp + 2, &m_sourcePort, 2) != 0) {
+        return NULL;
+    }
+
+    const int t_udpPayloadLength = ((t_udp[4] << 8) | t_udp[5]) - 8;
+    payloadLength = qMin(t_udpPayloadLength, frameLength - 14 - t_ipHeaderLength - 8);
+    truncated = (payloadLength < t_udpPayloadLength);
+    return reinterpret_cast<const char *>(t_udp + 8);
+}
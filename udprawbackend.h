@@ -0,0 +1,73 @@
+#ifndef UDPRAWBACKEND_H
+#define UDPRAWBACKEND_H
+
+#include "udpiobackend.h"
+
+#include <QString>
+
+/* Common part of the backends which send whole Ethernet frames (AF_XDP, AF_PACKET).
+ *
+ * open() finds the interface, our IP and MAC and the MAC of the next hop from the kernel
+ * routing and neighbour tables, and reserves our UDP port with a normal socket, so that the
+ * kernel does not answer our echoes with ICMP port unreachable.
+ * The Ethernet, IPv4 and UDP headers are the same for each datagram, so they are built once.
+ * Only the payload (timestamp and counter) changes.
+ *
+ * These backends need CAP_NET_RAW (and CAP_NET_ADMIN and CAP_BPF for AF_XDP).
+ */
+class UdpRawBackend : public UdpIoBackend
+{
+public:
+    // Ethernet (14) + IPv4 without options (20) + UDP (8)
+    static const int FRAME_HEADER_LENGTH = 42;
+
+    // Sending and receiving use their own rings and frames
+    inline bool concurrentReceive() const override { return true; }
+    // The frames get their new headers when they are sent next
+    bool reconfigure(const UdpIoConfig &config) override;
+
+protected:
+    // Resolves the addresses and reserves the port. Returns false on error.
+    bool openRaw(UdpIoConfig &config);
+    void closeRaw();
+
+    // Writes the headers of a datagram of m_datagramSDULength bytes at the beginning of frame
+    void buildFrameHeader(char *frame) const;
+    // Rewrites the headers of sending frame number i if they were built before the last reconfigure()
+    inline void refreshFrameHeader(char *frame, int i) {
+        if (m_frameGenerations[i] != m_headerGeneration) {
+            buildFrameHeader(frame);
+            m_frameGenerations[i] = m_headerGeneration;
+        }
+    }
+    // Returns the UDP payload of frame if it is one of our echoes, NULL otherwise.
+    // truncated is set if the frame is shorter than the datagram.
+    const char *echoPayload(const char *frame, int frameLength, int &payloadLength, bool &truncated) const;
+
+    QString m_interfaceName;
+    int m_interfaceIndex = 0;
+    int m_datagramSDULength = 0;
+    int m_frameLength = 0;
+    // Longest frame which fits into a sending frame, set by the backend when it opens
+    int m_maxFrameLength = 0;
+    // Increased by reconfigure(). The headers of sending frame i were built with m_frameGenerations[i].
+    int m_headerGeneration = 0;
+    QVector<int> m_frameGenerations;
+    // Our UDP port and the address of the satellite, in network byte order
+    quint16 m_sourcePort = 0;
+    quint32 m_destinationIp = 0;
+
+private:
+    bool resolveNextHop(quint32 nextHop, int probeSocket);
+
+    // Socket which keeps our UDP port
+    int m_portSocket = -1;
+    // All in network byte order
+    quint8 m_sourceMac[6];
+    quint8 m_nextHopMac[6];
+    quint32 m_sourceIp = 0;
+    quint16 m_destinationPort = 0;
+    quint8 m_tos = 0;
+};
+
+#endif // UDPRAWBACKEND_H
@@ -0,0 +1,210 @@
+#include "udpreceiverthread.h"
+#include "cpuplacement.h"
+#include <QDebug>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+UdpReceiverThread::UdpReceiverThread()
+{
+    m_wakeFd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+}
+
+UdpReceiverThread::~UdpReceiverThread()
+{
+    // be sure to stop the thread or get a segfault.
+    stop();
+    if (m_wakeFd >= 0) {
+        ::close(m_wakeFd);
+    }
+}
+
+void UdpReceiverThread::addFlow(UdpFlow *flow)
+{
+    m_Mutex.lock();
+    m_addedFlows.append(flow);
+    m_Mutex.unlock();
+
+    if (!isRunning()) {
+        this->start();
+    }
+    wakeUp();
+}
+
+void UdpReceiverThread::removeFlow(UdpFlow *flow)
+{
+    m_Mutex.lock();
+    if (m_addedFlows.removeAll(flow) > 0 || !isRunning()) {
+        // The thread did not take the flow yet
+        m_Mutex.unlock();
+        return;
+    }
+    m_removedFlows.append(flow);
+    m_Mutex.unlock();
+
+    wakeUp();
+
+    // Wait until the thread dropped the flow
+    m_Mutex.lock();
+    while (m_removedFlows.contains(flow)) {
+        m_flowsRemoved.wait(&m_Mutex);
+    }
+    m_Mutex.unlock();
+}
+
+void UdpReceiverThread::stop()
+{
+    if (isRunning()) {
+        m_Mutex.lock();
+        m_stopped = true;
+        m_Mutex.unlock();
+
+        wakeUp();
+        // Make sure the thread is stoped
+        this->wait();
+    }
+}
+
+void UdpReceiverThread::setPlacement(int cpu, int node)
+{
+    if (cpu == m_cpu && node == m_node) {
+        return;
+    }
+
+    // The thread places itself when it starts again with the next flow
+    stop();
+    m_cpu = cpu;
+    m_node = node;
+}
+
+int UdpReceiverThread::pinnedCpu()
+{
+    int t_cpu;
+
+    m_Mutex.lock();
+    t_cpu = m_pinnedCpu;
+    m_Mutex.unlock();
+
+    return t_cpu;
+}
+
+void UdpReceiverThread::wakeUp()
+{
+    const quint64 t_one = 1;
+    if (write(m_wakeFd, &t_one, sizeof (t_one)) < 0) {
+        // The counter is already set, the thread will wake up anyway
+    }
+}
+
+/*
+ * The thread loop. All thread-internal variables are prefixed with t_
+ */
+void UdpReceiverThread::run()
+{
+    UdpFlow *t_flow;
+    QList<UdpFlow *> t_flows;
+    QList<UdpFlow *> t_addedFlows;
+    QList<UdpFlow *> t_removedFlows;
+    struct epoll_event t_event;
+    struct epoll_event t_events[MAX_EVENTS];
+    int t_eventCount;
+    quint64 t_counter;
+    struct itimerspec t_timer;
+
+    // m_cpu and m_node are only changed while the thread is stopped
+    CpuPlacement::preferNode(m_node);
+    const bool t_pinned = CpuPlacement::pinCurrentThread(m_cpu);
+    m_Mutex.lock();
+    m_pinnedCpu = t_pinned ? m_cpu : -1;
+    m_Mutex.unlock();
+
+    const int t_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    const int t_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (t_epollFd < 0 || t_timerFd < 0) {
+        qDebug() << "UdpReceiverThread::run: could not create the epoll or timer file descriptors";
+        return;
+    }
+    t_event.events = EPOLLIN;
+    t_event.data.ptr = &m_wakeFd;
+    epoll_ctl(t_epollFd, EPOLL_CTL_ADD, m_wakeFd, &t_event);
+    t_event.data.ptr = &t_timer;
+    epoll_ctl(t_epollFd, EPOLL_CTL_ADD, t_timerFd, &t_event);
+
+    // The timeout check runs periodically
+    t_timer.it_value.tv_sec = RX_TIMEOUT_CHECK_NSEC / 1000000000;
+    t_timer.it_value.tv_nsec = RX_TIMEOUT_CHECK_NSEC % 1000000000;
+    t_timer.it_interval = t_timer.it_value;
+    timerfd_settime(t_timerFd, 0, &t_timer, NULL);
+
+    forever {
+        /********************************************************************
+        * First step: take the flows added and removed by the sending thread
+        *********************************************************************/
+        m_Mutex.lock();
+        if (m_stopped) {
+            m_stopped = false;
+            m_Mutex.unlock();
+            /* Break outside the forever loop */
+            break;
+        }
+        t_addedFlows = m_addedFlows;
+        m_addedFlows.clear();
+        t_removedFlows = m_removedFlows;
+        m_Mutex.unlock();
+
+        foreach (t_flow, t_addedFlows) {
+            t_event.events = EPOLLIN;
+            t_event.data.ptr = t_flow;
+            epoll_ctl(t_epollFd, EPOLL_CTL_ADD, t_flow->backend()->pollFd(), &t_event);
+            t_flows.append(t_flow);
+        }
+
+        if (!t_removedFlows.isEmpty()) {
+            foreach (t_flow, t_removedFlows) {
+                if (t_flows.removeAll(t_flow) > 0) {
+                    epoll_ctl(t_epollFd, EPOLL_CTL_DEL, t_flow->backend()->pollFd(), NULL);
+                }
+            }
+
+            m_Mutex.lock();
+            foreach (t_flow, t_removedFlows) {
+                m_removedFlows.removeAll(t_flow);
+            }
+            m_flowsRemoved.wakeAll();
+            m_Mutex.unlock();
+        }
+
+        /********************************************************************
+        * Second step: sleep until echoes come in, and receive them
+        *********************************************************************/
+        t_eventCount = epoll_wait(t_epollFd, t_events, MAX_EVENTS, -1);
+        for (int i = 0; i < t_eventCount; i++) {
+            if (t_events[i].data.ptr == &m_wakeFd) {
+                if (read(m_wakeFd, &t_counter, sizeof (t_counter)) < 0) {
+                    // Nothing to read, somebody else reset the counter
+                }
+            } else if (t_events[i].data.ptr == &t_timer) {
+                if (read(t_timerFd, &t_counter, sizeof (t_counter)) < 0) {
+                    // Nothing to read, the timer did not expire
+                }
+                foreach (t_flow, t_flows) {
+                    t_flow->receive(UdpFlow::monotonicNsec());
+                }
+            } else {
+                static_cast<UdpFlow *>(t_events[i].data.ptr)->receive(UdpFlow::monotonicNsec());
+            }
+        }
+    }
+
+    ::close(t_timerFd);
+    ::close(t_epollFd);
+
+    // The flows are closed by their sending thread
+    m_Mutex.lock();
+    m_addedFlows.clear();
+    m_removedFlows.clear();
+    m_flowsRemoved.wakeAll();
+    m_Mutex.unlock();
+}
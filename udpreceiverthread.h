@@ -0,0 +1,65 @@
+#ifndef UDPRECEIVERTHREAD_H
+#define UDPRECEIVERTHREAD_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QList>
+
+#include "udpflow.h"
+
+/* Receives the echoes of the flows of one UdpSenderThread.
+ *
+ * The thread sleeps in epoll_wait() until the backend of a flow can receive and calls receive()
+ * of that flow, while the UdpSenderThread only paces and sends. So a burst of echoes does not
+ * delay departures, and sending does not delay the receive timestamps.
+ * Each RX_TIMEOUT_CHECK_NSEC, all flows are called, so that packets which did not come back are
+ * counted as lost even when no echo comes in anymore.
+ *
+ * Flows are added and removed by their UdpSenderThread, which opens and closes them.
+ */
+class UdpReceiverThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    UdpReceiverThread();
+    ~UdpReceiverThread();
+
+    // The thread receives for the flow. The thread is started if needed.
+    void addFlow(UdpFlow *flow);
+    // Returns when the thread does not receive for the flow anymore
+    void removeFlow(UdpFlow *flow);
+    void stop();
+    // CPU the thread is pinned to and NUMA node of its memory, -1 = floating. Applied when the thread starts.
+    void setPlacement(int cpu, int node);
+    // CPU the thread is pinned to, -1 if it floats
+    int pinnedCpu();
+
+    static constexpr qint64 RX_TIMEOUT_CHECK_NSEC = 100000000;
+    // Events handled per epoll_wait() call
+    static const int MAX_EVENTS = 256;
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    void wakeUp();
+
+    /* Locker when accessing the flow lists */
+    QMutex m_Mutex;
+    QWaitCondition m_flowsRemoved;
+    QList<UdpFlow *> m_addedFlows;
+    QList<UdpFlow *> m_removedFlows;
+    // volatile = tell the computer this variable may change at any time
+    volatile bool m_stopped = false;
+
+    // eventfd which wakes the thread up when the lists change
+    int m_wakeFd = -1;
+
+    int m_cpu = -1;
+    int m_node = -1;
+    int m_pinnedCpu = -1;
+};
+
+#endif // UDPRECEIVERTHREAD_H
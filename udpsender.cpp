@@ -2,7 +2,6 @@
 #include <QtEndian>
 #include <stdio.h>
 #include <string.h>
-#include <QDateTime>
 #include <QDebug>
 
 UdpSender::UdpSender(QObject *parent) :
@@ -18,17 +17,12 @@ UdpSender::UdpSender(QObject *parent) :
     // Initialise PDU Size & Bandwidth to some Value
     setBandwidth(1000000, NetworkModel::EthernetLayer2);
     setPduSize(512, NetworkModel::EthernetLayer2);
-
-    m_lastStats = QDateTime::currentMSecsSinceEpoch();
-
-    connect(&m_thread, SIGNAL(statistics(quint64,quint64,quint64,quint64)),
-            this,      SLOT(receiveStatistics(quint64,quint64,quint64,quint64)));
 }
 
 UdpSender::~UdpSender()
 {
-    // be sure to stop the thread or get a segfault.
-    m_thread.stop();
+    // be sure to stop the flow or get a segfault.
+    m_flow.stop();
     if (m_WANNetworkModel) {
         delete m_WANNetworkModel;
     }
@@ -54,8 +48,10 @@ void UdpSender::setWANLayerModel(NetworkLayerListModel *model)
         delete m_WANNetworkModel;
     }
     m_WANNetworkModel = model->clone();
+    m_WANNetworkModel->setMtu(m_networkModel.mtu());
 
     m_WANNetworkModel->setUDPPDUSize(m_specUDPPDUSize);
+    updateWANPduSizes();
 }
 
 void UdpSender::updateWANLayerModel(NetworkLayerListModel *WANmodel)
@@ -70,18 +66,19 @@ void UdpSender::updateWANLayerModel(NetworkLayerListModel *WANmodel)
     }
 
     m_WANNetworkModel->setUDPPDUSize(m_specUDPPDUSize);
+    updateWANPduSizes();
 }
 
 void UdpSender::setDestination(QHostAddress address)
 {
     m_destination = address;
 
-    m_thread.setDestination(address);
+    m_flow.setDestination(address);
 }
 
 void UdpSender::setPort(int udpPort)
 {
-    if (m_thread.setPort(udpPort)) {
+    if (m_flow.setPort(udpPort)) {
         m_udpPort = udpPort;
     }
     // if setting the port failed, do nothing.
@@ -95,7 +92,7 @@ int UdpSender::port()
 void UdpSender::setTos(quint8 tos)
 {
     m_tos = tos;
-    m_thread.setTos(tos);
+    m_flow.setTos(tos);
 }
 
 void UdpSender::setDscp(quint8 dscp)
@@ -123,16 +120,19 @@ QUuid UdpSender::id()
     return m_id;
 }
 
-void UdpSender::setBandwidth(uint bandwidth, NetworkModel::Layer bandwidthLayer)
+void UdpSender::setBandwidth(quint64 bandwidth, NetworkModel::Layer bandwidthLayer)
 {
     m_networkModel.setBandwidth(bandwidth, bandwidthLayer);
 
     // We need to recalculate the amount of packets per second, as the Bandwidth changed
     m_specPps = m_networkModel.pps();
-    m_thread.setPpmsec(m_specPps / 1000);
+    m_flow.setPpmsec(m_specPps / 1000);
+    if (!m_rateProfile.isEmpty()) {
+        applyRateProfile(false);
+    }
 }
 
-uint UdpSender::specifiedBandwidth(NetworkModel::Layer bandwidthLayer)
+quint64 UdpSender::specifiedBandwidth(NetworkModel::Layer bandwidthLayer)
 {
     return m_networkModel.bandwidth(bandwidthLayer);
 }
@@ -151,11 +151,15 @@ void UdpSender::setPduSize(uint pduSize, NetworkModel::Layer pduSizeLayer)
 
     // Whe need to remove 8 bytes of the UDP Header to get the UDP Payload (datagram SDU) length.
     udpPayloadLength = m_specUDPPDUSize - 8;
-    m_thread.setDatagramSDULength(udpPayloadLength);
 
-    // We need to recalculate the amount of packets per second, as the PDU Size changed but not the Bandwidth
+    // We need to recalculate the amount of packets per second, as the PDU Size changed but not the Bandwidth.
+    // Both change at once, so that a running flow keeps its bandwidth.
     m_specPps = m_networkModel.pps();
-    m_thread.setPpmsec(m_specPps / 1000);
+    m_flow.setDatagramSDULength(udpPayloadLength, m_specPps / 1000);
+    updateWANPduSizes();
+    if (!m_rateProfile.isEmpty()) {
+        applyRateProfile(false);
+    }
 }
 
 uint UdpSender::specifiedPduSize(NetworkModel::Layer pduLayer)
@@ -163,143 +167,587 @@ uint UdpSender::specifiedPduSize(NetworkModel::Layer pduLayer)
     return m_networkModel.pduSize(pduLayer);
 }
 
-void UdpSender::setTcMsec(uint tc)
+void UdpSender::setSizeMix(NetworkModel::SizeMix mix, NetworkModel::Layer sizeLayer)
+{
+    m_networkModel.setSizeMix(mix, sizeLayer);
+    applySizeMix();
+}
+
+NetworkModel::SizeMix UdpSender::sizeMix(NetworkModel::Layer sizeLayer)
+{
+    return m_networkModel.sizeMix(sizeLayer);
+}
+
+void UdpSender::applySizeMix()
+{
+    NetworkModel::SizeMix udpMix = m_networkModel.sizeMix(NetworkModel::UDPLayer);
+    QList<QPair<uint, uint>> payloadMix;
+    QPair<uint, uint> entry;
+
+    // Whe need to remove 8 bytes of the UDP Header to get the UDP Payload (datagram SDU) lengths.
+    foreach (entry, udpMix) {
+        payloadMix.append(qMakePair(entry.first - 8, entry.second));
+    }
+
+    // The average size changed but not the Bandwidth: both go to the flow at once
+    m_specPps = m_networkModel.pps();
+    m_flow.setSizeMix(payloadMix, m_specPps / 1000);
+    updateWANPduSizes();
+    if (!m_rateProfile.isEmpty()) {
+        applyRateProfile(false);
+    }
+}
+
+bool UdpSender::setRateProfile(QString text, NetworkModel::Layer bandwidthLayer)
+{
+    if (!m_rateProfile.parse(text)) {
+        return false;
+    }
+
+    m_rateProfileLayer = bandwidthLayer;
+    m_rateSteps.clear();
+    applyRateProfile(true);
+    return true;
+}
+
+QString UdpSender::rateProfile()
+{
+    return m_rateProfile.text();
+}
+
+/*
+ * The steps of a ramp, a staircase or a burst are fractions of the specified rate, those of a trace
+ * are converted from bit/s with the average PDU size, so a profile follows bandwidth and size changes.
+ * The flow gets the peak rate of the profile to spread the flows over the threads.
+ */
+void UdpSender::applyRateProfile(bool restart)
+{
+    QVector<UdpRateStep> steps;
+    UdpRateStep step;
+    RateProfile::Step profileStep;
+    qreal ppmsecScale;
+    qreal ppmsecPeak = 0;
+
+    if (m_rateProfile.relative()) {
+        ppmsecScale = m_specPps / 1000;
+    } else {
+        ppmsecScale = 1 / (8 * m_networkModel.averagePduSize(m_rateProfileLayer)) / 1000;
+    }
+
+    foreach (profileStep, m_rateProfile.steps()) {
+        step.nsecDuration = qRound64(profileStep.seconds * 1000000000);
+        step.ppmsecStart = profileStep.bandwidthStart * ppmsecScale;
+        step.ppmsecEnd = profileStep.bandwidthEnd * ppmsecScale;
+        ppmsecPeak = qMax(ppmsecPeak, qMax(step.ppmsecStart, step.ppmsecEnd));
+        steps.append(step);
+    }
+
+    m_flow.setPpmsec(steps.isEmpty() ? m_specPps / 1000 : ppmsecPeak);
+    m_flow.setRateProfile(steps, m_rateProfile.loop(), restart);
+}
+
+void UdpSender::updateWANPduSizes()
+{
+    NetworkModel::SizeMix mix = m_networkModel.sizeMix(NetworkModel::UDPLayer);
+    QPair<uint, uint> entry;
+    QList<uint> pduList;
+    qreal totalWeight = 0;
+    int i;
+
+    m_WANPduSizes.clear();
+    if (m_WANNetworkModel == NULL) {
+        return;
+    }
+    if (mix.isEmpty()) {
+        mix.append(qMakePair(m_specUDPPDUSize, 1u));
+    }
+
+    foreach (entry, mix) {
+        m_WANNetworkModel->setUDPPDUSize(entry.first);
+        pduList = m_WANNetworkModel->layerPDUSize();
+        while (m_WANPduSizes.size() < pduList.size()) {
+            m_WANPduSizes.append(0);
+        }
+        for (i = 0; i < pduList.size(); i++) {
+            m_WANPduSizes[i] += (qreal) pduList[i] * entry.second;
+        }
+        totalWeight += entry.second;
+    }
+    for (i = 0; i < m_WANPduSizes.size(); i++) {
+        m_WANPduSizes[i] /= totalWeight;
+    }
+
+    // The WAN model keeps the specified size
+    m_WANNetworkModel->setUDPPDUSize(m_specUDPPDUSize);
+}
+
+void UdpSender::setTcUsec(uint tc)
 {
     // Tc cannot be zero
-    if (tc < 1)
-        tc = 1;
+    if (tc < UdpFlow::MIN_TC_USEC)
+        tc = UdpFlow::MIN_TC_USEC;
     // Tc should not be superior to 1 second (or we may have to change some code like packet loss detection)
-    if (tc > 1000)
-        tc = 1000;
+    if (tc > UdpFlow::MAX_TC_USEC)
+        tc = UdpFlow::MAX_TC_USEC;
+
+    m_tcUsec = tc;
+
+    m_flow.setTcUsec(m_tcUsec);
+}
+
+uint UdpSender::tcUsec()
+{
+    return  m_tcUsec;
+}
+
+void UdpSender::setTxBatchSize(uint batchSize)
+{
+    // The batch size must be between 1 and the maximum supported by sendmmsg()
+    batchSize = qBound(1u, batchSize, static_cast<uint>(UdpFlow::MAX_TX_BATCH_SIZE));
+
+    m_txBatchSize = batchSize;
+
+    m_flow.setTxBatchSize(m_txBatchSize);
+}
+
+uint UdpSender::txBatchSize()
+{
+    return m_txBatchSize;
+}
+
+void UdpSender::setRxDrainBudget(uint budget)
+{
+    m_rxDrainBudget = budget;
+
+    m_flow.setRxDrainBudget(m_rxDrainBudget);
+}
+
+uint UdpSender::rxDrainBudget()
+{
+    return m_rxDrainBudget;
+}
+
+void UdpSender::setUdpGso(bool enabled)
+{
+    m_udpGso = enabled;
+
+    m_flow.setUdpGso(m_udpGso);
+}
+
+bool UdpSender::udpGso()
+{
+    return m_udpGso;
+}
+
+void UdpSender::setUdpGro(bool enabled)
+{
+    m_udpGro = enabled;
+
+    m_flow.setUdpGro(m_udpGro);
+}
+
+bool UdpSender::udpGro()
+{
+    return m_udpGro;
+}
+
+void UdpSender::setTimestamping(bool enabled)
+{
+    m_timestamping = enabled;
+
+    m_flow.setTimestamping(m_timestamping);
+}
+
+bool UdpSender::timestamping()
+{
+    return m_timestamping;
+}
+
+void UdpSender::setCrc32c(bool enabled)
+{
+    m_crc32c = enabled;
+
+    m_flow.setCrc32c(m_crc32c);
+}
+
+bool UdpSender::crc32c()
+{
+    return m_crc32c;
+}
+
+void UdpSender::setPacingMode(UdpFlow::PacingMode mode)
+{
+    m_pacingMode = mode;
+
+    m_flow.setPacingMode(m_pacingMode);
+}
+
+UdpFlow::PacingMode UdpSender::pacingMode()
+{
+    return m_pacingMode;
+}
+
+void UdpSender::setPayloadMode(PayloadGenerator::Mode mode)
+{
+    m_payloadMode = mode;
+
+    m_flow.setPayloadMode(m_payloadMode);
+}
 
-    m_tcMsec = tc;
+PayloadGenerator::Mode UdpSender::payloadMode()
+{
+    return m_payloadMode;
+}
+
+void UdpSender::setIoBackend(UdpIoBackend::Backend backend)
+{
+    m_ioBackend = backend;
 
-    m_thread.setTcMsec(m_tcMsec);
+    m_flow.setIoBackend(m_ioBackend);
 }
 
-uint UdpSender::tcMsec()
+UdpIoBackend::Backend UdpSender::ioBackend()
 {
-    return  m_tcMsec;
+    return m_ioBackend;
 }
 
-void UdpSender::startTraffic()
+void UdpSender::startTraffic(UdpSenderThread *thread)
 {
-    if (m_thread.isRunning()) {
+    if (m_flow.isRunning()) {
         /* Test already running */
         return;
     }
-    m_thread.start();
+    m_flow.setSenderThread(thread);
+    m_flow.start();
 }
 
 void UdpSender::stopTraffic()
 {
-    m_thread.stop();
+    m_flow.stop();
 }
 
-uint UdpSender::sendingBandwidth(NetworkModel::Layer bandwidthLayer)
+QString UdpSender::placement()
+{
+    if (!m_flow.isRunning() || m_flow.senderThread() == NULL) {
+        return QString();
+    }
+
+    return m_flow.senderThread()->placement();
+}
+
+quint64 UdpSender::sendingBandwidth(NetworkModel::Layer bandwidthLayer)
 {
     return m_networkModel.pps2bandwidth(m_sentPps, bandwidthLayer);
 }
 
-uint UdpSender::receivingBandwidth(NetworkModel::Layer bandwidthLayer)
+const QList<UdpRateStepStats> &UdpSender::rateSteps()
+{
+    return m_rateSteps;
+}
+
+quint64 UdpSender::bandwidthOfPps(qreal pps, NetworkModel::Layer bandwidthLayer)
+{
+    return m_networkModel.pps2bandwidth(pps, bandwidthLayer);
+}
+
+quint64 UdpSender::receivingBandwidth(NetworkModel::Layer bandwidthLayer)
 {
     return m_networkModel.pps2bandwidth(m_receivedPps, bandwidthLayer);
 }
 
-int UdpSender::sendingPps()
+qint64 UdpSender::sendingPps()
 {
     return m_sentPps;
 }
 
-int UdpSender::receivingPps()
+qint64 UdpSender::receivingPps()
 {
     return m_receivedPps;
 }
 
-int UdpSender::packetLost()
+quint64 UdpSender::packetLost()
 {
     return m_PacketsLost;
 }
 
-int UdpSender::packetsSent()
+quint64 UdpSender::packetsSent()
 {
     return m_PacketsSent;
 }
 
-int UdpSender::packetsReceived()
+quint64 UdpSender::packetsReceived()
 {
     return m_PacketsReceived;
 }
 
-int UdpSender::packetsNotSent()
+quint64 UdpSender::packetsNotSent()
 {
     return m_PacketsNotSent;
 }
 
-QList<int> UdpSender::WANsendingBandwidth()
+quint64 UdpSender::packetsReordered()
 {
-    uint PDUsize;
-    QList<int> l;
-    QList<uint> pduList;
+    return m_PacketsReordered;
+}
 
-    if (m_WANNetworkModel == NULL) {
-        return l;
+quint64 UdpSender::packetsDuplicated()
+{
+    return m_PacketsDuplicated;
+}
+
+quint64 UdpSender::packetsLate()
+{
+    return m_PacketsLate;
+}
+
+quint64 UdpSender::packetsCorrupted()
+{
+    return m_PacketsCorrupted;
+}
+
+qreal UdpSender::sendingBatchAverage()
+{
+    return m_sendingBatchAverage;
+}
+
+qreal UdpSender::receivingBatchAverage()
+{
+    return m_receivingBatchAverage;
+}
+
+qreal UdpSender::pacingErrorAverageUsec()
+{
+    return m_pacingErrorAverageUsec;
+}
+
+qreal UdpSender::pacingErrorMaxUsec()
+{
+    return m_pacingErrorMaxUsec;
+}
+
+const LatencyHistogram &UdpSender::latencyHistogram()
+{
+    return m_latency.histogram;
+}
+
+const LatencyHistogram &UdpSender::networkLatencyHistogram()
+{
+    return m_latency.networkHistogram;
+}
+
+quint64 UdpSender::networkLatencyMissed()
+{
+    return m_latency.networkMissed;
+}
+
+qreal UdpSender::jitterUsec()
+{
+    return (qreal) m_latency.jitterNsec / 1000;
+}
+
+qreal UdpSender::ipdvAverageUsec()
+{
+    if (m_latency.ipdvCount == 0) {
+        return 0;
     }
+    return (qreal) m_latency.ipdvAbsSumNsec / m_latency.ipdvCount / 1000;
+}
+
+qreal UdpSender::ipdvMinUsec()
+{
+    return (qreal) m_latency.ipdvMinNsec / 1000;
+}
+
+qreal UdpSender::ipdvMaxUsec()
+{
+    return (qreal) m_latency.ipdvMaxNsec / 1000;
+}
 
-    pduList = m_WANNetworkModel->layerPDUSize();
+QList<quint64> UdpSender::WANsendingBandwidth()
+{
+    qreal PDUsize;
+    QList<quint64> l;
 
-    if (pduList.isEmpty()) {
-        return l;
+    // Empty without WAN model
+    foreach (PDUsize, m_WANPduSizes) {
+        l.append(qRound64(PDUsize * 8 * m_sentPps));
     }
 
-    foreach (PDUsize, pduList) {
-        l.append(PDUsize * 8 * m_sentPps);
+    return l;
+}
+
+QList<quint64> UdpSender::WANreceivingBandwidth()
+{
+    qreal PDUsize;
+    QList<quint64> l;
+
+    foreach (PDUsize, m_WANPduSizes) {
+        l.append(qRound64(PDUsize * 8 * m_receivedPps));
     }
 
     return l;
 }
 
-QList<int> UdpSender::WANreceivingBandwidth()
+void UdpSender::setStatsIntervalMsec(int msec)
 {
-    uint PDUsize;
-    QList<int> l;
-    QList<uint> pduList;
+    m_flow.setStatsIntervalMsec(msec);
+}
 
-    if (m_WANNetworkModel == NULL) {
-        return l;
+void UdpSender::setMtu(uint mtu)
+{
+    m_networkModel.setMtu(mtu);
+    if (m_WANNetworkModel) {
+        m_WANNetworkModel->setMtu(m_networkModel.mtu());
     }
+    // Minus the IP and UDP headers
+    m_flow.setMaxDatagramSDULength(m_networkModel.mtu() - 20 - 8);
 
-    pduList = m_WANNetworkModel->layerPDUSize();
+    // Keeps the sizes, unless they do not fit any more. The WAN layers and the flow follow.
+    setPduSize(m_networkModel.pduSize(NetworkModel::UDPLayer), NetworkModel::UDPLayer);
+    applySizeMix();
+}
+
+uint UdpSender::mtu()
+{
+    return m_networkModel.mtu();
+}
+
+void UdpSender::setLossTimeoutMsec(int msec)
+{
+    m_flow.setLossTimeoutMsec(msec);
+}
 
-    foreach (PDUsize, pduList) {
-        l.append(PDUsize * 8 * m_receivedPps);
+qint64 UdpSender::updateStatistics()
+{
+    UdpSenderStats stats;
+    UdpLatencyStats latencies;
+    UdpRateStepStats rateStep;
+
+    while (m_flow.takeStatistics(stats)) {
+        m_statsHistory.append(stats);
+    }
+    while (m_statsHistory.size() > STATS_HISTORY_LENGTH) {
+        m_statsHistory.removeFirst();
+    }
+    while (m_flow.takeLatencies(latencies)) {
+        m_latencyHistory.append(latencies);
+    }
+    while (m_latencyHistory.size() > STATS_HISTORY_LENGTH) {
+        m_latencyHistory.removeFirst();
+    }
+    while (m_flow.takeRateStep(rateStep)) {
+        m_rateSteps.append(rateStep);
+    }
+    while (m_rateSteps.size() > RATE_STEP_HISTORY_LENGTH) {
+        m_rateSteps.removeFirst();
     }
 
-    return l;
+    if (!m_flow.isRunning() || m_statsHistory.isEmpty()) {
+        return -1;
+    }
+    return m_statsHistory.last().nsecEpoch;
 }
 
-void UdpSender::receiveStatistics(quint64 packetsLost, quint64 packetsSent,
-                                  quint64 packetsReceived, quint64 packetsNotSent)
+/*
+ * The rates are calculated between the snapshot of nsecEpoch (or the newest one before) and the
+ * snapshot before it, with the times the thread took them. So they do not depend on when the
+ * main thread reads them, and all flows show the same interval.
+ */
+void UdpSender::selectStatistics(qint64 nsecEpoch)
 {
-    qint64 statTime = QDateTime::currentMSecsSinceEpoch();
+    int i = m_statsHistory.size() - 1;
+    while (i >= 0 && m_statsHistory[i].nsecEpoch > nsecEpoch) {
+        i--;
+    }
+    if (i < 0 || m_statsHistory[i].nsecEpoch == m_statsEpoch) {
+        // Nothing new
+        return;
+    }
+
+    const UdpSenderStats &stats = m_statsHistory[i];
+    UdpSenderStats previous;
+    if (i > 0 && m_statsHistory[i - 1].nsecStarted == stats.nsecStarted) {
+        previous = m_statsHistory[i - 1];
+    } else {
+        // The first snapshot since the flow started, its counters started at 0
+        previous.nsecTimestamp = stats.nsecStarted;
+    }
 
-    if (statTime == m_lastStats) {
-        // The last statistics were in the same msec. This should not occur, but perhaps the thread is busy
-        // We ignore these Statistics
-        qDebug() << "two stats at the same time...";
+    qint64 sendDelta = stats.packetsSent - previous.packetsSent;
+    qint64 receivedDelta = stats.packetsReceived - previous.packetsReceived;
+    qint64 sendCallsDelta = stats.sendCalls - previous.sendCalls;
+    qint64 receiveCallsDelta = stats.receiveCalls - previous.receiveCalls;
+    qint64 pacingErrorCountDelta = stats.pacingErrorCount - previous.pacingErrorCount;
+    qint64 timeDelta = stats.nsecTimestamp - previous.nsecTimestamp;
+
+    if (timeDelta <= 0) {
         return;
     }
 
-    qint64 sendDelta = packetsSent - m_PacketsSent;
-    qint64 receivedDelta = packetsReceived - m_PacketsReceived;
-    qint64 timeDela = statTime - m_lastStats;
+    m_sentPps     = 1000000000 * sendDelta / timeDelta;
+    m_receivedPps = 1000000000 * receivedDelta / timeDelta;
 
-    m_sentPps     = 1000 * sendDelta / timeDela;
-    m_receivedPps = 1000 * receivedDelta /timeDela;
+    if (sendCallsDelta > 0) {
+        m_sendingBatchAverage = (qreal) sendDelta / sendCallsDelta;
+    } else {
+        m_sendingBatchAverage = 0;
+    }
+
+    if (receiveCallsDelta > 0) {
+        m_receivingBatchAverage = (qreal) receivedDelta / receiveCallsDelta;
+    } else {
+        m_receivingBatchAverage = 0;
+    }
+
+    if (pacingErrorCountDelta > 0) {
+        m_pacingErrorAverageUsec = (qreal) (stats.pacingErrorSumNsec - previous.pacingErrorSumNsec) / pacingErrorCountDelta / 1000;
+    } else {
+        m_pacingErrorAverageUsec = 0;
+    }
+    // The maximum is per snapshot: take all snapshots since the last selected one
+    qint64 pacingErrorMax = 0;
+    for (int j = i; j >= 0 && m_statsHistory[j].nsecEpoch > m_statsEpoch; j--) {
+        pacingErrorMax = qMax(pacingErrorMax, m_statsHistory[j].pacingErrorMaxNsec);
+    }
+    m_pacingErrorMaxUsec = (qreal) pacingErrorMax / 1000;
+
+    /* The latencies of the interval. The receiving half may publish them a bit after the snapshot,
+     * histograms which come too late are added to the next interval.
+     */
+    m_latency.histogram.clear();
+    m_latency.networkHistogram.clear();
+    m_latency.networkMissed = 0;
+    m_latency.ipdvCount = 0;
+    m_latency.ipdvAbsSumNsec = 0;
+    m_latency.ipdvMinNsec = 0;
+    m_latency.ipdvMaxNsec = 0;
+    while (!m_latencyHistory.isEmpty() && m_latencyHistory.first().nsecEpoch <= stats.nsecEpoch) {
+        const UdpLatencyStats &latencies = m_latencyHistory.first();
+        m_latency.histogram.merge(latencies.histogram);
+        m_latency.networkHistogram.merge(latencies.networkHistogram);
+        m_latency.networkMissed += latencies.networkMissed;
+        // The jitter is a running estimate, the newest value is the one of the interval
+        m_latency.jitterNsec = latencies.jitterNsec;
+        if (latencies.ipdvCount > 0) {
+            if (m_latency.ipdvCount == 0 || latencies.ipdvMinNsec < m_latency.ipdvMinNsec) {
+                m_latency.ipdvMinNsec = latencies.ipdvMinNsec;
+            }
+            if (m_latency.ipdvCount == 0 || latencies.ipdvMaxNsec > m_latency.ipdvMaxNsec) {
+                m_latency.ipdvMaxNsec = latencies.ipdvMaxNsec;
+            }
+            m_latency.ipdvCount += latencies.ipdvCount;
+            m_latency.ipdvAbsSumNsec += latencies.ipdvAbsSumNsec;
+        }
+        m_latencyHistory.removeFirst();
+    }
 
-    m_PacketsLost = packetsLost;
-    m_PacketsSent = packetsSent;
-    m_PacketsReceived = packetsReceived;
-    m_PacketsNotSent = packetsNotSent;
-    m_lastStats = statTime;
+    m_PacketsLost = stats.packetsLost;
+    m_PacketsSent = stats.packetsSent;
+    m_PacketsReceived = stats.packetsReceived;
+    m_PacketsNotSent = stats.packetsNotSent;
+    m_PacketsReordered = stats.packetsReordered;
+    m_PacketsDuplicated = stats.packetsDuplicated;
+    m_PacketsLate = stats.packetsLate;
+    m_PacketsCorrupted = stats.packetsCorrupted;
+    m_statsEpoch = stats.nsecEpoch;
 }
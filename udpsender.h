@@ -7,8 +7,10 @@
 #include <QUuid>
 
 #include "networkmodel.h"
+#include "udpflow.h"
 #include "udpsenderthread.h"
 #include "networklayerlistmodel.h"
+#include "rateprofile.h"
 
 class UdpSender : public QObject
 {
@@ -35,63 +37,172 @@ public:
     QString name();
     QUuid id();
 
-    void setBandwidth(uint bandwidth, NetworkModel::Layer bandwidthLayer);
-    uint specifiedBandwidth(NetworkModel::Layer bandwidthLayer);
+    void setBandwidth(quint64 bandwidth, NetworkModel::Layer bandwidthLayer);
+    quint64 specifiedBandwidth(NetworkModel::Layer bandwidthLayer);
     void setPduSize(uint pduSize, NetworkModel::Layer pduSizeLayer);
     uint specifiedPduSize(NetworkModel::Layer pduLayer);
-
-    void setTcMsec(uint tc);
-    uint tcMsec();
-
-    void startTraffic();
+    // Size mix (IMIX): PDU sizes at sizeLayer and their weights. Without one, all packets have the specified PDU size.
+    void setSizeMix(NetworkModel::SizeMix mix, NetworkModel::Layer sizeLayer);
+    NetworkModel::SizeMix sizeMix(NetworkModel::Layer sizeLayer);
+    /* Rate profile (see RateProfile), the bandwidths of a trace are at bandwidthLayer. Returns false and
+     * keeps the profile if text is not valid. A new profile starts from its beginning.
+     */
+    bool setRateProfile(QString text, NetworkModel::Layer bandwidthLayer);
+    QString rateProfile();
+
+    // Tc in µsec
+    void setTcUsec(uint tc);
+    uint tcUsec();
+
+    void setTxBatchSize(uint batchSize);
+    uint txBatchSize();
+
+    void setRxDrainBudget(uint budget);
+    uint rxDrainBudget();
+
+    void setUdpGso(bool enabled);
+    bool udpGso();
+
+    void setUdpGro(bool enabled);
+    bool udpGro();
+
+    void setTimestamping(bool enabled);
+    bool timestamping();
+    // CRC32C trailer in each payload, checked on the echoes
+    void setCrc32c(bool enabled);
+    bool crc32c();
+
+    void setPacingMode(UdpFlow::PacingMode mode);
+    UdpFlow::PacingMode pacingMode();
+    void setPayloadMode(PayloadGenerator::Mode mode);
+    PayloadGenerator::Mode payloadMode();
+
+    void setIoBackend(UdpIoBackend::Backend backend);
+    UdpIoBackend::Backend ioBackend();
+
+    // The flow is run by thread, chosen by UdpSenderScheduler
+    void startTraffic(UdpSenderThread *thread);
     void stopTraffic();
+    // Worker thread and CPUs running the flow, empty if it is stopped
+    QString placement();
 
     /***** Statistics *****/
-    uint sendingBandwidth(NetworkModel::Layer bandwidthLayer);
-    uint receivingBandwidth(NetworkModel::Layer bandwidthLayer);
-    int sendingPps();
-    int receivingPps();
-    int packetLost();
-    int packetsSent();
-    int packetsReceived();
-    int packetsNotSent();
-
-    QList<int> WANsendingBandwidth();
-    QList<int> WANreceivingBandwidth();
+    // Interval of the stats snapshots of the flow
+    void setStatsIntervalMsec(int msec);
+    // Packets which did not come back after this time are lost
+    void setLossTimeoutMsec(int msec);
+    // IP MTU: the biggest packet the flow may send, the packet size is clamped to it
+    void setMtu(uint mtu);
+    uint mtu();
+    // Fetches the snapshots of the flow. Returns the epoch of the newest one, -1 if the flow is
+    // stopped or did not report yet.
+    qint64 updateStatistics();
+    // The statistics below are those of the stats interval which ended at nsecEpoch
+    void selectStatistics(qint64 nsecEpoch);
+    quint64 sendingBandwidth(NetworkModel::Layer bandwidthLayer);
+    // Steps of the rate profile which ended, the oldest first
+    const QList<UdpRateStepStats> &rateSteps();
+    quint64 bandwidthOfPps(qreal pps, NetworkModel::Layer bandwidthLayer);
+    quint64 receivingBandwidth(NetworkModel::Layer bandwidthLayer);
+    qint64 sendingPps();
+    qint64 receivingPps();
+    quint64 packetLost();
+    quint64 packetsSent();
+    quint64 packetsReceived();
+    quint64 packetsNotSent();
+    quint64 packetsReordered();
+    quint64 packetsDuplicated();
+    quint64 packetsLate();
+    quint64 packetsCorrupted();
+    qreal sendingBatchAverage();
+    qreal receivingBatchAverage();
+    qreal pacingErrorAverageUsec();
+    qreal pacingErrorMaxUsec();
+    // Latencies of the echoes received during the stats interval
+    const LatencyHistogram &latencyHistogram();
+    // Delay between the kernel send and receive timestamps, empty without timestamping
+    const LatencyHistogram &networkLatencyHistogram();
+    // Echoes of the stats interval left out of it: their send timestamp was overwritten
+    quint64 networkLatencyMissed();
+    // RFC 3550 jitter at the end of the stats interval
+    qreal jitterUsec();
+    // IPDV (RFC 5481) during the stats interval: average of the absolute values, minimum and maximum
+    qreal ipdvAverageUsec();
+    qreal ipdvMinUsec();
+    qreal ipdvMaxUsec();
+
+    QList<quint64> WANsendingBandwidth();
+    QList<quint64> WANreceivingBandwidth();
 
 signals:
     void statsChanged();
 
-public slots:
-    void receiveStatistics(quint64 packetsLost, quint64 packetsSent, quint64 packetsReceived, quint64 packetsNotSent);
-
 private:
     QHostAddress m_destination;
 
-    UdpSenderThread m_thread;
+    UdpFlow m_flow;
 
     int m_udpPort = 7;
     quint8 m_tos = 0;
-    uint m_tcMsec = 100;
+    uint m_tcUsec = 100000;
+    uint m_txBatchSize = 1;
+    uint m_rxDrainBudget = 0;
+    bool m_udpGso = false;
+    bool m_udpGro = false;
+    bool m_timestamping = false;
+    bool m_crc32c = false;
+    UdpFlow::PacingMode m_pacingMode = UdpFlow::BurstPacing;
+    PayloadGenerator::Mode m_payloadMode = PayloadGenerator::ZeroPayload;
+    UdpIoBackend::Backend m_ioBackend = UdpIoBackend::SocketBackend;
 
     // Unique identifier
     QUuid m_id;
 
+    // Hands the size mix of m_networkModel over to the flow
+    void applySizeMix();
+    // Average PDU size of each WAN layer over the size mix, as the layers may add padding (ESP)
+    void updateWANPduSizes();
+    // Hands the rate profile over to the flow, in packets at the specified rate
+    void applyRateProfile(bool restart);
+
     NetworkModel m_networkModel;
     NetworkLayerListModel *m_WANNetworkModel = NULL;
+    QList<qreal> m_WANPduSizes;
     /* Specified UDP PDU size */
     uint m_specUDPPDUSize;
     /* Specified packets per second */
     qreal m_specPps;
+    RateProfile m_rateProfile;
+    NetworkModel::Layer m_rateProfileLayer = NetworkModel::EthernetLayer2;
 
     /***** Statistics *****/
     quint64 m_PacketsLost = 0;
     quint64 m_PacketsSent = 0;
     quint64 m_PacketsReceived = 0;
     quint64 m_PacketsNotSent = 0;
-    qint64 m_lastStats;
-    int m_sentPps = 0;
-    int m_receivedPps = 0;
+    quint64 m_PacketsReordered = 0;
+    quint64 m_PacketsDuplicated = 0;
+    quint64 m_PacketsLate = 0;
+    quint64 m_PacketsCorrupted = 0;
+    // Last snapshots of the flow, the oldest first
+    QList<UdpSenderStats> m_statsHistory;
+    static const int STATS_HISTORY_LENGTH = 64;
+    // Epoch of the statistics selected
+    qint64 m_statsEpoch = -1;
+    qint64 m_sentPps = 0;
+    qint64 m_receivedPps = 0;
+    // Average count of packets sent per sendmmsg() call during the last stats interval
+    qreal m_sendingBatchAverage = 0;
+    // Average count of packets received per recvmmsg() call during the last stats interval
+    qreal m_receivingBatchAverage = 0;
+    // Departure time error with smooth pacing during the last stats interval
+    qreal m_pacingErrorAverageUsec = 0;
+    qreal m_pacingErrorMaxUsec = 0;
+    // Latency histograms of the flow not selected yet, the oldest first
+    QList<UdpLatencyStats> m_latencyHistory;
+    UdpLatencyStats m_latency;
+    QList<UdpRateStepStats> m_rateSteps;
+    static const int RATE_STEP_HISTORY_LENGTH = 1000;
 
     QString m_Name;
 };
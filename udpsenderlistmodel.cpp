@@ -1,14 +1,24 @@
 #include "udpsenderlistmodel.h"
 
 #include <QLocale>
+#include <QStringList>
+
+#include "udpxdpbackend.h"
 
 UdpSenderListModel::UdpSenderListModel(QObject *parent)
     : QAbstractTableModel(parent)
 {
-    // Refresh stats every second
-    QTimer *statsTimer = new QTimer(this);
-    connect(statsTimer, SIGNAL(timeout()), this, SLOT(updateStats()));
-    statsTimer->start(1000);
+    // Refresh stats every stats interval
+    m_statsTimer = new QTimer(this);
+    connect(m_statsTimer, SIGNAL(timeout()), this, SLOT(updateStats()));
+    m_statsTimer->start(m_statsIntervalMsec);
+}
+
+UdpSenderListModel::~UdpSenderListModel()
+{
+    // The flows have to be stopped before the scheduler deletes their threads
+    qDeleteAll(m_udpSenderList.begin(), m_udpSenderList.end());
+    m_udpSenderList.clear();
 }
 
 int UdpSenderListModel::rowCount(const QModelIndex &parent) const
@@ -47,6 +57,22 @@ QVariant UdpSenderListModel::data(const QModelIndex &index, int role) const
         }
     }
 
+    // Boolean options are displayed as check boxes
+    if (role == Qt::CheckStateRole) {
+        switch (index.column()) {
+            case COL_GSO:
+                return m_udpSenderList[index.row()]->udpGso() ? Qt::Checked : Qt::Unchecked;
+            case COL_GRO:
+                return m_udpSenderList[index.row()]->udpGro() ? Qt::Checked : Qt::Unchecked;
+            case COL_TIMESTAMPING:
+                return m_udpSenderList[index.row()]->timestamping() ? Qt::Checked : Qt::Unchecked;
+            case COL_CRC32C:
+                return m_udpSenderList[index.row()]->crc32c() ? Qt::Checked : Qt::Unchecked;
+            default:
+                return QVariant();
+        }
+    }
+
     if (role != Qt::DisplayRole && role != Qt::EditRole)
         return QVariant();
 
@@ -55,11 +81,11 @@ QVariant UdpSenderListModel::data(const QModelIndex &index, int role) const
     // s is the current sender. As we have pretty long lines, s is shorter ;-)
     UdpSender *s = m_udpSenderList[index.row()];
     QString tmpText = "";
-    int packetsSent = 0;
+    quint64 packetsSent = 0;
     qreal percent;
-    int packetsNotSent = 0;
-    int packetsReceived = 0;
-    int packetsLost = 0;
+    quint64 packetsNotSent = 0;
+    quint64 packetsReceived = 0;
+    quint64 packetsLost = 0;
 
     switch (index.column()) {
         case COL_NAME:
@@ -69,12 +95,35 @@ QVariant UdpSenderListModel::data(const QModelIndex &index, int role) const
         case COL_BANDWIDTH:
             return l.toString((qreal) s->specifiedBandwidth(m_BandwidthLayer) / m_BandwidthUnit,
                     'f', QLocale::FloatingPointShortest);
+        case COL_PROFILE:
+            return s->rateProfile();
         case COL_PORT:
             return s->port();
         case COL_SIZE:
             return l.toString(s->specifiedPduSize(m_PDUSizeLayer));
+        case COL_SIZEMIX:
+            return sizeMixText(s->sizeMix(m_PDUSizeLayer));
+        case COL_PAYLOAD:
+            return PayloadGenerator::modeName(s->payloadMode());
         case COL_TC:
-            return s->tcMsec();
+            // Tc is displayed in msec, but can be set with a µsec resolution
+            return l.toString((qreal) s->tcUsec() / 1000, 'f', QLocale::FloatingPointShortest);
+        case COL_TXBATCH:
+            return s->txBatchSize();
+        case COL_RXBUDGET:
+            return s->rxDrainBudget();
+        case COL_GSO:
+        case COL_GRO:
+        case COL_TIMESTAMPING:
+        case COL_CRC32C:
+            // Only a check box
+            return QVariant();
+        case COL_PACING:
+            return UdpFlow::pacingModeName(s->pacingMode());
+        case COL_BACKEND:
+            return UdpIoBackend::backendName(s->ioBackend());
+        case COL_PLACEMENT:
+            return s->placement();
         case COL_SENDINGSTATS:
             tmpText += "L1 " +
               l.toString((qreal) s->sendingBandwidth(NetworkModel::EthernetLayer1) / m_BandwidthUnit, 'f', 2) + "\n";
@@ -106,7 +155,12 @@ QVariant UdpSenderListModel::data(const QModelIndex &index, int role) const
             tmpText += "Packets sent: " + l.toString(packetsSent) + "\n";
             tmpText += "Packets not sent: " + l.toString(packetsNotSent) + "\n";
             tmpText += "Percent not sent: " + l.toString(percent) + "%\n";
-            tmpText += "pps " + l.toString(s->sendingPps());
+            tmpText += "pps " + l.toString(s->sendingPps()) + "\n";
+            tmpText += "Packets per batch: " + l.toString(s->sendingBatchAverage(), 'f', 1);
+            if (s->pacingMode() == UdpFlow::SmoothPacing) {
+                tmpText += "\nPacing error µs avg " + l.toString(s->pacingErrorAverageUsec(), 'f', 1) +
+                           " max " + l.toString(s->pacingErrorMaxUsec(), 'f', 1);
+            }
             return tmpText;
         case COL_RECEIVINGPACKETS:
             packetsSent = s->packetsSent();
@@ -116,8 +170,28 @@ QVariant UdpSenderListModel::data(const QModelIndex &index, int role) const
             tmpText += "Packets received: " + l.toString(packetsReceived) + "\n";
             tmpText += "Packets lost: " + l.toString(packetsLost) + "\n";
             tmpText += "Percent lost: " + l.toString(percent) + "%\n";
-            tmpText += "pps " + l.toString(s->receivingPps());
+            tmpText += "Reordered: " + l.toString(s->packetsReordered()) + "\n";
+            tmpText += "Duplicated: " + l.toString(s->packetsDuplicated()) + "\n";
+            tmpText += "Late: " + l.toString(s->packetsLate()) + "\n";
+            if (s->crc32c()) {
+                tmpText += "Corrupted: " + l.toString(s->packetsCorrupted()) + "\n";
+            }
+            tmpText += "pps " + l.toString(s->receivingPps()) + "\n";
+            tmpText += "Packets per batch: " + l.toString(s->receivingBatchAverage(), 'f', 1);
             return tmpText;
+        case COL_LATENCY:
+            return latencyText(s->latencyHistogram(), s->networkLatencyHistogram(), s->networkLatencyMissed());
+        case COL_JITTER:
+            if (s->latencyHistogram().count() == 0) {
+                return "No echo";
+            }
+            tmpText += "Jitter " + l.toString(s->jitterUsec(), 'f', 1) + "\n";
+            tmpText += "IPDV avg " + l.toString(s->ipdvAverageUsec(), 'f', 1) + "\n";
+            tmpText += "IPDV min " + l.toString(s->ipdvMinUsec(), 'f', 1) + "\n";
+            tmpText += "IPDV max " + l.toString(s->ipdvMaxUsec(), 'f', 1);
+            return tmpText;
+        case COL_PROFILESTATS:
+            return rateProfileStats(s);
         case COL_WANSENDINGSTATS:
             return WANSendingStats(index);
         case COL_WANRECEIVINGSTATS:
@@ -142,12 +216,36 @@ QVariant UdpSenderListModel::headerData(int section, Qt::Orientation orientation
             return "DSCP Value";
         case COL_BANDWIDTH:
             return NetworkModel::layerShortName(m_BandwidthLayer) + " spec. Bandwidth";
+        case COL_PROFILE:
+            return "Rate profile";
         case COL_PORT:
             return "UDP Port";
         case COL_SIZE:
             return NetworkModel::layerShortName(m_PDUSizeLayer) + " spec. PDU Size";
+        case COL_SIZEMIX:
+            return NetworkModel::layerShortName(m_PDUSizeLayer) + " Size mix";
+        case COL_PAYLOAD:
+            return "Payload";
         case COL_TC:
             return "Tc (msec)";
+        case COL_TXBATCH:
+            return "TX batch";
+        case COL_RXBUDGET:
+            return "RX budget";
+        case COL_GSO:
+            return "UDP GSO";
+        case COL_GRO:
+            return "UDP GRO";
+        case COL_TIMESTAMPING:
+            return "Kernel timestamps";
+        case COL_CRC32C:
+            return "CRC32C";
+        case COL_PACING:
+            return "Pacing";
+        case COL_BACKEND:
+            return "I/O backend";
+        case COL_PLACEMENT:
+            return "Worker";
         case COL_SENDINGSTATS:
             return "LAN sending BW";
         case COL_RECEIVINGSTATS:
@@ -156,6 +254,12 @@ QVariant UdpSenderListModel::headerData(int section, Qt::Orientation orientation
             return "Packets Sent";
         case COL_RECEIVINGPACKETS:
             return "Packets Received";
+        case COL_LATENCY:
+            return "Latency (µs)";
+        case COL_JITTER:
+            return "Jitter (µs)";
+        case COL_PROFILESTATS:
+            return NetworkModel::layerShortName(m_BandwidthLayer) + " Profile steps";
         case COL_WANSENDINGSTATS:
             return "WAN sending BW";
         case COL_WANRECEIVINGSTATS:
@@ -172,12 +276,40 @@ bool UdpSenderListModel::setData(const QModelIndex &index, const QVariant &value
     if (index.row() > m_udpSenderList.count())
         return false;
 
+    if (role == Qt::CheckStateRole) {
+        bool checked = (static_cast<Qt::CheckState>(value.toInt()) == Qt::Checked);
+        switch (index.column()) {
+            case COL_GSO:
+                m_udpSenderList[index.row()]->setUdpGso(checked);
+                emit dataChanged(index, index);
+                return true;
+                break;
+            case COL_GRO:
+                m_udpSenderList[index.row()]->setUdpGro(checked);
+                emit dataChanged(index, index);
+                return true;
+                break;
+            case COL_TIMESTAMPING:
+                m_udpSenderList[index.row()]->setTimestamping(checked);
+                emit dataChanged(index, index);
+                return true;
+                break;
+            case COL_CRC32C:
+                m_udpSenderList[index.row()]->setCrc32c(checked);
+                emit dataChanged(index, index);
+                return true;
+                break;
+        }
+        return false;
+    }
+
     if (role != Qt::EditRole) {
         return false;
     }
 
     QLocale locale;
     QString stringValue = value.toString();
+    NetworkModel::SizeMix sizeMix;
 
     switch (index.column()) {
         case COL_NAME:
@@ -191,7 +323,14 @@ bool UdpSenderListModel::setData(const QModelIndex &index, const QVariant &value
             return true;
             break;
         case COL_BANDWIDTH:
-            m_udpSenderList[index.row()]->setBandwidth(locale.toDouble(stringValue) * m_BandwidthUnit, m_BandwidthLayer);
+            m_udpSenderList[index.row()]->setBandwidth(qRound64(locale.toDouble(stringValue) * m_BandwidthUnit), m_BandwidthLayer);
+            emit dataChanged(index, index);
+            return true;
+            break;
+        case COL_PROFILE:
+            if (!m_udpSenderList[index.row()]->setRateProfile(stringValue, m_BandwidthLayer)) {
+                return false;
+            }
             emit dataChanged(index, index);
             return true;
             break;
@@ -205,8 +344,51 @@ bool UdpSenderListModel::setData(const QModelIndex &index, const QVariant &value
             emit dataChanged(index, index);
             return true;
             break;
+        case COL_SIZEMIX:
+            // The simple IMIX, given at Ethernet layer 2
+            if (stringValue.trimmed().toLower() == "imix") {
+                sizeMix << qMakePair(64u, 7u) << qMakePair(594u, 4u) << qMakePair(1518u, 1u);
+                m_udpSenderList[index.row()]->setSizeMix(sizeMix, NetworkModel::EthernetLayer2);
+            } else if (parseSizeMix(stringValue, sizeMix)) {
+                m_udpSenderList[index.row()]->setSizeMix(sizeMix, m_PDUSizeLayer);
+            } else {
+                return false;
+            }
+            emit dataChanged(index, index);
+            return true;
+            break;
         case COL_TC:
-            m_udpSenderList[index.row()]->setTcMsec(value.toUInt());
+            m_udpSenderList[index.row()]->setTcUsec(qRound(locale.toDouble(stringValue) * 1000));
+            emit dataChanged(index, index);
+            return true;
+            break;
+        case COL_TXBATCH:
+            m_udpSenderList[index.row()]->setTxBatchSize(value.toUInt());
+            emit dataChanged(index, index);
+            return true;
+            break;
+        case COL_RXBUDGET:
+            m_udpSenderList[index.row()]->setRxDrainBudget(value.toUInt());
+            emit dataChanged(index, index);
+            return true;
+            break;
+        case COL_PAYLOAD:
+            m_udpSenderList[index.row()]->setPayloadMode(PayloadGenerator::modeFromName(stringValue));
+            emit dataChanged(index, index);
+            return true;
+            break;
+        case COL_PACING:
+            m_udpSenderList[index.row()]->setPacingMode(UdpFlow::pacingModeFromName(stringValue));
+            emit dataChanged(index, index);
+            return true;
+            break;
+        case COL_BACKEND:
+            if (UdpIoBackend::backendFromName(stringValue) == UdpIoBackend::AfXdpBackend && otherXdpFlow(index.row())) {
+                emit flowRefused("Only one flow can use af_xdp: it binds queue " + QString::number(UdpXdpBackend::XDP_QUEUE_ID)
+                                 + " of the interface and attaches the XDP program.");
+                return false;
+            }
+            m_udpSenderList[index.row()]->setIoBackend(UdpIoBackend::backendFromName(stringValue));
             emit dataChanged(index, index);
             return true;
             break;
@@ -221,16 +403,28 @@ Qt::ItemFlags UdpSenderListModel::flags(const QModelIndex &index) const
         return Qt::ItemIsEnabled;
 
     // These columns are not editable
-    if (index.column() == COL_SENDINGSTATS
+    if (index.column() == COL_PLACEMENT
+            || index.column() == COL_SENDINGSTATS
             || index.column() == COL_RECEIVINGSTATS
             || index.column() == COL_SENDINGPACKETS
             || index.column() == COL_RECEIVINGPACKETS
+            || index.column() == COL_LATENCY
+            || index.column() == COL_JITTER
+            || index.column() == COL_PROFILESTATS
             || index.column() == COL_WANSENDINGSTATS
             || index.column() == COL_WANRECEIVINGSTATS
             ) {
         return Qt::ItemIsSelectable;
     }
 
+    // These columns are check boxes
+    if (index.column() == COL_GSO
+            || index.column() == COL_GRO
+            || index.column() == COL_TIMESTAMPING
+            || index.column() == COL_CRC32C) {
+        return QAbstractItemModel::flags(index) | Qt::ItemIsUserCheckable;
+    }
+
     if (m_isGeneratingTraffic) {
         if (index.column() == COL_PORT) {
             // These Columns can not be edited while generating trafic
@@ -254,10 +448,13 @@ bool UdpSenderListModel::insertRows(int position, int rows, const QModelIndex &/
         sender = new UdpSender();
         sender->setDestination(m_destination);
         sender->setWANLayerModel(m_WANLayerModel);
+        sender->setStatsIntervalMsec(m_statsIntervalMsec);
+        sender->setLossTimeoutMsec(m_lossTimeoutMsec);
+        sender->setMtu(m_mtu);
 
         m_udpSenderList.insert(position, sender);
         if (m_isGeneratingTraffic) {
-            sender->startTraffic();
+            sender->startTraffic(m_scheduler.leastLoadedThread());
         }
     }
 
@@ -347,16 +544,100 @@ void UdpSenderListModel::generateTraffic()
     // Refresh the Table
     emit dataChanged(index(0, 0), index(rowCount()-1, columnCount()-1));
 
-    /* Starts to generate Traffic */
+    /* Starts to generate Traffic. Each flow goes to the least loaded worker thread */
     foreach (sender, m_udpSenderList) {
-        sender->startTraffic();
+        sender->startTraffic(m_scheduler.leastLoadedThread());
     }
     m_isGeneratingTraffic = true;
 }
 
+void UdpSenderListModel::setWorkerCount(int count)
+{
+    m_scheduler.setThreadCount(count);
+}
+
+int UdpSenderListModel::workerCount()
+{
+    return m_scheduler.threadCount();
+}
+
+void UdpSenderListModel::setSeparateReceive(bool enabled)
+{
+    m_scheduler.setSeparateReceive(enabled);
+}
+
+bool UdpSenderListModel::separateReceive()
+{
+    return m_scheduler.separateReceive();
+}
+
+void UdpSenderListModel::setCpuPolicy(QString policy)
+{
+    m_scheduler.setCpuPolicy(policy);
+}
+
+QString UdpSenderListModel::cpuPolicy()
+{
+    return m_scheduler.cpuPolicy();
+}
+
+void UdpSenderListModel::setStatsIntervalMsec(int msec)
+{
+    UdpSender *sender;
+
+    m_statsIntervalMsec = qBound(UdpFlow::MIN_STATS_INTERVAL_MSEC, msec, UdpFlow::MAX_STATS_INTERVAL_MSEC);
+    m_statsTimer->setInterval(m_statsIntervalMsec);
+
+    foreach (sender, m_udpSenderList) {
+        sender->setStatsIntervalMsec(m_statsIntervalMsec);
+    }
+}
+
+int UdpSenderListModel::statsIntervalMsec()
+{
+    return m_statsIntervalMsec;
+}
+
+void UdpSenderListModel::setLossTimeoutMsec(int msec)
+{
+    UdpSender *sender;
+
+    m_lossTimeoutMsec = qBound(UdpFlow::MIN_LOSS_TIMEOUT_MSEC, msec, UdpFlow::MAX_LOSS_TIMEOUT_MSEC);
+
+    foreach (sender, m_udpSenderList) {
+        sender->setLossTimeoutMsec(m_lossTimeoutMsec);
+    }
+}
+
+int UdpSenderListModel::lossTimeoutMsec()
+{
+    return m_lossTimeoutMsec;
+}
+
+void UdpSenderListModel::setMtu(uint mtu)
+{
+    UdpSender *sender;
+
+    m_mtu = qBound(NetworkModel::MIN_MTU, mtu, NetworkModel::MAX_MTU);
+
+    foreach (sender, m_udpSenderList) {
+        sender->setMtu(m_mtu);
+    }
+    // The packet sizes may have been cut
+    if (!m_udpSenderList.isEmpty()) {
+        emit dataChanged(index(0, COL_SIZE), index(m_udpSenderList.count() - 1, COL_SIZEMIX));
+    }
+}
+
+uint UdpSenderListModel::mtu()
+{
+    return m_mtu;
+}
+
 void UdpSenderListModel::setDestinationIP(QHostAddress destinationIP)
 {
     m_destination = destinationIP;
+    m_scheduler.setDestination(destinationIP);
 
     UdpSender *sender;
     foreach (sender, m_udpSenderList) {
@@ -381,7 +662,7 @@ QString UdpSenderListModel::totalSendingStats()
     UdpSender *s;
     QLocale l;
     qreal bw;
-    int pps;
+    qint64 pps;
 
     bw = 0;
     foreach (s, m_udpSenderList) {
@@ -434,7 +715,7 @@ QString UdpSenderListModel::totalReceivingStats()
     UdpSender *s;
     QLocale l;
     qreal bw;
-    int pps;
+    qint64 pps;
 
     bw = 0;
     foreach (s, m_udpSenderList) {
@@ -487,30 +768,209 @@ QString UdpSenderListModel::totalPacketsStats()
     UdpSender *s;
     QLocale l;
 
-    int packetsSent = 0;
+    quint64 packetsSent = 0;
     foreach (s, m_udpSenderList) {
         packetsSent += s->packetsSent();
     }
 
-    int packetsReceived = 0;
+    quint64 packetsReceived = 0;
     foreach (s, m_udpSenderList) {
         packetsReceived += s->packetsReceived();
     }
 
-    int packetsLost = 0;
+    quint64 packetsLost = 0;
     foreach (s, m_udpSenderList) {
         packetsLost += s->packetLost();
     }
 
+    quint64 packetsReordered = 0;
+    quint64 packetsDuplicated = 0;
+    quint64 packetsLate = 0;
+    quint64 packetsCorrupted = 0;
+    foreach (s, m_udpSenderList) {
+        packetsReordered += s->packetsReordered();
+        packetsDuplicated += s->packetsDuplicated();
+        packetsLate += s->packetsLate();
+        packetsCorrupted += s->packetsCorrupted();
+    }
+
     qreal percent = (qreal) packetsLost * 100 / packetsSent;
 
     tmpText += "Packets sent: " + l.toString(packetsSent) + "\n";
     tmpText += "Packets received: " + l.toString(packetsReceived) + "\n";
     tmpText += "Packets lost: " + l.toString(packetsLost) + "\n";
-    tmpText += "Percent lost: " + l.toString(percent) + "%";
+    tmpText += "Percent lost: " + l.toString(percent) + "%\n";
+    tmpText += "Reordered: " + l.toString(packetsReordered) + "\n";
+    tmpText += "Duplicated: " + l.toString(packetsDuplicated) + "\n";
+    tmpText += "Late: " + l.toString(packetsLate) + "\n";
+    tmpText += "Corrupted: " + l.toString(packetsCorrupted);
+    return tmpText;
+}
+
+QString UdpSenderListModel::totalLatencyStats()
+{
+    UdpSender *s;
+    LatencyHistogram histogram;
+    LatencyHistogram networkHistogram;
+    quint64 networkMissed = 0;
+
+    foreach (s, m_udpSenderList) {
+        histogram.merge(s->latencyHistogram());
+        networkHistogram.merge(s->networkLatencyHistogram());
+        networkMissed += s->networkLatencyMissed();
+    }
+
+    return latencyText(histogram, networkHistogram, networkMissed);
+}
+
+/*
+ * Percentiles of the latencies of one stats interval, in µs.
+ * The percentiles are the upper bound of their histogram bucket (at most 3 % too high).
+ * With kernel timestamps, the network part follows, and the average time spent in our host,
+ * then the count of echoes whose send timestamp was overwritten before they came back.
+ */
+QString UdpSenderListModel::latencyText(const LatencyHistogram &histogram, const LatencyHistogram &networkHistogram,
+                                        quint64 networkMissed)
+{
+    QString tmpText = "";
+    QLocale l;
+
+    if (histogram.count() == 0) {
+        return "No echo";
+    }
+
+    tmpText += "p50 " + l.toString((qreal) histogram.percentileNsec(50) / 1000, 'f', 1) + "\n";
+    tmpText += "p90 " + l.toString((qreal) histogram.percentileNsec(90) / 1000, 'f', 1) + "\n";
+    tmpText += "p99 " + l.toString((qreal) histogram.percentileNsec(99) / 1000, 'f', 1) + "\n";
+    tmpText += "p99.9 " + l.toString((qreal) histogram.percentileNsec(99.9) / 1000, 'f', 1) + "\n";
+    tmpText += "max " + l.toString((qreal) histogram.maxNsec() / 1000, 'f', 1);
+
+    if (networkHistogram.count() > 0) {
+        tmpText += "\nNetwork p50 " + l.toString((qreal) networkHistogram.percentileNsec(50) / 1000, 'f', 1) + "\n";
+        tmpText += "Network p99 " + l.toString((qreal) networkHistogram.percentileNsec(99) / 1000, 'f', 1) + "\n";
+        tmpText += "Network max " + l.toString((qreal) networkHistogram.maxNsec() / 1000, 'f', 1) + "\n";
+        tmpText += "Host avg " + l.toString((qreal) ((qint64) histogram.meanNsec() - (qint64) networkHistogram.meanNsec()) / 1000, 'f', 1);
+    }
+    if (networkMissed > 0) {
+        tmpText += "\nNetwork missed " + l.toString(networkMissed);
+    }
+    return tmpText;
+}
+
+/*
+ * Target and achieved bandwidth of the last step of the rate profile which ended, and the step which
+ * reached the smallest part of its target among the steps kept by the sender.
+ */
+QString UdpSenderListModel::rateProfileStats(UdpSender *sender) const
+{
+    const QList<UdpRateStepStats> &steps = sender->rateSteps();
+    UdpRateStepStats step;
+    QString tmpText = "";
+    QLocale l;
+    qreal seconds;
+    qreal percent;
+    qreal worstPercent = -1;
+    int worstStep = 0;
+
+    if (sender->rateProfile().isEmpty()) {
+        return "";
+    }
+    if (steps.isEmpty()) {
+        return "No step ended";
+    }
+
+    foreach (step, steps) {
+        if (step.packetsTarget >= 1) {
+            percent = step.packetsSent * 100 / step.packetsTarget;
+            if (worstPercent < 0 || percent < worstPercent) {
+                worstPercent = percent;
+                worstStep = step.step;
+            }
+        }
+    }
+
+    step = steps.last();
+    seconds = (qreal) (step.nsecEnd - step.nsecStart) / 1000000000;
+    tmpText += "Step " + l.toString(step.step + 1) + " pass " + l.toString(step.pass + 1) + "\n";
+    tmpText += "Target " +
+      l.toString((qreal) sender->bandwidthOfPps(step.packetsTarget / seconds, m_BandwidthLayer) / m_BandwidthUnit, 'f', 2) + "\n";
+    tmpText += "Achieved " +
+      l.toString((qreal) sender->bandwidthOfPps(step.packetsSent / seconds, m_BandwidthLayer) / m_BandwidthUnit, 'f', 2);
+    if (step.packetsTarget >= 1) {
+        tmpText += " (" + l.toString(step.packetsSent * 100 / step.packetsTarget, 'f', 1) + "%)";
+    }
+    if (worstPercent >= 0) {
+        tmpText += "\nWorst step " + l.toString(worstStep + 1) + ": " + l.toString(worstPercent, 'f', 1) + "%";
+    }
     return tmpText;
 }
 
+bool UdpSenderListModel::otherXdpFlow(int row) const
+{
+    for (int i = 0; i < m_udpSenderList.count(); i++) {
+        if (i != row && m_udpSenderList[i]->ioBackend() == UdpIoBackend::AfXdpBackend) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * The text is also saved in the project file, so the numbers are not localised.
+ */
+QString UdpSenderListModel::sizeMixText(const NetworkModel::SizeMix &mix)
+{
+    QStringList entries;
+    QPair<uint, uint> entry;
+
+    foreach (entry, mix) {
+        entries.append(QString::number(entry.first) + ":" + QString::number(entry.second));
+    }
+    return entries.join(", ");
+}
+
+/*
+ * An empty text is a valid mix: the flow sends its specified PDU size again.
+ * At most MAX_SIZE_MIX_ENTRIES sizes, weights from 1 to MAX_SIZE_MIX_WEIGHT.
+ */
+bool UdpSenderListModel::parseSizeMix(const QString &text, NetworkModel::SizeMix &mix)
+{
+    QStringList entries = text.trimmed().split(',');
+    QStringList fields;
+    QString entry;
+    uint size;
+    uint weight;
+    bool ok;
+
+    mix.clear();
+    if (text.trimmed().isEmpty()) {
+        return true;
+    }
+    if (entries.count() > MAX_SIZE_MIX_ENTRIES) {
+        return false;
+    }
+
+    foreach (entry, entries) {
+        fields = entry.split(':');
+        if (fields.count() > 2) {
+            return false;
+        }
+        size = fields[0].trimmed().toUInt(&ok);
+        if (!ok || size == 0) {
+            return false;
+        }
+        weight = 1;
+        if (fields.count() == 2) {
+            weight = fields[1].trimmed().toUInt(&ok);
+            if (!ok || weight == 0 || weight > MAX_SIZE_MIX_WEIGHT) {
+                return false;
+            }
+        }
+        mix.append(qMakePair(size, weight));
+    }
+    return true;
+}
+
 QString UdpSenderListModel::WANSendingStats(const QModelIndex &index) const
 {
     UdpSender *s = m_udpSenderList[index.row()];
@@ -521,7 +981,7 @@ QString UdpSenderListModel::WANSendingStats(const QModelIndex &index) const
         return "WAN Model not initialised";
     }
 
-    QList <int> bwList = s->WANsendingBandwidth();
+    QList <quint64> bwList = s->WANsendingBandwidth();
     QList <QString> nameList = m_WANLayerModel->layerShortNameList();
     QList <bool> displayStatList = m_WANLayerModel->displayStatList();
 
@@ -558,7 +1018,7 @@ QString UdpSenderListModel::WANReceivingStats(const QModelIndex &index) const
         return "WAN Model not initialised";
     }
 
-    QList <int> bwList = s->WANreceivingBandwidth();
+    QList <quint64> bwList = s->WANreceivingBandwidth();
     QList <QString> nameList = m_WANLayerModel->layerShortNameList();
     QList <bool> displayStatList = m_WANLayerModel->displayStatList();
 
@@ -590,8 +1050,8 @@ QString UdpSenderListModel::WANtotalReceivingStats()
     UdpSender *s;
     QList <QString> nameList = m_WANLayerModel->layerShortNameList();
     QList <bool> displayStatList = m_WANLayerModel->displayStatList();
-    QList <int> bwListTotal;
-    QList <int> bwList;
+    QList <quint64> bwListTotal;
+    QList <quint64> bwList;
     int i;
 
     int count = nameList.count();
@@ -639,8 +1099,8 @@ QString UdpSenderListModel::WANtotalSendingStats()
     UdpSender *s;
     QList <QString> nameList = m_WANLayerModel->layerShortNameList();
     QList <bool> displayStatList = m_WANLayerModel->displayStatList();
-    QList <int> bwListTotal;
-    QList <int> bwList;
+    QList <quint64> bwListTotal;
+    QList <quint64> bwList;
     int i;
 
     int count = nameList.count();
@@ -689,6 +1149,13 @@ void UdpSenderListModel::saveParameter(QSettings &settings)
     const int rowCount = m_udpSenderList.count();
     UdpSender *sender;
 
+    settings.setValue("workers", workerCount());
+    settings.setValue("rxthread", separateReceive());
+    settings.setValue("cpus", cpuPolicy());
+    settings.setValue("statsinterval", statsIntervalMsec());
+    settings.setValue("losstimeout", lossTimeoutMsec());
+    settings.setValue("mtu", mtu());
+
     settings.beginWriteArray("Flows");
 
     for (row = 0; row < rowCount ; row++) {
@@ -699,7 +1166,20 @@ void UdpSenderListModel::saveParameter(QSettings &settings)
         settings.setValue("bandwidth", sender->specifiedBandwidth(m_BandwidthLayer));
         settings.setValue("dscp", sender->dscp());
         settings.setValue("size", sender->specifiedPduSize(m_PDUSizeLayer));
-        settings.setValue("tc", sender->tcMsec());
+        settings.setValue("sizemix", sizeMixText(sender->sizeMix(m_PDUSizeLayer)));
+        settings.setValue("profile", sender->rateProfile());
+        // "tc" (msec) is kept for older versions of wanperf
+        settings.setValue("tc", qMax(sender->tcUsec() / 1000, 1u));
+        settings.setValue("tcusec", sender->tcUsec());
+        settings.setValue("txbatch", sender->txBatchSize());
+        settings.setValue("rxbudget", sender->rxDrainBudget());
+        settings.setValue("gso", sender->udpGso());
+        settings.setValue("gro", sender->udpGro());
+        settings.setValue("timestamping", sender->timestamping());
+        settings.setValue("crc32c", sender->crc32c());
+        settings.setValue("pacing", UdpFlow::pacingModeName(sender->pacingMode()));
+        settings.setValue("payload", PayloadGenerator::modeName(sender->payloadMode()));
+        settings.setValue("backend", UdpIoBackend::backendName(sender->ioBackend()));
     }
 
     settings.endArray();
@@ -709,6 +1189,9 @@ void UdpSenderListModel::loadParameter(QSettings &settings)
 {
     int row;
     UdpSender *sender;
+    NetworkModel::SizeMix sizeMix;
+    UdpIoBackend::Backend backend;
+    QStringList refusedXdpFlows;
 
     // Tell the model that we will change all the data
     beginResetModel();
@@ -718,6 +1201,12 @@ void UdpSenderListModel::loadParameter(QSettings &settings)
     // then remove them from the list
     m_udpSenderList.clear();
 
+    setWorkerCount(settings.value("workers", 0).toInt());
+    setSeparateReceive(settings.value("rxthread", false).toBool());
+    setCpuPolicy(settings.value("cpus", "").toString());
+    setStatsIntervalMsec(settings.value("statsinterval", 1000).toInt());
+    setLossTimeoutMsec(settings.value("losstimeout", 2000).toInt());
+    setMtu(settings.value("mtu", NetworkModel::DEFAULT_MTU).toUInt());
 
     const int rowCount = settings.beginReadArray("Flows");
 
@@ -727,12 +1216,40 @@ void UdpSenderListModel::loadParameter(QSettings &settings)
         sender = new UdpSender();
         sender->setDestination(m_destination);
         sender->setWANLayerModel(m_WANLayerModel);
+        sender->setStatsIntervalMsec(m_statsIntervalMsec);
+        sender->setLossTimeoutMsec(m_lossTimeoutMsec);
+        sender->setMtu(m_mtu);
 
         sender->setName(settings.value("name").toString());
-        sender->setBandwidth(settings.value("bandwidth").toUInt(), m_BandwidthLayer);
+        sender->setBandwidth(settings.value("bandwidth").toULongLong(), m_BandwidthLayer);
         sender->setDscp(settings.value("dscp").toUInt());
         sender->setPduSize(settings.value("size").toUInt(), m_BandwidthLayer);
-        sender->setTcMsec(settings.value("tc").toUInt());
+        // Empty (no mix) in projects saved before size mixes were introduced
+        if (parseSizeMix(settings.value("sizemix", "").toString(), sizeMix)) {
+            sender->setSizeMix(sizeMix, m_PDUSizeLayer);
+        }
+        // Empty (constant bandwidth) in projects saved before rate profiles were introduced.
+        // A trace which can not be read any more leaves the bandwidth constant.
+        sender->setRateProfile(settings.value("profile", "").toString(), m_BandwidthLayer);
+        // Projects saved before µsec Tc only contain "tc" in msec
+        sender->setTcUsec(settings.value("tcusec", settings.value("tc").toUInt() * 1000).toUInt());
+        // Projects saved before batching was introduced send one packet per system call
+        sender->setTxBatchSize(settings.value("txbatch", 1).toUInt());
+        // 0 = receive until the buffer is empty, as before the budget was introduced
+        sender->setRxDrainBudget(settings.value("rxbudget", 0).toUInt());
+        sender->setUdpGso(settings.value("gso", false).toBool());
+        sender->setUdpGro(settings.value("gro", false).toBool());
+        sender->setTimestamping(settings.value("timestamping", false).toBool());
+        sender->setCrc32c(settings.value("crc32c", false).toBool());
+        sender->setPacingMode(UdpFlow::pacingModeFromName(settings.value("pacing", "burst").toString()));
+        sender->setPayloadMode(PayloadGenerator::modeFromName(settings.value("payload", "zeros").toString()));
+        backend = UdpIoBackend::backendFromName(settings.value("backend", "socket").toString());
+        if (backend == UdpIoBackend::AfXdpBackend && otherXdpFlow(row)) {
+            // The flow keeps the socket backend
+            refusedXdpFlows.append(sender->name());
+        } else {
+            sender->setIoBackend(backend);
+        }
 
         m_udpSenderList.append(sender);
     }
@@ -741,10 +1258,36 @@ void UdpSenderListModel::loadParameter(QSettings &settings)
 
     // Tell the model that we are done with changing data
     endResetModel();
+
+    if (!refusedXdpFlows.isEmpty()) {
+        emit flowRefused("Only one flow can use af_xdp. These flows use the socket backend: " + refusedXdpFlows.join(", "));
+    }
 }
 
+/*
+ * Fetches the snapshots of all flows and shows all of them at the newest epoch every running
+ * flow reached. So the totals add up the rates of the same interval.
+ */
 void UdpSenderListModel::updateStats()
 {
-    emit dataChanged(index(0, COL_SENDINGSTATS), index(rowCount()-1, COL_RECEIVINGPACKETS));
+    UdpSender *sender;
+    qint64 epoch = -1;
+    qint64 senderEpoch;
+
+    foreach (sender, m_udpSenderList) {
+        senderEpoch = sender->updateStatistics();
+        if (senderEpoch >= 0 && (epoch < 0 || senderEpoch < epoch)) {
+            epoch = senderEpoch;
+        }
+    }
+
+    if (epoch >= 0) {
+        foreach (sender, m_udpSenderList) {
+            sender->selectStatistics(epoch);
+        }
+    }
+
+    emit dataChanged(index(0, COL_PLACEMENT), index(rowCount()-1, COL_PROFILESTATS));
+    emit statsUpdated();
 }
 
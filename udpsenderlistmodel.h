@@ -4,8 +4,10 @@
 #include <QAbstractTableModel>
 #include <QList>
 #include <QSettings>
+#include <QTimer>
 
 #include "udpsender.h"
+#include "udpsenderscheduler.h"
 #include "networkmodel.h"
 #include "networklayerlistmodel.h"
 
@@ -15,6 +17,7 @@ class UdpSenderListModel : public QAbstractTableModel
 
 public:
     explicit UdpSenderListModel(QObject *parent = nullptr);
+    ~UdpSenderListModel();
 
     // Basic functionality:
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
@@ -38,6 +41,25 @@ public:
     void generateTraffic();
     void stopAllSender();
 
+    // Count of worker threads running the flows, 0 = one per core
+    void setWorkerCount(int count);
+    int workerCount();
+    // Receive on a thread of its own for each worker thread
+    void setSeparateReceive(bool enabled);
+    bool separateReceive();
+    // CPUs of the worker threads: "" (floating), "auto" (NUMA node of the NIC) or a CPU list
+    void setCpuPolicy(QString policy);
+    QString cpuPolicy();
+    // Interval of the statistics, in msec. The flows take their snapshots at the same times.
+    void setStatsIntervalMsec(int msec);
+    int statsIntervalMsec();
+    // Packets which did not come back after this time are lost, in msec
+    void setLossTimeoutMsec(int msec);
+    int lossTimeoutMsec();
+    // IP MTU of the flows, in bytes: 1500, up to 9216 with jumbo frames
+    void setMtu(uint mtu);
+    uint mtu();
+
     void setDestinationIP(QHostAddress destinationIP);
 
     // Total Statistics are displayed in MainWindow and can not be private
@@ -45,6 +67,8 @@ public:
     QString totalSendingStats();
     QString totalReceivingStats();
     QString totalPacketsStats();
+    // Latency percentiles of all flows together
+    QString totalLatencyStats();
     QString WANtotalReceivingStats();
     QString WANtotalSendingStats();
 
@@ -56,27 +80,71 @@ public:
 private:
     QString WANSendingStats(const QModelIndex &index) const;
     QString WANReceivingStats(const QModelIndex &index) const;
+    static QString latencyText(const LatencyHistogram &histogram, const LatencyHistogram &networkHistogram,
+                               quint64 networkMissed);
+    QString rateProfileStats(UdpSender *sender) const;
+    // Size mix as text: "64:7, 594:4, 1518:1", a size without weight has weight 1
+    static QString sizeMixText(const NetworkModel::SizeMix &mix);
+    static bool parseSizeMix(const QString &text, NetworkModel::SizeMix &mix);
+    // True if a flow other than row uses the af_xdp backend: it owns the queue of the interface
+    bool otherXdpFlow(int row) const;
+
+    static const int MAX_SIZE_MIX_ENTRIES = 16;
+    static const uint MAX_SIZE_MIX_WEIGHT = 1000;
 
 
 public slots:
     void updateStats();
     void WANLayerModelChanged();
 
+signals:
+    // The statistics of the flows and the totals changed
+    void statsUpdated();
+    // A flow setting was refused, message tells why
+    void flowRefused(QString message);
+
 private:
+    // Worker threads running the flows
+    UdpSenderScheduler m_scheduler;
+
     QList<UdpSender *> m_udpSenderList;
 
     enum udpSenderColumns {
         COL_NAME, // 0
         COL_PORT,
         COL_BANDWIDTH,
+        // Rate profile: ramp, steps, burst or trace, relative to COL_BANDWIDTH
+        COL_PROFILE,
         COL_DSCP,
         COL_SIZE,
+        // Size mix (IMIX), overrides COL_SIZE
+        COL_SIZEMIX,
+        // Content of the payloads: zeros, pattern, random pool or unique
+        COL_PAYLOAD,
         COL_TC,
+        COL_TXBATCH,
+        COL_RXBUDGET,
+        COL_GSO,
+        COL_GRO,
+        // Kernel timestamps (SO_TIMESTAMPING)
+        COL_TIMESTAMPING,
+        // CRC32C trailer, checked on the echoes
+        COL_CRC32C,
+        COL_PACING,
+        COL_BACKEND,
+        // Worker thread and CPU running the flow
+        COL_PLACEMENT,
         /* Statistics */
         COL_SENDINGSTATS,
         COL_RECEIVINGSTATS,
         COL_SENDINGPACKETS,
         COL_RECEIVINGPACKETS,
+        // Latency percentiles of the echoes
+        COL_LATENCY,
+        // RFC 3550 jitter and RFC 5481 IPDV
+        COL_JITTER,
+        // Target and achieved bandwidth of the steps of the rate profile
+        COL_PROFILESTATS,
         COL_WANSENDINGSTATS,
         COL_WANRECEIVINGSTATS,
         // COL_COUNT has to be the last enumerator, as it is the count of columns
@@ -92,6 +160,11 @@ private:
 
     bool m_isGeneratingTraffic = false;
 
+    QTimer *m_statsTimer;
+    int m_statsIntervalMsec = 1000;
+    int m_lossTimeoutMsec = 2000;
+    uint m_mtu = NetworkModel::DEFAULT_MTU;
+
     QHostAddress m_destination;
 };
 
@@ -0,0 +1,155 @@
+#include "udpsenderscheduler.h"
+#include "cpuplacement.h"
+#include <QDebug>
+
+UdpSenderScheduler::UdpSenderScheduler()
+{
+}
+
+UdpSenderScheduler::~UdpSenderScheduler()
+{
+    // The threads close their flows when they are stopped
+    qDeleteAll(m_threads.begin(), m_threads.end());
+    m_threads.clear();
+}
+
+void UdpSenderScheduler::setThreadCount(int count)
+{
+    m_threadCount = qMax(count, 0);
+    m_poolChanged = true;
+}
+
+int UdpSenderScheduler::threadCount()
+{
+    return m_threadCount;
+}
+
+void UdpSenderScheduler::setSeparateReceive(bool enabled)
+{
+    m_separateReceive = enabled;
+    m_poolChanged = true;
+}
+
+bool UdpSenderScheduler::separateReceive()
+{
+    return m_separateReceive;
+}
+
+void UdpSenderScheduler::setCpuPolicy(QString policy)
+{
+    m_cpuPolicy = policy.trimmed().toLower();
+    m_poolChanged = true;
+}
+
+QString UdpSenderScheduler::cpuPolicy()
+{
+    return m_cpuPolicy;
+}
+
+void UdpSenderScheduler::setDestination(QHostAddress destination)
+{
+    m_destination = destination;
+    if (m_cpuPolicy == "auto") {
+        // The satellite may be reached through another NIC
+        m_poolChanged = true;
+    }
+}
+
+UdpSenderThread *UdpSenderScheduler::leastLoadedThread()
+{
+    UdpSenderThread *t_thread;
+    UdpSenderThread *t_best = NULL;
+
+    updatePool();
+
+    foreach (t_thread, m_threads) {
+        if (t_best == NULL
+                || t_thread->load() < t_best->load()
+                || (t_thread->load() == t_best->load() && t_thread->flowCount() < t_best->flowCount())) {
+            t_best = t_thread;
+        }
+    }
+
+    return t_best;
+}
+
+void UdpSenderScheduler::updatePool()
+{
+    UdpSenderThread *t_thread;
+    QList<int> t_cpus;
+    int t_node = -1;
+    int t_count = m_threadCount;
+    int t_cpu;
+    int t_rxCpu;
+
+    if (!m_poolChanged) {
+        return;
+    }
+    foreach (t_thread, m_threads) {
+        if (t_thread->flowCount() > 0) {
+            // Flows can not move to another thread while they run
+            return;
+        }
+    }
+
+    /* The CPUs we may use */
+    const QList<int> t_allowedCpus = CpuPlacement::allowedCpus();
+    if (m_cpuPolicy == "auto") {
+        const QString t_interface = CpuPlacement::routeInterface(m_destination);
+        t_node = CpuPlacement::interfaceNode(t_interface);
+        foreach (t_cpu, CpuPlacement::nodeCpus(t_node)) {
+            if (t_allowedCpus.contains(t_cpu)) {
+                t_cpus.append(t_cpu);
+            }
+        }
+        if (t_cpus.isEmpty()) {
+            // No NUMA information (virtual interface, single node): use all CPUs
+            t_node = -1;
+            t_cpus = t_allowedCpus;
+        }
+        qDebug() << "UdpSenderScheduler: interface" << t_interface << "node" << t_node
+                 << "CPUs" << CpuPlacement::cpuListName(t_cpus);
+    } else if (!m_cpuPolicy.isEmpty()) {
+        foreach (t_cpu, CpuPlacement::parseCpuList(m_cpuPolicy)) {
+            if (t_allowedCpus.contains(t_cpu)) {
+                t_cpus.append(t_cpu);
+            }
+        }
+        if (t_cpus.isEmpty()) {
+            qDebug() << "UdpSenderScheduler: no usable CPU in" << m_cpuPolicy << ", the threads float";
+        }
+    }
+
+    /* One thread per core: with a receiver thread, each worker takes two */
+    if (t_count == 0) {
+        if (t_cpus.isEmpty()) {
+            t_count = qMax(QThread::idealThreadCount(), 1);
+        } else {
+            t_count = m_separateReceive ? qMax(t_cpus.size() / 2, 1) : t_cpus.size();
+        }
+    }
+
+    while (m_threads.count() > t_count) {
+        delete m_threads.takeLast();
+    }
+    while (m_threads.count() < t_count) {
+        m_threads.append(new UdpSenderThread(m_threads.count()));
+    }
+
+    for (int i = 0; i < m_threads.count(); i++) {
+        t_cpu = -1;
+        t_rxCpu = -1;
+        if (!t_cpus.isEmpty()) {
+            if (m_separateReceive) {
+                t_cpu = t_cpus[(2 * i) % t_cpus.size()];
+                t_rxCpu = t_cpus[(2 * i + 1) % t_cpus.size()];
+            } else {
+                t_cpu = t_cpus[i % t_cpus.size()];
+            }
+        }
+        m_threads[i]->setSeparateReceive(m_separateReceive);
+        // With a CPU list, the node of the CPU of the thread
+        m_threads[i]->setPlacement(t_cpu, t_rxCpu, (t_node >= 0 || t_cpu < 0) ? t_node : CpuPlacement::cpuNode(t_cpu));
+    }
+    m_poolChanged = false;
+}
@@ -0,0 +1,56 @@
+#ifndef UDPSENDERSCHEDULER_H
+#define UDPSENDERSCHEDULER_H
+
+#include <QList>
+#include <QHostAddress>
+
+#include "udpsenderthread.h"
+
+/* The pool of worker threads running the flows.
+ *
+ * The flows are spread over the threads by their packet rate: a new flow goes to the thread
+ * with the lowest load. The threads start with their first flow.
+ * The pool is only changed while no flow is running.
+ */
+class UdpSenderScheduler
+{
+public:
+    UdpSenderScheduler();
+    ~UdpSenderScheduler();
+
+    // Count of worker threads, 0 = one per core (of the CPU policy)
+    void setThreadCount(int count);
+    int threadCount();
+    // Each thread gets a receiver thread, so that sending and receiving run on their own cores.
+    void setSeparateReceive(bool enabled);
+    bool separateReceive();
+    /* CPUs of the threads:
+     * - "" (default): the threads float, the kernel places them
+     * - "auto": the CPUs of the NUMA node of the NIC which reaches the satellite (all CPUs if unknown)
+     * - a CPU list, e.g. "0-3,8"
+     * Each thread (and each receiver thread) is pinned to one CPU of the list.
+     */
+    void setCpuPolicy(QString policy);
+    QString cpuPolicy();
+    // The satellite, used by the "auto" CPU policy
+    void setDestination(QHostAddress destination);
+
+    // The thread which should run the next flow
+    UdpSenderThread *leastLoadedThread();
+
+private:
+    Q_DISABLE_COPY(UdpSenderScheduler)
+
+    // Creates, deletes and places threads and receiver threads, if no flow is running
+    void updatePool();
+
+    QList<UdpSenderThread *> m_threads;
+    int m_threadCount = 0;
+    bool m_separateReceive = false;
+    QString m_cpuPolicy;
+    QHostAddress m_destination;
+    // The parameters changed since the pool was updated
+    bool m_poolChanged = true;
+};
+
+#endif // UDPSENDERSCHEDULER_H
@@ -1,287 +1,382 @@
 ﻿#include "udpsenderthread.h"
-#include <QDateTime>
-#include <QtEndian>
-#include <QtGlobal>
-#include <QList>
-
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <netinet/udp.h>
+#include "udpiouringbackend.h"
+#include "cpuplacement.h"
+#include <QHash>
+#include <QDebug>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
-#include <fcntl.h>
-#include <poll.h>
+#include <errno.h>
 
-UdpSenderThread::UdpSenderThread()
+void UdpFlowSchedule::insert(UdpFlow *flow)
 {
+    m_flows.append(flow);
+    place(flow, m_flows.size() - 1);
+    moveUp(flow->t_scheduleIndex);
 }
 
-void UdpSenderThread::setTos(quint8 tos)
+void UdpFlowSchedule::remove(UdpFlow *flow)
 {
-    if (isRunning()) {
-        // We don't change TOS while the Thread ist runing. First stop the thread
-        stop();
-        m_tos = tos;
-        this->start();
-    } else {
-        m_tos = tos;
+    const int i = flow->t_scheduleIndex;
+    UdpFlow *t_last = m_flows.last();
+
+    m_flows.removeLast();
+    flow->t_scheduleIndex = -1;
+    if (t_last != flow) {
+        // The last flow takes the free place
+        place(t_last, i);
+        update(t_last);
     }
 }
 
-void UdpSenderThread::setDatagramSDULength(int length)
+void UdpFlowSchedule::update(UdpFlow *flow)
 {
-    if (isRunning()) {
-        // We don't change SDU Length while the Thread ist running. First stop the thread
-        stop();
+    moveUp(flow->t_scheduleIndex);
+    moveDown(flow->t_scheduleIndex);
+}
 
-        m_datagramSDULength = length;
+void UdpFlowSchedule::dueFlows(qint64 nsecNow, QVector<UdpFlow *> &flows) const
+{
+    // The due flows form a tree from the first flow, as no flow is earlier than its parent
+    QVector<int> t_stack;
+    int i;
 
-        this->start();
-    } else {
-        m_datagramSDULength = length;
+    if (m_flows.isEmpty()) {
+        return;
+    }
+    t_stack.append(0);
+    while (!t_stack.isEmpty()) {
+        i = t_stack.takeLast();
+        if (m_flows[i]->nsecNextRun() > nsecNow) {
+            continue;
+        }
+        flows.append(m_flows[i]);
+        if (2 * i + 1 < m_flows.size()) {
+            t_stack.append(2 * i + 1);
+        }
+        if (2 * i + 2 < m_flows.size()) {
+            t_stack.append(2 * i + 2);
+        }
     }
 }
 
-void UdpSenderThread::setPpmsec(qreal ppmsec)
+void UdpFlowSchedule::moveUp(int i)
 {
-    if (isRunning()) {
-        // We don't change ppmsec while the Thread ist running. First Stop the thread
-        stop();
+    UdpFlow *t_flow = m_flows[i];
+    int t_parent;
 
-        m_ppmsec = ppmsec;
+    while (i > 0) {
+        t_parent = (i - 1) / 2;
+        if (m_flows[t_parent]->nsecNextRun() <= t_flow->nsecNextRun()) {
+            break;
+        }
+        place(m_flows[t_parent], i);
+        i = t_parent;
+    }
+    place(t_flow, i);
+}
 
-        this->start();
-    } else {
-        m_ppmsec = ppmsec;
+void UdpFlowSchedule::moveDown(int i)
+{
+    UdpFlow *t_flow = m_flows[i];
+    const int t_count = m_flows.size();
+    int t_child;
+
+    while (2 * i + 1 < t_count) {
+        t_child = 2 * i + 1;
+        if (t_child + 1 < t_count && m_flows[t_child + 1]->nsecNextRun() < m_flows[t_child]->nsecNextRun()) {
+            t_child++;
+        }
+        if (t_flow->nsecNextRun() <= m_flows[t_child]->nsecNextRun()) {
+            break;
+        }
+        place(m_flows[t_child], i);
+        i = t_child;
     }
+    place(t_flow, i);
 }
 
-bool UdpSenderThread::setPort(int port)
+UdpSenderThread::UdpSenderThread(int index)
+    : m_index(index)
 {
-    if (isRunning()) {
-        // We don't change the destination port while the thread is runing
-        //FIXME: this should be handled by the GUI
-        return false;
+    m_wakeFd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+}
+
+UdpSenderThread::~UdpSenderThread()
+{
+    // be sure to stop the thread or get a segfault.
+    stop();
+    delete m_receiver;
+    if (m_wakeFd >= 0) {
+        ::close(m_wakeFd);
+    }
+}
+
+void UdpSenderThread::setSeparateReceive(bool enabled)
+{
+    if (enabled == (m_receiver != NULL)) {
+        return;
     }
 
-    m_udpPort = port;
-    return true;
+    // The thread has to close its flows first, it starts again with the next flow
+    stop();
+    if (enabled) {
+        m_receiver = new UdpReceiverThread();
+        m_receiver->setPlacement(m_rxCpu, m_node);
+    } else {
+        delete m_receiver;
+        m_receiver = NULL;
+    }
 }
 
-bool UdpSenderThread::setDestination(QHostAddress address)
+void UdpSenderThread::setPlacement(int cpu, int rxCpu, int node)
 {
-    if (isRunning()) {
-        // We don't change the destination address while the thread is runing
-        //FIXME: this should be handled by the GUI
-        return false;
+    if (cpu == m_cpu && rxCpu == m_rxCpu && node == m_node) {
+        return;
     }
 
-    m_destination = address;
-    return true;
+    // The thread places itself when it starts again with the next flow
+    stop();
+    m_cpu = cpu;
+    m_rxCpu = rxCpu;
+    m_node = node;
+    if (m_receiver != NULL) {
+        m_receiver->setPlacement(m_rxCpu, m_node);
+    }
 }
 
-void UdpSenderThread::setTcMsec(uint tcMsec)
+QString UdpSenderThread::placement()
 {
-    // these guards should be enforced into the UI, be we have to be sure
-    // Tc cannot be zero
-    if (tcMsec < 1)
-        tcMsec = 1;
-    // Tc should not be superior to 1 second (or we may have to change some code like packet loss detection)
-    if (tcMsec > 1000)
-        tcMsec = 1000;
+    QString t_text = "#" + QString::number(m_index + 1);
 
     m_Mutex.lock();
-    m_tcMsec = tcMsec;
+    const int t_cpu = m_pinnedCpu;
+    const int t_node = m_preferredNode;
     m_Mutex.unlock();
 
-    if (isRunning()) {
-        // Restart the thread in order to re-read the variable
-        stop();
-        this->start();
+    t_text += (t_cpu >= 0) ? " CPU " + QString::number(t_cpu) : QString(" floating");
+    if (m_receiver != NULL) {
+        const int t_rxCpu = m_receiver->pinnedCpu();
+        t_text += (t_rxCpu >= 0) ? ", RX CPU " + QString::number(t_rxCpu) : QString(", RX floating");
     }
+    if (t_node >= 0) {
+        t_text += ", node " + QString::number(t_node);
+    }
+
+    return t_text;
 }
 
-void UdpSenderThread::stop()
+void UdpSenderThread::addFlow(UdpFlow *flow)
 {
-    if (isRunning()) {
-        m_Mutex.lock();
-        m_stopped = true;
-        m_Mutex.unlock();
+    m_Mutex.lock();
+    m_addedFlows.append(flow);
+    m_flowCount++;
+    m_load += flow->ppmsec();
+    m_Mutex.unlock();
 
-        // Make sure the thread is stoped
-        this->wait();
+    if (!isRunning()) {
+        this->start();
     }
+    wakeUp();
 }
 
-/*
- * I want this to be very fast, so we will read the parameters once with a Mutex.
- * If the parameter are changed, the main process has to restart the thread.
- *
- * All thread-internal variables are prefixed with t_
- * All shared variables (members of the object) are prefixed with m_
- *
- * This is a quite monolithic Thread. I avoided function calls in order to save
- * CPU cycles. I'm not sure this is a good idea, the code is difficult to read.
- *
- * The stats are sent with an emited signal, which is thread-safe.
- *
- * This is Linux-Only code. If someone wants to port to windows, here are
- * hints for Sockets with Linux & Windows:
- * https://handsonnetworkprogramming.com/articles/socket-error-message-text/
- */
-
-void UdpSenderThread::run()
+void UdpSenderThread::removeFlow(UdpFlow *flow)
 {
-    /********************************************************************
-    * Create a Socket and bind it
-    *********************************************************************/
-    int t_udpSocket = socket(AF_INET, SOCK_DGRAM, 0);
-    if (t_udpSocket < 0) {
-        qDebug() << "UdpSenderThread::run: could not open the socket";
-    }
-
     m_Mutex.lock();
-    int t_result = setsockopt(t_udpSocket, IPPROTO_IP, IP_TOS,
-                              (char *)&m_tos, sizeof (m_tos));
-    if (t_result < 0) {
-        qDebug() << "UdpSenderThread::run: could not set TOS";
-        close(t_udpSocket);
+    m_flowCount--;
+    m_load = (m_flowCount > 0) ? m_load - flow->ppmsec() : 0;
+    if (m_addedFlows.removeAll(flow) > 0 || !isRunning()) {
+        // The thread did not open the flow yet
+        m_Mutex.unlock();
         return;
     }
+    m_removedFlows.append(flow);
     m_Mutex.unlock();
 
-    /* We do not specify from which port we send, and bind to any interface or
-     * any IP on the computer
-     * We bind in order to receive the response from the satellite (udpecho)
-     */
-    struct sockaddr_in t_myAddress;
-    memset(&t_myAddress, 0, sizeof(struct sockaddr_in));
-    t_myAddress.sin_family = AF_INET;
-    t_myAddress.sin_addr.s_addr = INADDR_ANY;
-    t_result = bind(t_udpSocket,
-                    (struct sockaddr *)&t_myAddress, sizeof (t_myAddress));
-    if (t_result < 0) {
-        qDebug() << "UdpSenderThread::run: could not bind the socket";
-        close(t_udpSocket);
-        return;
-    }
+    wakeUp();
 
-    /* We need the socket to be non blocking, so that we can send while no
-     * packets to write and vice versa */
-    t_result = fcntl(t_udpSocket, F_SETFL, O_NONBLOCK);
-    if (t_result < 0) {
-        qDebug() << "UdpSenderThread::run: could not set the socket non-blocking";
-        close(t_udpSocket);
-        return;
+    // Wait until the thread closed the flow
+    m_Mutex.lock();
+    while (m_removedFlows.contains(flow)) {
+        m_flowsRemoved.wait(&m_Mutex);
     }
+    m_Mutex.unlock();
+}
+
+int UdpSenderThread::flowCount()
+{
+    int t_count;
 
-    /********************************************************************
-    * Create the address structures to reach the satellite (udpecho)
-    *********************************************************************/
-    struct sockaddr_in t_destAddress;
-    memset(&t_destAddress, 0, sizeof(struct sockaddr_in));
-    t_destAddress.sin_family = AF_INET;
     m_Mutex.lock();
-    t_destAddress.sin_addr.s_addr=htonl(m_destination.toIPv4Address());
-    t_destAddress.sin_port=htons(m_udpPort);
+    t_count = m_flowCount;
     m_Mutex.unlock();
-    const socklen_t t_destAddressLen = sizeof (t_destAddress);
-
 
-    /********************************************************************
-    * Now initialise many variables
-    *********************************************************************/
-    // Current Time, ckecked frequently
-    qint64 t_msecNow = QDateTime::currentMSecsSinceEpoch();
-    // time differences
-    qint64 t_msecDelta = 0;
+    return t_count;
+}
 
+qreal UdpSenderThread::load()
+{
+    qreal t_load;
 
-    // Tc (Time Commited): Time interval in which to send the packets
-    const qint64 t_msecTc = m_tcMsec;
-    // Bc (Burst Commited): Packets to send per Time interval
     m_Mutex.lock();
-    qint64 t_packetsBc = t_msecTc * m_ppmsec;
+    t_load = m_load;
     m_Mutex.unlock();
 
-    /* keep track how much packets we have to send */
-    int t_packetBucket = t_packetsBc;
-
-    // used to check the response from recv() and sendto()
-    ssize_t t_packetSize;
-
-    /* keep track when to refill the bucket */
-    qint64 t_msecNextRefill = t_msecNow + t_msecTc;
+    return t_load;
+}
 
+void UdpSenderThread::updateLoad(qreal oldPpmsec, qreal newPpmsec)
+{
     m_Mutex.lock();
-    const int t_datagramSDULength = m_datagramSDULength;
+    m_load += newPpmsec - oldPpmsec;
     m_Mutex.unlock();
+}
+
+void UdpSenderThread::stop()
+{
+    if (isRunning()) {
+        m_Mutex.lock();
+        m_stopped = true;
+        m_Mutex.unlock();
 
-    /* Our Datagram payloads for sending and receiving */
-    char t_datagramSend[t_datagramSDULength];
-    memset(t_datagramSend, 0, t_datagramSDULength);
-
-    char t_datagramReceive[t_datagramSDULength];
-    memset(t_datagramReceive, 0, t_datagramSDULength);
-
-    /* We keep track of the count of packets sended in order to detect packet loss
-     * We store the t_sendingCounter directly into the datagram to be send / received,
-     * so we do not have to copy them to/from there.
-    */
-    quint64 *t_sendingCounter = reinterpret_cast<quint64 *>(t_datagramSend + 8);
-    quint64 *t_returnedCounter = reinterpret_cast<quint64 *>(t_datagramReceive + 8);
-
-    // Packet counter we are waitung for
-    quint64 t_counterAwaited = 0;
-    // delta between awaited counter and received counter
-    int t_counterDelta;
-    /* We keep track of the time the packet was send in order to measure latency
-     * We store the t_sendingTime directly into the datagram to be send / received,
-     * so we do not have to copy them to/from there.
-    */
-    qint64 *t_sendingTime = reinterpret_cast<qint64 *>(t_datagramSend);
-    qint64 *t_returnedTime = reinterpret_cast<qint64 *>(t_datagramReceive);
-
-    // Stats
-    int t_statsPacketsReceived = 0;
-    int t_statsPacketsLost = 0;
-    int t_statsPacketsNotSent = 0;
-
-    // We consider packets that did not come back after 2 seconds as lost.
-    // For this we have to keep track of the packet counters 2 seconds.
-    // As we check each Tc, we need an history of (2 seconds / Tc) counters
-    QList<quint64> t_counterHistory;
-    int t_counterHistoryLength = 2000 / t_msecTc;
-    while (t_counterHistoryLength > 0) {
-        t_counterHistory.append(*t_sendingCounter);
-        t_counterHistoryLength--;
+        wakeUp();
+        // Make sure the thread is stoped
+        this->wait();
     }
-    quint64 t_counterTimedOut;
+}
 
-    quint64 t_latency;
-    quint64 t_statsCummuledLatency = 0;
+void UdpSenderThread::wakeUp()
+{
+    const quint64 t_one = 1;
+    if (write(m_wakeFd, &t_one, sizeof (t_one)) < 0) {
+        // The counter is already set, the thread will wake up anyway
+    }
+}
 
-    const qint64 t_statsReportInterval = 1000;
-    // Report stats before next Tc. Doing so 1 ms before Tc makes stats less jumpy
-    qint64 t_statNextTime = t_msecNow + t_statsReportInterval - 1;
+/* Runs the flow and moves it in the schedule */
+void UdpSenderThread::runFlow(UdpFlow *flow, UdpFlowSchedule &schedule, int epollFd)
+{
+    flow->process(UdpFlow::monotonicNsec());
+    flow->backend()->flush();
+    schedule.update(flow);
+    watchFlow(flow, epollFd);
+}
+
+/* Watches the file descriptor of the backend of the flow: for receiving, unless a receiver
+ * thread does it, and for sending with burst pacing and full buffers.
+ */
+void UdpSenderThread::watchFlow(UdpFlow *flow, int epollFd)
+{
+    struct epoll_event t_event;
+    quint32 t_pollEvents = 0;
 
+    const int t_pollFd = flow->backend()->pollFd();
+    if (t_pollFd < 0) {
+        return;
+    }
+    if (!flow->receivesSeparately()) {
+        t_pollEvents |= EPOLLIN;
+    }
+    if (flow->wantsToSend()) {
+        t_pollEvents |= EPOLLOUT;
+    }
+    if (t_pollEvents == flow->t_pollEvents) {
+        return;
+    }
+
+    t_event.events = t_pollEvents;
+    t_event.data.ptr = flow;
+    if (flow->t_pollEvents == 0) {
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, t_pollFd, &t_event);
+    } else if (t_pollEvents == 0) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, t_pollFd, NULL);
+    } else {
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, t_pollFd, &t_event);
+    }
+    flow->t_pollEvents = t_pollEvents;
+}
+
+void UdpSenderThread::closeFlow(UdpFlow *flow, UdpFlowSchedule &schedule, int epollFd, UdpReceiverThread *receiver)
+{
+    if (flow->receivesSeparately()) {
+        receiver->removeFlow(flow);
+    }
+    if (flow->t_pollEvents != 0) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, flow->backend()->pollFd(), NULL);
+        flow->t_pollEvents = 0;
+    }
+    schedule.remove(flow);
+    flow->close();
+}
 
-    /*****************************************************************
-     * With poll we can check if the socket can be read or written to.
-     * We need two different structures: one only for reading and one for reading and writing.
+/*
+ * The thread loop. All thread-internal variables are prefixed with t_
+ *
+ * Each pass:
+ * - opens the flows added and closes the flows removed by the main thread
+ * - runs the flows which are due, each once
+ * - submits the sends of the shared io_uring
+ * - sleeps until the next flow is due or a backend can receive, and runs these flows.
+ */
+void UdpSenderThread::run()
+{
+    UdpFlow *t_flow;
+    UdpFlowSchedule t_schedule;
+    QList<UdpFlow *> t_addedFlows;
+    QList<UdpFlow *> t_removedFlows;
+    // Flows run in this pass
+    QVector<UdpFlow *> t_flows;
+    QVector<UdpIoUringBackend *> t_completedBackends;
+    UdpIoUringBackend *t_backend;
+    // Receives for the flows whose backends allow it, NULL if the flows receive themselves
+    UdpReceiverThread *t_receiver = NULL;
+    struct epoll_event t_event;
+    struct epoll_event t_events[MAX_EVENTS];
+    int t_eventCount;
+    int t_timeout;
+    quint64 t_counter;
+    qint64 t_nsecNow;
+    qint64 t_nsecWakeup;
+    // Time the timer is set to
+    qint64 t_nsecTimer = 0;
+    struct itimerspec t_timer;
+
+    /* The io_uring flows share one ring. We find their flows through their backends. */
+    IoUring t_ring;
+    QHash<UdpIoBackend *, UdpFlow *> t_ringFlows;
+
+    /* Place the thread before the flows allocate their buffers, so that they are local.
+     * m_cpu and m_node are only changed while the thread is stopped.
      */
-    struct pollfd t_pollRead;
-    t_pollRead.fd = t_udpSocket;
-    t_pollRead.events = POLLIN;
+    const bool t_preferred = CpuPlacement::preferNode(m_node);
+    const bool t_pinned = CpuPlacement::pinCurrentThread(m_cpu);
+    m_Mutex.lock();
+    m_preferredNode = t_preferred ? m_node : -1;
+    m_pinnedCpu = t_pinned ? m_cpu : -1;
+    m_Mutex.unlock();
 
-    struct pollfd t_pollReadWrite;
-    t_pollReadWrite.fd = t_udpSocket;
-    t_pollReadWrite.events = POLLIN|POLLOUT;
+    const int t_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    const int t_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (t_epollFd < 0 || t_timerFd < 0) {
+        qDebug() << "UdpSenderThread::run: could not create the epoll or timer file descriptors";
+        return;
+    }
+    memset(&t_timer, 0, sizeof (t_timer));
+    t_event.events = EPOLLIN;
+    t_event.data.ptr = &m_wakeFd;
+    epoll_ctl(t_epollFd, EPOLL_CTL_ADD, m_wakeFd, &t_event);
+    t_event.data.ptr = &t_nsecTimer;
+    epoll_ctl(t_epollFd, EPOLL_CTL_ADD, t_timerFd, &t_event);
 
     /********************************************************************
     * This is our thread loop. It last forever and will be broken when m_stoped ist set to true.
     *********************************************************************/
     forever {
-        // Stop the thread when m_stopped is set to true from the main thread.
+        /********************************************************************
+        * First step: open and close the flows given by the main thread
+        *********************************************************************/
         m_Mutex.lock();
         if (m_stopped) {
             m_stopped = false;
@@ -289,124 +384,145 @@ void UdpSenderThread::run()
             /* Break outside the forever loop */
             break;
         }
+        t_addedFlows = m_addedFlows;
+        m_addedFlows.clear();
+        // The flows stay in m_removedFlows until they are closed
+        t_removedFlows = m_removedFlows;
+        t_receiver = m_receiver;
         m_Mutex.unlock();
 
-        /********************************************************************
-        * First step: emit stats (once per second)
-        * We do this before we send new packets and hope to get stats that
-        * do not vary to much in time.
-        *********************************************************************/
-        // As the loop last less than 1 msec, we just update t_msecNow at the beginning of it.
-        // This saves a few CPU cycles
-        t_msecNow = QDateTime::currentMSecsSinceEpoch();
-
-        if (t_statNextTime < t_msecNow) {
-            // The signal will be send to the main thread, this is qt magic and is thread-safe :-)
-            // FIXME: Latency not sended
-            emit statistics(t_statsPacketsLost, *t_sendingCounter, t_statsPacketsReceived, t_statsPacketsNotSent);
-
-            // Next stats in t_statsReportInterval
-            t_statNextTime += t_statsReportInterval;
-        }
-
-
-        /********************************************************************
-        * Second step: receive as much packets as possible, in order to clear the buffers.
-        * We begin with receiving because we do not want packet drops comming from overfull receiving buffers.
-        * We might not reach the wanted bandwidth because we recive to much at a time. But leaving packets
-        * in the receiving Buffer could produce unwanted packet loss.
-        * As soon as there is nothing to receive, recv will return -1 and we go on to second step.
-        ********************************************************************/
-        while (true) {
-            t_packetSize = recv(t_udpSocket, &t_datagramReceive, t_datagramSDULength, 0);
-            if (t_packetSize < 0) {
-                /* Error or buffers full (EAGAIN or EWOULDBLOCK) => stop
-                 * sending for now and go to next step */
-                break;
+        foreach (t_flow, t_addedFlows) {
+            if (!t_ring.isOpen() && t_ring.open(IO_URING_ENTRIES)) {
+                // The ring wakes us up when it has completions
+                t_event.events = EPOLLIN;
+                t_event.data.ptr = &t_ring;
+                epoll_ctl(t_epollFd, EPOLL_CTL_ADD, t_ring.fd(), &t_event);
             }
-            t_latency = t_msecNow - *t_returnedTime;
-
-            t_counterDelta = *t_returnedCounter - t_counterAwaited;
-            if (t_counterDelta == 0) {
-                // This is the awaited Paket
-                t_counterAwaited++;
-                t_statsPacketsReceived++;
-                t_statsCummuledLatency += t_latency;
-            } else if (t_counterDelta > 0) {
-                // One packet was received, but packets inbetween have been lost
-                t_statsPacketsLost = t_statsPacketsLost + (t_counterDelta);
-                t_statsPacketsReceived++;
-                t_statsCummuledLatency += t_latency;
-                t_counterAwaited = *t_returnedCounter + 1;
-            } else {
-                // We received a counter which is smaller as the awaited counter
-                // We have a Packet duplication or a reordered packet => we ignore it
-                qDebug("Dup or reordered!");
+            if (!t_flow->open(t_ring.isOpen() ? &t_ring : NULL)) {
+                continue;
+            }
+            t_schedule.insert(t_flow);
+            if (t_flow->backend()->pollFd() < 0) {
+                // The backend uses the shared ring
+                t_ringFlows.insert(t_flow->backend(), t_flow);
+            } else if (t_receiver != NULL && t_flow->backend()->concurrentReceive()) {
+                t_flow->setSeparateReceive(true);
+                t_receiver->addFlow(t_flow);
             }
+            t_flow->t_pollEvents = 0;
+            watchFlow(t_flow, t_epollFd);
         }
 
+        if (!t_removedFlows.isEmpty()) {
+            foreach (t_flow, t_removedFlows) {
+                if (t_flow->t_scheduleIndex < 0) {
+                    // The flow could not be opened
+                    continue;
+                }
+                t_ringFlows.remove(t_flow->backend());
+                closeFlow(t_flow, t_schedule, t_epollFd, t_receiver);
+            }
 
+            m_Mutex.lock();
+            foreach (t_flow, t_removedFlows) {
+                m_removedFlows.removeAll(t_flow);
+            }
+            m_flowsRemoved.wakeAll();
+            m_Mutex.unlock();
+        }
 
         /********************************************************************
-        * Third step: send one packet if needed
-        * If the buffers are full, we get a negative result from sendto
-        * We only send one packet as we also want to receive packets in order to avoid packet loss
-        * This does cost some CPU time
+        * Second step: run the flows which are due, each once.
         *********************************************************************/
-        // Do we need to refill our Bucket?
-        if (t_msecNextRefill <= t_msecNow) {
-            // If we do not sent everything keep how much for the stats
-            t_statsPacketsNotSent += t_packetBucket;
-            t_msecNextRefill += t_msecTc;
-            t_packetBucket = t_packetsBc;
-
-            // Keep track of counter history
-            t_counterHistory.append(*t_sendingCounter);
-            t_counterTimedOut = t_counterHistory.takeFirst();
-            if (t_counterTimedOut > t_counterAwaited) {
-                // The packets between t_counterAwaited and t_counterTimedOutare lost
-                t_statsPacketsLost = t_statsPacketsLost + (t_counterTimedOut - t_counterAwaited);
-                t_counterAwaited = t_counterTimedOut;
+        t_flows.clear();
+        t_schedule.dueFlows(UdpFlow::monotonicNsec(), t_flows);
+        foreach (t_flow, t_flows) {
+            runFlow(t_flow, t_schedule, t_epollFd);
+        }
+
+        // The flows of the ring which got completions (e.g. received datagrams)
+        if (t_ring.hasCompletedBackends()) {
+            t_ring.takeCompletedBackends(t_completedBackends);
+            foreach (t_backend, t_completedBackends) {
+                t_flow = t_ringFlows.value(t_backend, NULL);
+                if (t_flow != NULL) {
+                    runFlow(t_flow, t_schedule, t_epollFd);
+                }
             }
         }
 
-        if (t_packetBucket > 0) {
-            // The Bucket ist not empty, send one Datagram
-            *t_sendingTime = t_msecNow;
-            t_packetSize = sendto(t_udpSocket, &t_datagramSend, t_datagramSDULength, 0,
-                                 (struct sockaddr *)&t_destAddress, t_destAddressLen);
-            if (t_packetSize >= 0) {
-                // One packet was sent
-                *t_sendingCounter = *t_sendingCounter + 1;
-                t_packetBucket--;
-            } //else: Error or buffers full (EAGAIN or EWOULDBLOCK) => try again next time
+        /********************************************************************
+        * Third step: hand the sends of the io_uring flows over to the kernel, with one system call
+        *********************************************************************/
+        if (t_ring.pendingSubmissions() > 0) {
+            t_ring.submitAndWait(0);
         }
 
-        /*****************************************/
-        /* Last step: Maybe sleep for a while
-         *****************************************/
-
-        // Wait until we refill our bucket or we have to send stats
-        if (t_msecNextRefill <= t_statNextTime) {
-            // We first need to refill
-            t_msecDelta = t_msecNextRefill - t_msecNow;
-        } else {
-            // We first need to send stats
-            t_msecDelta = t_statNextTime - t_msecNow;
+        /********************************************************************
+        * Last step: Maybe sleep for a while
+        * We sleep until the first flow is due. With smooth pacing, we wake up PACING_SPIN_NSEC
+        * earlier and spin the rest of the time, as the timer does not wake up precisely enough.
+        *********************************************************************/
+        t_timeout = -1;
+        t_nsecNow = UdpFlow::monotonicNsec();
+        if (t_ring.hasCompletedBackends()) {
+            // Some flows still have something to do
+            t_timeout = 0;
+        } else if (!t_schedule.isEmpty()) {
+            t_flow = t_schedule.first();
+            t_nsecWakeup = t_flow->nsecNextRun();
+            if (t_nsecWakeup - t_nsecNow <= UdpFlow::PACING_SPIN_NSEC) {
+                while (UdpFlow::monotonicNsec() < t_nsecWakeup) {
+                }
+                t_timeout = 0;
+            } else {
+                if (t_flow->needsPreciseWakeup()) {
+                    t_nsecWakeup -= UdpFlow::PACING_SPIN_NSEC;
+                }
+                if (t_nsecWakeup != t_nsecTimer) {
+                    t_timer.it_value.tv_sec = t_nsecWakeup / 1000000000;
+                    t_timer.it_value.tv_nsec = t_nsecWakeup % 1000000000;
+                    timerfd_settime(t_timerFd, TFD_TIMER_ABSTIME, &t_timer, NULL);
+                    t_nsecTimer = t_nsecWakeup;
+                }
+            }
         }
-        if (t_msecDelta > 0) {
-            // we could wait but,
-            // we only sleep when there is nothing to do
-            if (t_packetBucket > 0) {
-                // we still have something to send
-                poll(&t_pollReadWrite, 1, t_msecDelta);
+
+        // we only sleep when there is nothing to do.
+        t_eventCount = epoll_wait(t_epollFd, t_events, MAX_EVENTS, t_timeout);
+        for (int i = 0; i < t_eventCount; i++) {
+            if (t_events[i].data.ptr == &m_wakeFd) {
+                if (read(m_wakeFd, &t_counter, sizeof (t_counter)) < 0) {
+                    // Nothing to read, somebody else reset the counter
+                }
+            } else if (t_events[i].data.ptr == &t_nsecTimer) {
+                if (read(t_timerFd, &t_counter, sizeof (t_counter)) < 0) {
+                    // The timer was set again in the meantime
+                }
+                // The timer has to be set again, even for the same time
+                t_nsecTimer = 0;
+            } else if (t_events[i].data.ptr == &t_ring) {
+                // Hand the completions over to the backends, their flows run in the next pass
+                t_ring.reap();
             } else {
-                // we just wait for udp echos (replies)
-                poll(&t_pollRead, 1, t_msecDelta);
+                // The backend of this flow can receive (or send)
+                runFlow(static_cast<UdpFlow *>(t_events[i].data.ptr), t_schedule, t_epollFd);
             }
         }
     }
 
-    // Ending the thread - close socket
-    close(t_udpSocket);
+    // Ending the thread - close all flows
+    while (!t_schedule.isEmpty()) {
+        closeFlow(t_schedule.first(), t_schedule, t_epollFd, t_receiver);
+    }
+    t_ring.close();
+    ::close(t_timerFd);
+    ::close(t_epollFd);
+
+    // The flows waiting to be removed are closed, the flows waiting to be added are dropped
+    m_Mutex.lock();
+    m_addedFlows.clear();
+    m_removedFlows.clear();
+    m_flowsRemoved.wakeAll();
+    m_Mutex.unlock();
 }
@@ -2,54 +2,118 @@
 #define UDPSENDERTHREAD_H
 
 #include <QThread>
-#include <QReadWriteLock>
 #include <QMutex>
-#include <QUdpSocket>
+#include <QWaitCondition>
+#include <QList>
+#include <QVector>
 
+#include "udpflow.h"
+#include "udpreceiverthread.h"
+
+/* The flows of a thread, ordered by the time they want to run (a binary min-heap).
+ * Each flow knows its position, so that it can be moved when its time changes.
+ * 10000 flows cost about 14 comparisons per change.
+ */
+class UdpFlowSchedule
+{
+public:
+    inline bool isEmpty() const { return m_flows.isEmpty(); }
+    inline int count() const { return m_flows.size(); }
+    inline UdpFlow *first() const { return m_flows[0]; }
+    inline UdpFlow *at(int i) const { return m_flows[i]; }
+
+    void insert(UdpFlow *flow);
+    void remove(UdpFlow *flow);
+    // The time of flow changed
+    void update(UdpFlow *flow);
+    // Appends the flows due at nsecNow
+    void dueFlows(qint64 nsecNow, QVector<UdpFlow *> &flows) const;
+
+private:
+    void moveUp(int i);
+    void moveDown(int i);
+    inline void place(UdpFlow *flow, int i) { m_flows[i] = flow; flow->t_scheduleIndex = i; }
+
+    QVector<UdpFlow *> m_flows;
+};
+
+/* A worker thread which runs any count of flows.
+ *
+ * The thread sleeps in epoll_wait() until the first flow of its schedule is due (timerfd)
+ * or the backend of a flow can receive (or send). It then calls process() of these flows.
+ * So 10000 flows cost one thread per core, not 10000 threads waking up at their own Tc.
+ * The io_uring flows of a thread share one ring.
+ * With a separate receive, a UdpReceiverThread receives for the flows whose backend allows it,
+ * this thread then only paces and sends.
+ *
+ * Flows are added and removed by the main thread with addFlow() and removeFlow(),
+ * UdpSenderScheduler chooses the thread.
+ */
 class UdpSenderThread : public QThread
 {
     Q_OBJECT
 
 public:
-    UdpSenderThread();
-
-    void setTos(quint8 tos);
-    void setDatagramSDULength(int length);
-    void setPpmsec(qreal ppmsec);
-    bool setPort(int port);
-    bool setDestination(QHostAddress address);
-    void setTcMsec(uint tcMsec);
+    // index is the number of the thread in the pool, shown in the flow table
+    explicit UdpSenderThread(int index = 0);
+    ~UdpSenderThread();
+
+    // The thread opens the flow and runs it. The thread is started if needed.
+    void addFlow(UdpFlow *flow);
+    // Returns when the thread does not run the flow anymore
+    void removeFlow(UdpFlow *flow);
+    // Flows and sum of their packets per msec, used to spread the flows over the threads
+    int flowCount();
+    qreal load();
+    // The rate of a running flow changed
+    void updateLoad(qreal oldPpmsec, qreal newPpmsec);
     void stop();
+    // Receive on a UdpReceiverThread. The thread stops and closes its flows if this changes.
+    void setSeparateReceive(bool enabled);
+    /* CPUs the thread and its receiver thread are pinned to, and NUMA node of their memory.
+     * -1 = floating. Applied when the thread starts, it stops and closes its flows if this changes.
+     */
+    void setPlacement(int cpu, int rxCpu, int node);
+    // Placement applied, e.g. "#2 CPU 4, RX CPU 5, node 0"
+    QString placement();
 
-signals:
-    void statistics(quint64 packetsLost, quint64 packetsSent, quint64 packetsReceived, quint64 packetsNotSent);
+    // Entries of the shared io_uring
+    static const unsigned IO_URING_ENTRIES = 4096;
+    // Events handled per epoll_wait() call
+    static const int MAX_EVENTS = 256;
 
 protected:
     void run() Q_DECL_OVERRIDE;
 
-
 private:
-    /* Parameter for run(). Has not to be accessed via a Mutex as the parameter are only changed when thread ist not running */
-    /* Defaults are set to avoid a random value */
-
-    // This is the Payoad of udp without header.
-    int m_datagramSDULength = 500;
-    // Packets per milisecond to send. We work with miliseconds to reduce calculation in the sending algotithm.
-    qreal m_ppmsec = 0;
-    // Destination Port
-    quint16 m_udpPort = 7;
-    // Destination Address
-    QHostAddress m_destination;
-    // Type of Service
-    quint8 m_tos = 0;
-    // tc duration, in msec
-    uint m_tcMsec = 100;
-
-    /* Locker when accessing Parameter and Statistics */
+    void wakeUp();
+    void runFlow(UdpFlow *flow, UdpFlowSchedule &schedule, int epollFd);
+    void watchFlow(UdpFlow *flow, int epollFd);
+    void closeFlow(UdpFlow *flow, UdpFlowSchedule &schedule, int epollFd, UdpReceiverThread *receiver);
+
+    /* Locker when accessing the flow lists */
     QMutex m_Mutex;
+    QWaitCondition m_flowsRemoved;
+    // Flows to open and flows to close, handed over to the thread
+    QList<UdpFlow *> m_addedFlows;
+    QList<UdpFlow *> m_removedFlows;
+    int m_flowCount = 0;
+    qreal m_load = 0;
     // volatile = tell the computer this variable may change at any time
     volatile bool m_stopped = false;
 
+    // eventfd which wakes the thread up when the lists change
+    int m_wakeFd = -1;
+    // Only changed while the thread is stopped
+    UdpReceiverThread *m_receiver = NULL;
+
+    int m_index;
+    int m_cpu = -1;
+    int m_rxCpu = -1;
+    int m_node = -1;
+    // Set by the thread when it placed itself
+    int m_pinnedCpu = -1;
+    int m_preferredNode = -1;
 };
 
 #endif // UDPSENDERTHREAD_H
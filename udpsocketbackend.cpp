@@ -0,0 +1,176 @@
+#include "udpsocketbackend.h"
+
+#include <QDebug>
+
+#include <netinet/udp.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+UdpSocketBackend::UdpSocketBackend()
+{
+}
+
+UdpSocketBackend::~UdpSocketBackend()
+{
+    close();
+}
+
+bool UdpSocketBackend::open(UdpIoConfig &config)
+{
+    m_udpSocket = openUdpSocket(config);
+    if (m_udpSocket < 0) {
+        return false;
+    }
+    m_pollFd = m_udpSocket;
+
+    /* We send up to txBatchSize datagrams with one sendmmsg() call, so we need one
+     * payload per datagram of the batch. This may be too big for the stack.
+     */
+    m_sendBatch = new UdpSendBatch(config.txBatchSize, config.datagramSDULength, m_segmentsPerMessage,
+                                   config.txTime, &m_destAddress);
+    m_sendPayloads.resize(config.txBatchSize);
+    for (int i = 0; i < config.txBatchSize; i++) {
+        m_sendPayloads[i] = m_sendBatch->payload(i);
+    }
+
+    /* With UDP GRO, the kernel coalesces echoed datagrams into buffers of up to 64k.
+     * These are big, so we preallocate less of them.
+     */
+    m_udpGro = config.udpGro;
+    m_rxBatchSize = m_udpGro ? RX_GRO_BATCH_SIZE : RX_BATCH_SIZE;
+    // Room for the longest datagram of the MTU, as the size may grow while the flow runs
+    m_receiveBufferLength = UdpIoBuffer::alignedLength(m_udpGro ? UDP_MAX_GRO_PAYLOAD
+                                                                : qMax(config.datagramSDULength, config.maxDatagramSDULength));
+    m_receiveControlLength = (m_udpGro ? CMSG_SPACE(sizeof (int)) : 0)
+            + (config.timestamping ? TIMESTAMPING_CONTROL_LENGTH : 0);
+
+    m_receiveBuffers.allocate(static_cast<size_t>(m_rxBatchSize) * m_receiveBufferLength);
+    m_receiveControl.fill(0, m_rxBatchSize * m_receiveControlLength);
+    m_receiveIovecs.resize(m_rxBatchSize);
+    m_receiveMessages.resize(m_rxBatchSize);
+    for (int i = 0; i < m_rxBatchSize; i++) {
+        m_receiveIovecs[i].iov_base = m_receiveBuffers.data() + i * m_receiveBufferLength;
+        m_receiveIovecs[i].iov_len = m_receiveBufferLength;
+        memset(&m_receiveMessages[i], 0, sizeof (struct mmsghdr));
+        m_receiveMessages[i].msg_hdr.msg_iov = &m_receiveIovecs[i];
+        m_receiveMessages[i].msg_hdr.msg_iovlen = 1;
+    }
+    // A coalesced buffer holds at most one datagram per segment
+    m_receivedDatagrams.resize(m_rxBatchSize * (m_udpGro ? m_receiveBufferLength / qMax(1, config.datagramSDULength) + 1 : 1));
+
+    return true;
+}
+
+void UdpSocketBackend::close()
+{
+    if (m_udpSocket >= 0) {
+        ::close(m_udpSocket);
+        m_udpSocket = -1;
+        m_pollFd = -1;
+    }
+    delete m_sendBatch;
+    m_sendBatch = NULL;
+}
+
+bool UdpSocketBackend::reconfigure(const UdpIoConfig &config)
+{
+    // With GRO, a buffer of shorter datagrams holds more than m_receivedDatagrams has room for
+    if (m_udpGro && config.datagramSDULength < m_socketConfig.datagramSDULength) {
+        return false;
+    }
+    // The echoes would be cut (the MTU grew since open()): reopen with bigger receive buffers
+    if (!m_udpGro && config.datagramSDULength > m_receiveBufferLength) {
+        return false;
+    }
+    if (!reconfigureUdpSocket(m_udpSocket, config)) {
+        return false;
+    }
+
+    /* Only the sending side changes, as receive() may run on another thread. The receive buffers
+     * keep their length, they have room for the longest datagram.
+     */
+    if (m_sendBatch->datagramLength() != m_socketConfig.datagramSDULength
+            || m_sendBatch->segmentsPerMessage() != m_segmentsPerMessage) {
+        delete m_sendBatch;
+        m_sendBatch = new UdpSendBatch(m_socketConfig.txBatchSize, m_socketConfig.datagramSDULength,
+                                       m_segmentsPerMessage, m_socketConfig.txTime, &m_destAddress);
+        for (int i = 0; i < m_sendPayloads.size(); i++) {
+            m_sendPayloads[i] = m_sendBatch->payload(i);
+        }
+    }
+
+    return true;
+}
+
+int UdpSocketBackend::prepareSend(int count)
+{
+    // The payloads are always the same, the kernel copied them at the last send()
+    return qMin(count, m_sendPayloads.size());
+}
+
+int UdpSocketBackend::send(int count, qreal nsecFirstDeparture, qreal nsecInterPacket)
+{
+    const int t_messageCount = m_sendBatch->prepare(count, nsecFirstDeparture, nsecInterPacket,
+                                                    m_sendLengths.isEmpty() ? NULL : m_sendLengths.constData());
+
+    int t_result = sendmmsg(m_udpSocket, m_sendBatch->messages(), t_messageCount, 0);
+    if (t_result <= 0) {
+        // Error or buffers full (EAGAIN or EWOULDBLOCK) => try again next time
+        return 0;
+    }
+
+    // If the buffers got full, the remaining counters are sent again with the next batch.
+    return m_sendBatch->datagramsSent(t_result, count);
+}
+
+int UdpSocketBackend::receive(int maxCount)
+{
+    const int t_batchCount = qMin(maxCount, m_rxBatchSize);
+    struct cmsghdr *t_cmsg;
+    int t_segmentSize;
+    qint64 t_nsecTimestamp;
+    bool t_hardwareTimestamp;
+
+    m_receivedCount = 0;
+
+    // The send timestamps first, so that they are there when their echoes are processed
+    if (m_socketConfig.timestamping) {
+        readSendTimestamps(m_udpSocket);
+    }
+
+    if (m_receiveControlLength > 0) {
+        // The kernel overwrites the control length, so we have to set it before each call
+        for (int i = 0; i < t_batchCount; i++) {
+            m_receiveMessages[i].msg_hdr.msg_control = m_receiveControl.data() + i * m_receiveControlLength;
+            m_receiveMessages[i].msg_hdr.msg_controllen = m_receiveControlLength;
+        }
+    }
+
+    int t_result = recvmmsg(m_udpSocket, m_receiveMessages.data(), t_batchCount, 0, NULL);
+    if (t_result <= 0) {
+        // Error or buffers empty (EAGAIN or EWOULDBLOCK)
+        return 0;
+    }
+
+    for (int i = 0; i < t_result; i++) {
+        // Without a GRO control message, the buffer holds one datagram
+        t_segmentSize = m_receiveMessages[i].msg_len;
+        t_nsecTimestamp = 0;
+        t_hardwareTimestamp = false;
+        if (m_receiveControlLength > 0) {
+            for (t_cmsg = CMSG_FIRSTHDR(&m_receiveMessages[i].msg_hdr); t_cmsg != NULL;
+                 t_cmsg = CMSG_NXTHDR(&m_receiveMessages[i].msg_hdr, t_cmsg)) {
+                if (t_cmsg->cmsg_level == SOL_UDP && t_cmsg->cmsg_type == UDP_GRO) {
+                    memcpy(&t_segmentSize, CMSG_DATA(t_cmsg), sizeof (int));
+                } else {
+                    parseTimestamping(t_cmsg, t_nsecTimestamp, t_hardwareTimestamp);
+                }
+            }
+        }
+        addReceivedBuffer(m_receiveBuffers.constData() + i * m_receiveBufferLength,
+                          m_receiveMessages[i].msg_len, t_segmentSize, t_nsecTimestamp, t_hardwareTimestamp,
+                          m_receiveMessages[i].msg_hdr.msg_flags & MSG_TRUNC);
+    }
+
+    return m_receivedCount;
+}
@@ -0,0 +1,42 @@
+#ifndef UDPSOCKETBACKEND_H
+#define UDPSOCKETBACKEND_H
+
+#include "udpiobackend.h"
+
+/* The classic path: a non-blocking UDP socket, sendmmsg() and recvmmsg().
+ * One system call per batch to send and one per batch to receive.
+ */
+class UdpSocketBackend : public UdpIoBackend
+{
+public:
+    UdpSocketBackend();
+    ~UdpSocketBackend();
+
+    bool open(UdpIoConfig &config) override;
+    void close() override;
+    bool reconfigure(const UdpIoConfig &config) override;
+
+    int prepareSend(int count) override;
+    int send(int count, qreal nsecFirstDeparture, qreal nsecInterPacket) override;
+    int receive(int maxCount) override;
+    // Sending and receiving only share the socket
+    inline bool concurrentReceive() const override { return true; }
+
+private:
+    int m_udpSocket = -1;
+
+    UdpSendBatch *m_sendBatch = NULL;
+
+    /* Echoed datagrams are received with recvmmsg() into m_rxBatchSize preallocated buffers */
+    bool m_udpGro = false;
+    int m_rxBatchSize = 0;
+    int m_receiveBufferLength = 0;
+    // The segment size of a coalesced buffer is passed as an UDP_GRO control message
+    int m_receiveControlLength = 0;
+    UdpIoBuffer m_receiveBuffers;
+    QVector<char> m_receiveControl;
+    QVector<struct iovec> m_receiveIovecs;
+    QVector<struct mmsghdr> m_receiveMessages;
+};
+
+#endif // UDPSOCKETBACKEND_H
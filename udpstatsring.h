@@ -0,0 +1,126 @@
+#ifndef UDPSTATSRING_H
+#define UDPSTATSRING_H
+
+#include <QtGlobal>
+#include <QAtomicInteger>
+
+#include "latencyhistogram.h"
+
+/* Statistics of a flow at one time. All counters are cumulated since the flow started */
+struct UdpSenderStats
+{
+    // CLOCK_MONOTONIC time the snapshot was taken by the thread running the flow
+    qint64 nsecTimestamp = 0;
+    // Report epoch of the snapshot: a multiple of the report interval, the same for all flows
+    qint64 nsecEpoch = 0;
+    // Time the flow was opened. It changes when the flow restarts, the counters then start from 0 again.
+    qint64 nsecStarted = 0;
+
+    quint64 packetsLost = 0;
+    quint64 packetsSent = 0;
+    quint64 packetsReceived = 0;
+    quint64 packetsNotSent = 0;
+    // Packets received after a packet sent later, packets received twice, packets received after their loss timeout
+    quint64 packetsReordered = 0;
+    quint64 packetsDuplicated = 0;
+    quint64 packetsLate = 0;
+    // Packets received with a wrong CRC32C trailer
+    quint64 packetsCorrupted = 0;
+    // Count of batches sent, used to calculate the effective batch size
+    quint64 sendCalls = 0;
+    // Count of receive calls which returned packets
+    quint64 receiveCalls = 0;
+    // Departure time error with smooth pacing: sum and count since the start, maximum since the last snapshot
+    quint64 pacingErrorSumNsec = 0;
+    quint64 pacingErrorCount = 0;
+    qint64 pacingErrorMaxNsec = 0;
+};
+
+/* Latencies measured by the receiving half of a flow during one report interval */
+struct UdpLatencyStats
+{
+    // Report epoch of the interval end, as in UdpSenderStats. Several intervals if the main thread was late.
+    qint64 nsecEpoch = 0;
+    LatencyHistogram histogram;
+    // Delay between the kernel send and receive timestamps, with timestamping only
+    LatencyHistogram networkHistogram;
+    /* Echoes with a receive timestamp whose send timestamp was not found: its slot was taken by a
+     * datagram sent later (more than SEND_TIMESTAMP_SLOTS in flight), or it was not read yet
+     */
+    quint64 networkMissed = 0;
+    // RFC 3550 interarrival jitter at the end of the interval
+    qint64 jitterNsec = 0;
+    /* IPDV (RFC 5481): delay difference of packets received during the interval whose previous
+     * packet in sequence was received too. Count, sum of the absolute values, minimum and maximum.
+     */
+    quint64 ipdvCount = 0;
+    quint64 ipdvAbsSumNsec = 0;
+    qint64 ipdvMinNsec = 0;
+    qint64 ipdvMaxNsec = 0;
+};
+
+/* Target and achieved packets of one step of a rate profile, published when the step ends */
+struct UdpRateStepStats
+{
+    // Index of the step in the profile, and how often a looping profile started again before it
+    int step = 0;
+    quint64 pass = 0;
+    // CLOCK_MONOTONIC times of the beginning and the end of the step
+    qint64 nsecStart = 0;
+    qint64 nsecEnd = 0;
+    // Packets of the profile rate in the Tcs of the step, and the packets actually sent
+    qreal packetsTarget = 0;
+    quint64 packetsSent = 0;
+};
+
+/* Snapshots of the stats of a flow, from the thread running the flow to the main thread.
+ *
+ * One producer (the thread) and one consumer (the main thread), without lock: the head is only
+ * written by push(), the tail only by pop(). If the main thread does not keep up, push() fails
+ * and the producer keeps its data for the next push.
+ * SIZE is a power of 2.
+ */
+template <typename T, quint32 SIZE>
+class UdpStatsRing
+{
+public:
+    // Returns false if the ring is full. Called by the thread running the flow.
+    bool push(const T &snapshot)
+    {
+        const quint32 t_head = m_head.load();
+
+        if (t_head - m_tail.loadAcquire() >= SIZE) {
+            return false;
+        }
+
+        m_snapshots[t_head & (SIZE - 1)] = snapshot;
+        // The snapshot is written before the consumer sees the new head
+        m_head.storeRelease(t_head + 1);
+
+        return true;
+    }
+
+    // Returns false if the ring is empty. Called by the main thread.
+    bool pop(T &snapshot)
+    {
+        const quint32 t_tail = m_tail.load();
+
+        if (t_tail == m_head.loadAcquire()) {
+            return false;
+        }
+
+        snapshot = m_snapshots[t_tail & (SIZE - 1)];
+        // The slot is read before the producer may overwrite it
+        m_tail.storeRelease(t_tail + 1);
+
+        return true;
+    }
+
+private:
+    T m_snapshots[SIZE];
+    // Free running indexes, the slot is the index modulo SIZE
+    QAtomicInteger<quint32> m_head;
+    QAtomicInteger<quint32> m_tail;
+};
+
+#endif // UDPSTATSRING_H
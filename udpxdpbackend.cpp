@@ -0,0 +1,426 @@
+#include "udpxdpbackend.h"
+
+#include <QDebug>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+/* bpf() has no glibc wrapper */
+static inline int bpfCall(int command, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, command, attr, sizeof (union bpf_attr));
+}
+
+static inline struct bpf_insn bpfInstruction(quint8 code, quint8 dst, quint8 src, qint16 offset, qint32 immediate)
+{
+    struct bpf_insn t_instruction;
+    t_instruction.code = code;
+    t_instruction.dst_reg = dst;
+    t_instruction.src_reg = src;
+    t_instruction.off = offset;
+    t_instruction.imm = immediate;
+    return t_instruction;
+}
+
+UdpXdpBackend::UdpXdpBackend()
+{
+}
+
+UdpXdpBackend::~UdpXdpBackend()
+{
+    close();
+}
+
+bool UdpXdpBackend::open(UdpIoConfig &config)
+{
+    int t_result;
+
+    if (!openRaw(config)) {
+        return false;
+    }
+    if (m_frameLength > XDP_FRAME_SIZE) {
+        qDebug() << "UdpXdpBackend::open: datagrams bigger than" << XDP_FRAME_SIZE - FRAME_HEADER_LENGTH
+                 << "bytes are not supported";
+        close();
+        return false;
+    }
+
+    /* The UMEM: sending frames first, then receiving frames */
+    m_umemSize = 2 * XDP_FRAMES_PER_DIRECTION * XDP_FRAME_SIZE;
+    void *t_memory = mmap(NULL, m_umemSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE, -1, 0);
+    if (t_memory == MAP_FAILED) {
+        close();
+        return false;
+    }
+    m_umem = static_cast<char *>(t_memory);
+
+    m_xdpSocket = socket(AF_XDP, SOCK_RAW, 0);
+    if (m_xdpSocket < 0) {
+        qDebug() << "UdpXdpBackend::open: could not open the AF_XDP socket, errno" << errno;
+        close();
+        return false;
+    }
+
+    struct xdp_umem_reg t_umemRegistration;
+    memset(&t_umemRegistration, 0, sizeof (t_umemRegistration));
+    t_umemRegistration.addr = reinterpret_cast<quint64>(m_umem);
+    t_umemRegistration.len = m_umemSize;
+    t_umemRegistration.chunk_size = XDP_FRAME_SIZE;
+    t_result = setsockopt(m_xdpSocket, SOL_XDP, XDP_UMEM_REG, &t_umemRegistration, sizeof (t_umemRegistration));
+    if (t_result < 0) {
+        qDebug() << "UdpXdpBackend::open: could not register the UMEM, errno" << errno;
+        close();
+        return false;
+    }
+
+    int t_ringSize = XDP_FRAMES_PER_DIRECTION;
+    if (setsockopt(m_xdpSocket, SOL_XDP, XDP_UMEM_FILL_RING, &t_ringSize, sizeof (t_ringSize)) < 0
+            || setsockopt(m_xdpSocket, SOL_XDP, XDP_UMEM_COMPLETION_RING, &t_ringSize, sizeof (t_ringSize)) < 0
+            || setsockopt(m_xdpSocket, SOL_XDP, XDP_RX_RING, &t_ringSize, sizeof (t_ringSize)) < 0
+            || setsockopt(m_xdpSocket, SOL_XDP, XDP_TX_RING, &t_ringSize, sizeof (t_ringSize)) < 0) {
+        qDebug() << "UdpXdpBackend::open: could not create the rings";
+        close();
+        return false;
+    }
+
+    struct xdp_mmap_offsets t_offsets;
+    socklen_t t_offsetsLength = sizeof (t_offsets);
+    t_result = getsockopt(m_xdpSocket, SOL_XDP, XDP_MMAP_OFFSETS, &t_offsets, &t_offsetsLength);
+    if (t_result < 0
+            || !mapRing(m_rxRing, t_offsets.rx, sizeof (struct xdp_desc), XDP_PGOFF_RX_RING)
+            || !mapRing(m_txRing, t_offsets.tx, sizeof (struct xdp_desc), XDP_PGOFF_TX_RING)
+            || !mapRing(m_fillRing, t_offsets.fr, sizeof (quint64), XDP_UMEM_PGOFF_FILL_RING)
+            || !mapRing(m_completionRing, t_offsets.cr, sizeof (quint64), XDP_UMEM_PGOFF_COMPLETION_RING)) {
+        qDebug() << "UdpXdpBackend::open: could not map the rings";
+        close();
+        return false;
+    }
+    m_txProducer = *m_txRing.producer;
+    m_completionConsumer = *m_completionRing.consumer;
+    m_rxConsumer = *m_rxRing.consumer;
+    m_fillProducer = *m_fillRing.producer;
+
+    /* Build the sending frames once */
+    m_maxFrameLength = XDP_FRAME_SIZE;
+    m_headerGeneration = 0;
+    m_frameGenerations.fill(0, XDP_FRAMES_PER_DIRECTION);
+    m_freeTxFrames.resize(XDP_FRAMES_PER_DIRECTION);
+    for (int i = 0; i < XDP_FRAMES_PER_DIRECTION; i++) {
+        m_freeTxFrames[i] = static_cast<quint64>(i) * XDP_FRAME_SIZE;
+        buildFrameHeader(m_umem + m_freeTxFrames[i]);
+    }
+    m_freeTxCount = XDP_FRAMES_PER_DIRECTION;
+    m_preparedFrames.resize(config.txBatchSize);
+    m_preparedCount = 0;
+    m_sendPayloads.resize(config.txBatchSize);
+
+    /* Give all the receiving frames to the kernel */
+    m_returnedFrames.clear();
+    for (int i = 0; i < XDP_FRAMES_PER_DIRECTION; i++) {
+        m_returnedFrames.append(static_cast<quint64>(XDP_FRAMES_PER_DIRECTION + i) * XDP_FRAME_SIZE);
+    }
+    m_receivedDatagrams.resize(XDP_FRAMES_PER_DIRECTION);
+    m_receivedCount = 0;
+    receive(0);
+
+    /* Bind to the queue, zero-copy if the driver can */
+    struct sockaddr_xdp t_address;
+    memset(&t_address, 0, sizeof (t_address));
+    t_address.sxdp_family = AF_XDP;
+    t_address.sxdp_ifindex = m_interfaceIndex;
+    t_address.sxdp_queue_id = XDP_QUEUE_ID;
+    t_address.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_ZEROCOPY;
+    t_result = bind(m_xdpSocket, (struct sockaddr *)&t_address, sizeof (t_address));
+    if (t_result < 0) {
+        t_address.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_COPY;
+        t_result = bind(m_xdpSocket, (struct sockaddr *)&t_address, sizeof (t_address));
+    }
+    if (t_result < 0) {
+        qDebug() << "UdpXdpBackend::open: could not bind to" << m_interfaceName << "errno" << errno;
+        close();
+        return false;
+    }
+    m_pollFd = m_xdpSocket;
+
+    if (!attachProgram()) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void UdpXdpBackend::close()
+{
+    // Closing the link detaches the XDP program
+    if (m_link >= 0) {
+        ::close(m_link);
+        m_link = -1;
+    }
+    if (m_program >= 0) {
+        ::close(m_program);
+        m_program = -1;
+    }
+    if (m_xskMap >= 0) {
+        ::close(m_xskMap);
+        m_xskMap = -1;
+    }
+
+    unmapRing(m_rxRing);
+    unmapRing(m_txRing);
+    unmapRing(m_fillRing);
+    unmapRing(m_completionRing);
+    if (m_xdpSocket >= 0) {
+        ::close(m_xdpSocket);
+        m_xdpSocket = -1;
+        m_pollFd = -1;
+    }
+    if (m_umem != NULL) {
+        munmap(m_umem, m_umemSize);
+        m_umem = NULL;
+    }
+
+    closeRaw();
+}
+
+int UdpXdpBackend::prepareSend(int count)
+{
+    // Frames prepared but not sent go back to the free frames
+    while (m_preparedCount > 0) {
+        m_preparedCount--;
+        m_freeTxFrames[m_freeTxCount] = m_preparedFrames[m_preparedCount];
+        m_freeTxCount++;
+    }
+
+    reclaimCompletions();
+
+    const quint32 t_txFree = XDP_FRAMES_PER_DIRECTION
+            - (m_txProducer - __atomic_load_n(m_txRing.consumer, __ATOMIC_ACQUIRE));
+    count = qMin(count, qMin(m_freeTxCount, static_cast<int>(t_txFree)));
+    count = qMin(count, m_preparedFrames.size());
+
+    for (int i = 0; i < count; i++) {
+        m_freeTxCount--;
+        m_preparedFrames[i] = m_freeTxFrames[m_freeTxCount];
+        // The thread only writes the payload, the headers are already there unless reconfigure() changed them
+        refreshFrameHeader(m_umem + m_preparedFrames[i], m_preparedFrames[i] / XDP_FRAME_SIZE);
+        m_sendPayloads[i] = m_umem + m_preparedFrames[i] + FRAME_HEADER_LENGTH;
+    }
+    m_preparedCount = count;
+
+    return count;
+}
+
+int UdpXdpBackend::send(int count, qreal /* nsecFirstDeparture */, qreal /* nsecInterPacket */)
+{
+    struct xdp_desc *t_descriptors = static_cast<struct xdp_desc *>(m_txRing.descriptors);
+    struct xdp_desc *t_descriptor;
+
+    count = qMin(count, m_preparedCount);
+    for (int i = 0; i < count; i++) {
+        t_descriptor = &t_descriptors[(m_txProducer + i) & (XDP_FRAMES_PER_DIRECTION - 1)];
+        t_descriptor->addr = m_preparedFrames[i];
+        t_descriptor->len = m_frameLength;
+        t_descriptor->options = 0;
+    }
+    m_txProducer += count;
+    __atomic_store_n(m_txRing.producer, m_txProducer, __ATOMIC_RELEASE);
+
+    // Frames which were prepared but are not sent go back with the next prepareSend()
+    for (int i = count; i < m_preparedCount; i++) {
+        m_preparedFrames[i - count] = m_preparedFrames[i];
+    }
+    m_preparedCount -= count;
+
+    // The kernel only sends when we wake it up (always needed in copy mode)
+    if (__atomic_load_n(m_txRing.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP) {
+        sendto(m_xdpSocket, NULL, 0, MSG_DONTWAIT, NULL, 0);
+    }
+
+    return count;
+}
+
+int UdpXdpBackend::receive(int maxCount)
+{
+    quint64 *t_fill = static_cast<quint64 *>(m_fillRing.descriptors);
+    const struct xdp_desc *t_descriptors = static_cast<const struct xdp_desc *>(m_rxRing.descriptors);
+    const struct xdp_desc *t_descriptor;
+    const char *t_payload;
+    int t_payloadLength;
+    bool t_truncated;
+
+    /* The frames returned by the last call have been processed, give them back to the kernel.
+     * The fill ring is as big as the count of receiving frames, so it always has room.
+     */
+    if (!m_returnedFrames.isEmpty()) {
+        for (int i = 0; i < m_returnedFrames.size(); i++) {
+            t_fill[(m_fillProducer + i) & (XDP_FRAMES_PER_DIRECTION - 1)] = m_returnedFrames[i];
+        }
+        m_fillProducer += m_returnedFrames.size();
+        __atomic_store_n(m_fillRing.producer, m_fillProducer, __ATOMIC_RELEASE);
+        m_returnedFrames.clear();
+    }
+
+    m_receivedCount = 0;
+    const quint32 t_available = __atomic_load_n(m_rxRing.producer, __ATOMIC_ACQUIRE) - m_rxConsumer;
+    const int t_count = qMin(static_cast<quint32>(maxCount), t_available);
+    for (int i = 0; i < t_count; i++) {
+        t_descriptor = &t_descriptors[(m_rxConsumer + i) & (XDP_FRAMES_PER_DIRECTION - 1)];
+        t_payload = echoPayload(m_umem + t_descriptor->addr, t_descriptor->len, t_payloadLength, t_truncated);
+        if (t_payload != NULL) {
+            m_receivedDatagrams[m_receivedCount].payload = t_payload;
+            m_receivedDatagrams[m_receivedCount].length = t_payloadLength;
+            m_receivedDatagrams[m_receivedCount].truncated = t_truncated;
+            m_receivedCount++;
+        }
+        // The address may point behind the headroom, the fill ring wants the start of the frame
+        m_returnedFrames.append(t_descriptor->addr & ~static_cast<quint64>(XDP_FRAME_SIZE - 1));
+    }
+    m_rxConsumer += t_count;
+    __atomic_store_n(m_rxRing.consumer, m_rxConsumer, __ATOMIC_RELEASE);
+
+    if (t_count == 0 && m_xdpSocket >= 0
+            && (__atomic_load_n(m_fillRing.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP)) {
+        // The driver waits for us to refill
+        recvfrom(m_xdpSocket, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+    }
+
+    return m_receivedCount;
+}
+
+bool UdpXdpBackend::mapRing(XdpRing &ring, const struct xdp_ring_offset &offset, size_t descriptorSize,
+                            off_t pageOffset)
+{
+    ring.mapSize = offset.desc + XDP_FRAMES_PER_DIRECTION * descriptorSize;
+    ring.map = mmap(NULL, ring.mapSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_xdpSocket, pageOffset);
+    if (ring.map == MAP_FAILED) {
+        ring.map = NULL;
+        return false;
+    }
+
+    char *t_map = static_cast<char *>(ring.map);
+    ring.producer = reinterpret_cast<quint32 *>(t_map + offset.producer);
+    ring.consumer = reinterpret_cast<quint32 *>(t_map + offset.consumer);
+    ring.flags = reinterpret_cast<quint32 *>(t_map + offset.flags);
+    ring.descriptors = t_map + offset.desc;
+    return true;
+}
+
+void UdpXdpBackend::unmapRing(XdpRing &ring)
+{
+    if (ring.map != NULL) {
+        munmap(ring.map, ring.mapSize);
+    }
+    ring = XdpRing();
+}
+
+void UdpXdpBackend::reclaimCompletions()
+{
+    const quint64 *t_completions = static_cast<const quint64 *>(m_completionRing.descriptors);
+    const quint32 t_producer = __atomic_load_n(m_completionRing.producer, __ATOMIC_ACQUIRE);
+
+    while (m_completionConsumer != t_producer) {
+        m_freeTxFrames[m_freeTxCount] = t_completions[m_completionConsumer & (XDP_FRAMES_PER_DIRECTION - 1)];
+        m_freeTxCount++;
+        m_completionConsumer++;
+    }
+    __atomic_store_n(m_completionRing.consumer, m_completionConsumer, __ATOMIC_RELEASE);
+}
+
+/* Loads and attaches the XDP program:
+ *   if the frame is IPv4 without options, UDP, to our port: redirect to the socket of its queue
+ *   else: XDP_PASS
+ * It is written in BPF instructions, so that we neither need clang nor libbpf at runtime.
+ */
+bool UdpXdpBackend::attachProgram()
+{
+    union bpf_attr t_attr;
+    int t_key = XDP_QUEUE_ID;
+
+    memset(&t_attr, 0, sizeof (t_attr));
+    t_attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    t_attr.key_size = sizeof (int);
+    t_attr.value_size = sizeof (int);
+    t_attr.max_entries = 64;
+    m_xskMap = bpfCall(BPF_MAP_CREATE, &t_attr);
+    if (m_xskMap < 0) {
+        qDebug() << "UdpXdpBackend::attachProgram: could not create the XSKMAP, errno" << errno;
+        return false;
+    }
+
+    memset(&t_attr, 0, sizeof (t_attr));
+    t_attr.map_fd = m_xskMap;
+    t_attr.key = reinterpret_cast<quint64>(&t_key);
+    t_attr.value = reinterpret_cast<quint64>(&m_xdpSocket);
+    if (bpfCall(BPF_MAP_UPDATE_ELEM, &t_attr) < 0) {
+        qDebug() << "UdpXdpBackend::attachProgram: could not add the socket to the XSKMAP, errno" << errno;
+        return false;
+    }
+
+    // Jumps are relative to the next instruction, "pass" is instruction 19
+    const struct bpf_insn t_program[] = {
+        bpfInstruction(BPF_LDX|BPF_MEM|BPF_W, BPF_REG_2, BPF_REG_1, 0, 0),      // r2 = ctx->data
+        bpfInstruction(BPF_LDX|BPF_MEM|BPF_W, BPF_REG_3, BPF_REG_1, 4, 0),      // r3 = ctx->data_end
+        bpfInstruction(BPF_ALU64|BPF_MOV|BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),    // r4 = r2
+        bpfInstruction(BPF_ALU64|BPF_ADD|BPF_K, BPF_REG_4, 0, 0, FRAME_HEADER_LENGTH),
+        bpfInstruction(BPF_JMP|BPF_JGT|BPF_X, BPF_REG_4, BPF_REG_3, 14, 0),     // frame too short
+        bpfInstruction(BPF_LDX|BPF_MEM|BPF_H, BPF_REG_5, BPF_REG_2, 12, 0),     // EtherType
+        bpfInstruction(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, 12, htons(0x0800)),
+        bpfInstruction(BPF_LDX|BPF_MEM|BPF_B, BPF_REG_5, BPF_REG_2, 14, 0),     // IP version and header length
+        bpfInstruction(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, 10, 0x45),
+        bpfInstruction(BPF_LDX|BPF_MEM|BPF_B, BPF_REG_5, BPF_REG_2, 23, 0),     // IP protocol
+        bpfInstruction(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, 8, IPPROTO_UDP),
+        bpfInstruction(BPF_LDX|BPF_MEM|BPF_H, BPF_REG_5, BPF_REG_2, 36, 0),     // UDP destination port
+        bpfInstruction(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, 6, m_sourcePort),
+        bpfInstruction(BPF_LDX|BPF_MEM|BPF_W, BPF_REG_2, BPF_REG_1, 16, 0),     // r2 = ctx->rx_queue_index
+        bpfInstruction(BPF_LD|BPF_DW|BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, m_xskMap),
+        bpfInstruction(0, 0, 0, 0, 0),
+        bpfInstruction(BPF_ALU64|BPF_MOV|BPF_K, BPF_REG_3, 0, 0, XDP_PASS),     // if no socket: pass
+        bpfInstruction(BPF_JMP|BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+        bpfInstruction(BPF_JMP|BPF_EXIT, 0, 0, 0, 0),
+        bpfInstruction(BPF_ALU64|BPF_MOV|BPF_K, BPF_REG_0, 0, 0, XDP_PASS),     // pass:
+        bpfInstruction(BPF_JMP|BPF_EXIT, 0, 0, 0, 0)
+    };
+    static const char t_license[] = "Dual MIT/GPL";
+
+    memset(&t_attr, 0, sizeof (t_attr));
+    t_attr.prog_type = BPF_PROG_TYPE_XDP;
+    t_attr.insns = reinterpret_cast<quint64>(t_program);
+    t_attr.insn_cnt = sizeof (t_program) / sizeof (struct bpf_insn);
+    t_attr.license = reinterpret_cast<quint64>(t_license);
+    m_program = bpfCall(BPF_PROG_LOAD, &t_attr);
+    if (m_program < 0) {
+        qDebug() << "UdpXdpBackend::attachProgram: could not load the XDP program, errno" << errno;
+        return false;
+    }
+
+    /* Attach in driver mode if possible, else in generic (skb) mode */
+    memset(&t_attr, 0, sizeof (t_attr));
+    t_attr.link_create.prog_fd = m_program;
+    t_attr.link_create.target_ifindex = m_interfaceIndex;
+    t_attr.link_create.attach_type = BPF_XDP;
+    m_link = bpfCall(BPF_LINK_CREATE, &t_attr);
+    if (m_link < 0) {
+        t_attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+        m_link = bpfCall(BPF_LINK_CREATE, &t_attr);
+    }
+    if (m_link < 0) {
+        qDebug() << "UdpXdpBackend::attachProgram: could not attach the XDP program to" << m_interfaceName
+                 << "errno" << errno;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef UDPXDPBACKEND_H
+#define UDPXDPBACKEND_H
+
+#include "udprawbackend.h"
+
+#include <sys/types.h>
+#include <linux/if_xdp.h>
+
+/* An AF_XDP socket: frames go from our memory (UMEM) to the driver without the network stack.
+ *
+ * - The UMEM is cut in frames of XDP_FRAME_SIZE bytes. The first half is for sending: each frame
+ *   is built once with its Ethernet, IPv4 and UDP headers, later only the payload is rewritten.
+ *   The second half is given to the kernel (fill ring) for receiving.
+ * - Sent frames come back through the completion ring, received frames through the RX ring.
+ * - A small XDP program redirects the UDP datagrams for our port to the socket, everything
+ *   else goes on to the network stack.
+ *
+ * Zero-copy is used when the driver supports it, otherwise copy mode (which works on veth).
+ * Only the queue XDP_QUEUE_ID is used: on multiqueue NICs, steer the echoes to it (ethtool -N).
+ * The socket binds the queue and the program is attached to the interface, so only one flow can
+ * use this backend at a time. UdpSenderListModel refuses a second one.
+ */
+class UdpXdpBackend : public UdpRawBackend
+{
+public:
+    UdpXdpBackend();
+    ~UdpXdpBackend();
+
+    bool open(UdpIoConfig &config) override;
+    void close() override;
+
+    int prepareSend(int count) override;
+    int send(int count, qreal nsecFirstDeparture, qreal nsecInterPacket) override;
+    int receive(int maxCount) override;
+
+    static const int XDP_FRAME_SIZE = 2048;
+    // Frames for sending and for receiving. Each ring holds as much entries.
+    static const int XDP_FRAMES_PER_DIRECTION = 2048;
+    static const int XDP_QUEUE_ID = 0;
+
+private:
+    struct XdpRing {
+        quint32 *producer = NULL;
+        quint32 *consumer = NULL;
+        quint32 *flags = NULL;
+        void *descriptors = NULL;
+        void *map = NULL;
+        size_t mapSize = 0;
+    };
+
+    bool mapRing(XdpRing &ring, const struct xdp_ring_offset &offset, size_t descriptorSize, off_t pageOffset);
+    void unmapRing(XdpRing &ring);
+    bool attachProgram();
+    void reclaimCompletions();
+
+    int m_xdpSocket = -1;
+    char *m_umem = NULL;
+    size_t m_umemSize = 0;
+    XdpRing m_rxRing;
+    XdpRing m_txRing;
+    XdpRing m_fillRing;
+    XdpRing m_completionRing;
+    // Local copies of the indexes we produce or consume
+    quint32 m_txProducer = 0;
+    quint32 m_completionConsumer = 0;
+    quint32 m_rxConsumer = 0;
+    quint32 m_fillProducer = 0;
+
+    // Free sending frames (UMEM offsets), used as a stack
+    QVector<quint64> m_freeTxFrames;
+    int m_freeTxCount = 0;
+    // Frames reserved by prepareSend()
+    QVector<quint64> m_preparedFrames;
+    int m_preparedCount = 0;
+    // Received frames, given back to the fill ring with the next receive()
+    QVector<quint64> m_returnedFrames;
+
+    int m_xskMap = -1;
+    int m_program = -1;
+    int m_link = -1;
+};
+
+#endif // UDPXDPBACKEND_H
@@ -21,7 +21,23 @@ SOURCES += main.cpp\
     udpsender.cpp \
     networkmodel.cpp \
     udpsenderlistmodel.cpp \
-    udpsenderthread.cpp
+    udpsenderthread.cpp \
+    udpflow.cpp \
+    latencyhistogram.cpp \
+    sequencewindow.cpp \
+    payloadgenerator.cpp \
+    crc32c.cpp \
+    rateprofile.cpp \
+    udpsenderscheduler.cpp \
+    udpreceiverthread.cpp \
+    cpuplacement.cpp \
+    udpiobackend.cpp \
+    udpsocketbackend.cpp \
+    iouring.cpp \
+    udpiouringbackend.cpp \
+    udprawbackend.cpp \
+    udpxdpbackend.cpp \
+    udppacketbackend.cpp
 
 HEADERS  += mainwindow.h \
     networklayer.h \
@@ -29,7 +45,24 @@ HEADERS  += mainwindow.h \
     udpsender.h \
     networkmodel.h \
     udpsenderlistmodel.h \
-    udpsenderthread.h
+    udpsenderthread.h \
+    udpflow.h \
+    udpstatsring.h \
+    latencyhistogram.h \
+    sequencewindow.h \
+    payloadgenerator.h \
+    crc32c.h \
+    rateprofile.h \
+    udpsenderscheduler.h \
+    udpreceiverthread.h \
+    cpuplacement.h \
+    udpiobackend.h \
+    udpsocketbackend.h \
+    iouring.h \
+    udpiouringbackend.h \
+    udprawbackend.h \
+    udpxdpbackend.h \
+    udppacketbackend.h
 
 FORMS    += mainwindow.ui
 